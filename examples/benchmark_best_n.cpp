@@ -0,0 +1,144 @@
+/**
+ * \file benchmark_best_n.cpp
+ *
+ * Time the nearest neighbor selection of BestN.h, the heap-ordered
+ * best_n_selector, against the previous best_n selection that rescans all
+ * n kept values after every replacement. Both see the same streams of
+ * (distance, instance index) candidates, with and without many tied
+ * distances, and must keep the same neighbors in the same order.
+ *
+ * Compile with: make benchmark_best_n
+ * Run with: ./benchmark_best_n [candidates [k [queries]]]
+ *   Defaults: 5000 candidates, k = 10, 1000 queries.
+ */
+
+#include <cstdlib>
+#include <climits>
+#include <ctime>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+
+#include "BestN.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// orders candidates by distance only, as the nearest neighbor searches do
+class DistanceLess
+{
+public:
+  bool operator()(const DistancePair& a, const DistancePair& b) const {
+    return a.first < b.first;
+  }
+};
+
+/// The previous best_n selection: rescan for the worst value every time.
+class RescanSelector
+{
+public:
+  RescanSelector(size_t size) : n(size), maxindex(0) {
+    best.reserve(n);
+  }
+  void push(const DistancePair& value) {
+    if(best.size() < n) {
+      best.push_back(value);
+      if(best.size() == n) {
+        maxindex = distance(best.begin(),
+                            max_element(best.begin(), best.end(),
+                                        DistanceLess()));
+      } else {
+        ++maxindex;
+      }
+      return;
+    }
+    if(n && DistanceLess()(value, best[maxindex])) {
+      best[maxindex] = value;
+      maxindex = distance(best.begin(),
+                          max_element(best.begin(), best.end(),
+                                      DistanceLess()));
+    }
+  }
+  const vector<DistancePair>& values() const { return best; }
+private:
+  size_t n;
+  vector<DistancePair> best;
+  size_t maxindex;
+};
+
+/// seconds of CPU time since start
+static double ElapsedSeconds(clock_t start) {
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/// Stream every query's candidates through a selector; keep the neighbors.
+template<class Selector>
+static double TimeSelections(const vector<vector<DistancePair> >& queries,
+                             unsigned int k,
+                             vector<vector<DistancePair> >& neighbors) {
+  neighbors.assign(queries.size(), vector<DistancePair>());
+  clock_t start = clock();
+  for(unsigned int q = 0; q < queries.size(); ++q) {
+    Selector selector(k);
+    const vector<DistancePair>& candidates = queries[q];
+    for(unsigned int c = 0; c < candidates.size(); ++c) {
+      selector.push(candidates[c]);
+    }
+    neighbors[q] = selector.values();
+  }
+  return ElapsedSeconds(start);
+}
+
+/// Time both selectors on the same queries and report the speedup.
+static void CompareSelectors(string name,
+                             const vector<vector<DistancePair> >& queries,
+                             unsigned int k) {
+  typedef insilico::best_n_selector<DistancePair, DistanceLess> HeapSelector;
+  vector<vector<DistancePair> > rescanNeighbors;
+  double rescanSeconds =
+    TimeSelections<RescanSelector>(queries, k, rescanNeighbors);
+  vector<vector<DistancePair> > heapNeighbors;
+  double heapSeconds = TimeSelections<HeapSelector>(queries, k, heapNeighbors);
+  cout << name << ": rescan " << rescanSeconds << " s, heap " << heapSeconds
+          << " s, speedup "
+          << (heapSeconds > 0 ? rescanSeconds / heapSeconds : 0) << "x"
+          << ((heapNeighbors == rescanNeighbors) ? ", same neighbors" :
+              ", DIFFERENT neighbors") << endl;
+}
+
+int main(int argc, char** argv) {
+
+  unsigned int numCandidates = (argc > 1) ? atoi(argv[1]) : 5000;
+  unsigned int k = (argc > 2) ? atoi(argv[2]) : 10;
+  unsigned int numQueries = (argc > 3) ? atoi(argv[3]) : 1000;
+  if(!numCandidates || !numQueries) {
+    cerr << "Usage: " << argv[0] << " [candidates [k [queries]]]" << endl;
+    exit(EXIT_FAILURE);
+  }
+  cout << "Candidates: " << numCandidates << ", k: " << k << ", queries: "
+          << numQueries << endl;
+
+  srand(1);
+  // continuous distances rarely tie; GM-like integer distances tie often
+  vector<vector<DistancePair> > distinctQueries(numQueries);
+  vector<vector<DistancePair> > tiedQueries(numQueries);
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    for(unsigned int c = 0; c < numCandidates; ++c) {
+      distinctQueries[q].push_back(make_pair((double) rand() / RAND_MAX, c));
+      tiedQueries[q].push_back(make_pair((double) (rand() % 100), c));
+    }
+  }
+  CompareSelectors("distinct distances", distinctQueries, k);
+  CompareSelectors("tied distances", tiedQueries, k);
+
+  // candidates arriving nearest last replace the worst neighbor every time
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    sort(distinctQueries[q].begin(), distinctQueries[q].end(),
+         DistanceLess());
+    reverse(distinctQueries[q].begin(), distinctQueries[q].end());
+  }
+  CompareSelectors("nearest last", distinctQueries, k);
+
+  return 0;
+}
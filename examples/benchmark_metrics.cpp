@@ -0,0 +1,129 @@
+/**
+ * \file benchmark_metrics.cpp
+ *
+ * Time each distance metric summed over all attributes of instance pairs:
+ * the diff function pointer path against the inlined metric policies of
+ * DistanceMetricPolicies.h.
+ *
+ * Compile with: make benchmark_metrics
+ * Run with: ./benchmark_metrics snps-file numerics-file phenotype-file
+ *   Pass "" for a missing snps or numerics file.
+ */
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "DistanceMetrics.h"
+#include "DistanceMetricPolicies.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// instance pairs timed per metric
+static const unsigned int MAX_PAIRS = 20000;
+
+/// seconds of CPU time since start
+static double ElapsedSeconds(clock_t start) {
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/// Sum a metric over the attributes of each pair.
+template<class Metric>
+static double TimeDistances(Metric diff, Dataset* ds,
+                            const vector<unsigned int>& indices,
+                            const vector<pair<unsigned int, unsigned int> >& pairs,
+                            vector<double>& distances) {
+  distances.assign(pairs.size(), 0.0);
+  clock_t start = clock();
+  for(unsigned int p = 0; p < pairs.size(); ++p) {
+    DatasetInstance* dsi1 = ds->GetInstance(pairs[p].first);
+    DatasetInstance* dsi2 = ds->GetInstance(pairs[p].second);
+    double distance = 0.0;
+    for(unsigned int i = 0; i < indices.size(); ++i) {
+      distance += diff(indices[i], dsi1, dsi2);
+    }
+    distances[p] = distance;
+  }
+  return ElapsedSeconds(start);
+}
+
+/// Time one metric both ways and report the speedup.
+template<class Metric>
+static void CompareMetric(string name, Metric policy,
+                          PointerMetric::DiffFunction diffFunction,
+                          Dataset* ds, const vector<unsigned int>& indices,
+                          const vector<pair<unsigned int, unsigned int> >& pairs) {
+  vector<double> pointerDistances;
+  double pointerSeconds = TimeDistances(PointerMetric(diffFunction), ds,
+                                        indices, pairs, pointerDistances);
+  vector<double> policyDistances;
+  double policySeconds = TimeDistances(policy, ds, indices, pairs,
+                                       policyDistances);
+  cout << name << ": pointer " << pointerSeconds << " s, policy "
+          << policySeconds << " s, speedup "
+          << (policySeconds > 0 ? pointerSeconds / policySeconds : 0) << "x"
+          << ((policyDistances == pointerDistances) ? ", same distances" :
+              ", DIFFERENT distances") << endl;
+}
+
+int main(int argc, char** argv) {
+
+  if(argc < 4) {
+    cerr << "Usage: " << argv[0] << " snps-file numerics-file phenotype-file"
+            << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  string snpsFilename = argv[1];
+  Dataset* ds = (snpsFilename == "") ? new Dataset() :
+    ChooseSnpsDatasetByType(snpsFilename);
+  if(!ds) {
+    exit(EXIT_FAILURE);
+  }
+  vector<string> ids;
+  if(!ds->LoadDataset(argv[1], argv[2], argv[3], ids)) {
+    cerr << "ERROR: Could not load data set." << endl;
+    exit(EXIT_FAILURE);
+  }
+  unsigned int numInstances = ds->NumInstances();
+  cout << "Instances: " << numInstances << ", attributes: "
+          << ds->NumAttributes() << ", numerics: " << ds->NumNumerics() << endl;
+
+  /// The same instance pairs for every metric.
+  vector<pair<unsigned int, unsigned int> > pairs;
+  for(unsigned int i = 0; (i < numInstances) && (pairs.size() < MAX_PAIRS); ++i) {
+    for(unsigned int j = i + 1; (j < numInstances) && (pairs.size() < MAX_PAIRS);
+        ++j) {
+      pairs.push_back(make_pair(i, j));
+    }
+  }
+  cout << "Instance pairs: " << pairs.size() << endl;
+
+  if(ds->HasGenotypes()) {
+    vector<unsigned int> attributeIndices =
+      ds->MaskGetAttributeIndices(DISCRETE_TYPE);
+    ds->PrepareNucleotideCountTables();
+    CompareMetric("gm", GMMetric(), diffGMM, ds, attributeIndices, pairs);
+    CompareMetric("am", AMMetric(), diffAMM, ds, attributeIndices, pairs);
+    CompareMetric("nca", NCAMetric(), diffNCA, ds, attributeIndices, pairs);
+    CompareMetric("nca6", NCA6Metric(), diffNCA6, ds, attributeIndices, pairs);
+    CompareMetric("km", KMMetric(), diffKM, ds, attributeIndices, pairs);
+  }
+  if(ds->HasNumerics()) {
+    vector<unsigned int> numericIndices =
+      ds->MaskGetAttributeIndices(NUMERIC_TYPE);
+    CompareMetric("manhattan", ManhattanMetric(), diffManhattan, ds,
+                  numericIndices, pairs);
+    CompareMetric("euclidean", EuclideanMetric(), diffEuclidean, ds,
+                  numericIndices, pairs);
+  }
+
+  delete ds;
+
+  return 0;
+}
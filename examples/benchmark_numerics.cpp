@@ -0,0 +1,127 @@
+/**
+ * \file benchmark_numerics.cpp
+ *
+ * Time all-pairs Manhattan distances over a numerics data set: the
+ * per-attribute diffManhattan path against the NumericsMatrix kernels.
+ *
+ * Compile with: make benchmark_numerics
+ * Run with: ./benchmark_numerics numerics-file phenotype-file
+ */
+
+#include <cstdlib>
+#include <ctime>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "NumericsMatrix.h"
+
+using namespace std;
+
+/// seconds of CPU time since start
+static double ElapsedSeconds(clock_t start) {
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv) {
+
+  if(argc < 3) {
+    cerr << "Usage: " << argv[0] << " numerics-file phenotype-file" << endl;
+    exit(EXIT_FAILURE);
+  }
+
+  Dataset* ds = new Dataset();
+  vector<string> ids;
+  if(!ds->LoadDataset("", argv[1], argv[2], ids)) {
+    cerr << "ERROR: Could not load data set." << endl;
+    exit(EXIT_FAILURE);
+  }
+  ds->SetDistanceMetrics("gm", "manhattan");
+  unsigned int numInstances = ds->NumInstances();
+  cout << "Instances: " << numInstances << ", numerics: "
+          << ds->NumNumerics() << endl;
+
+  /// Per-attribute distances: diffManhattan for every numeric of every pair.
+  vector<double> reference;
+  reference.reserve(numInstances * (numInstances - 1) / 2);
+  clock_t start = clock();
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    for(unsigned int j = i + 1; j < numInstances; ++j) {
+      reference.push_back(
+        ds->ComputeInstanceToInstanceDistance(ds->GetInstance(i),
+                                              ds->GetInstance(j)));
+    }
+  }
+  double referenceSeconds = ElapsedSeconds(start);
+  cout << "diffManhattan per attribute: " << referenceSeconds << " s" << endl;
+
+  /// Copy the numerics into a matrix the way Dataset does.
+  vector<DatasetInstance*> instances;
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    instances.push_back(ds->GetInstance(i));
+  }
+  vector<pair<double, double> > numericsMinMax;
+  for(unsigned int n = 0; n < ds->NumNumerics(); ++n) {
+    numericsMinMax.push_back(ds->GetMinMaxForNumeric(n));
+  }
+  NumericsMatrix matrix;
+  start = clock();
+  if(!matrix.Build(instances, ds->MaskGetAttributeIndices(NUMERIC_TYPE),
+                   numericsMinMax)) {
+    cerr << "ERROR: Could not build the numerics matrix." << endl;
+    exit(EXIT_FAILURE);
+  }
+  cout << "NumericsMatrix build: " << ElapsedSeconds(start) << " s" << endl;
+
+  /// Time each kernel the CPU supports and compare it to the reference.
+  NumericsMatrix::KernelType kernels[] = {
+    NumericsMatrix::SCALAR_KERNEL,
+    NumericsMatrix::AVX2_KERNEL,
+    NumericsMatrix::AVX512_KERNEL
+  };
+  vector<double> scalarDistances;
+  for(unsigned int k = 0; k < 3; ++k) {
+    if(!NumericsMatrix::IsKernelSupported(kernels[k])) {
+      cout << NumericsMatrix::KernelName(kernels[k])
+              << " kernel: not supported" << endl;
+      continue;
+    }
+    matrix.SetKernel(kernels[k]);
+    vector<double> distances;
+    distances.reserve(reference.size());
+    start = clock();
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      for(unsigned int j = i + 1; j < numInstances; ++j) {
+        distances.push_back(matrix.DistanceManhattan(i, j));
+      }
+    }
+    double kernelSeconds = ElapsedSeconds(start);
+    double maxRelativeDiff = 0.0;
+    for(unsigned int d = 0; d < distances.size(); ++d) {
+      double diff = fabs(distances[d] - reference[d]);
+      if(reference[d] != 0.0) {
+        diff /= fabs(reference[d]);
+      }
+      if(diff > maxRelativeDiff) {
+        maxRelativeDiff = diff;
+      }
+    }
+    if(kernels[k] == NumericsMatrix::SCALAR_KERNEL) {
+      scalarDistances = distances;
+    }
+    cout << NumericsMatrix::KernelName(kernels[k]) << " kernel: "
+            << kernelSeconds << " s, speedup "
+            << (kernelSeconds > 0 ? referenceSeconds / kernelSeconds : 0)
+            << "x, max relative difference " << maxRelativeDiff
+            << ((distances == scalarDistances) ? ", same as scalar" :
+                ", DIFFERS from scalar") << endl;
+  }
+
+  delete ds;
+
+  return 0;
+}
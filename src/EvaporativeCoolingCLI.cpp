@@ -46,6 +46,8 @@ int main(int argc, char** argv) {
 	string snpsFilename = "";
 	string snpsFileType = "";
 	string snpExclusionFile = "";
+	string snpLoadIncludeFile = "";
+	string snpLoadExcludeFile = "";
 	string numericsFilename = "";
 	string dgeCountsFilename = "";
 	string dgeNormsFilename = "";
@@ -58,6 +60,8 @@ int main(int argc, char** argv) {
 	string outputDatasetFilename = "";
 	string outputFilesPrefix = "ec_run";
 	string distanceMatrixFilename = "";
+	string distanceMatrixPrecision = "float64";
+	string distanceMatrixFormat = "text";
 	string gainMatrixFilename = "";
 	string titvFilename = "";
 	// Random Jungle
@@ -81,6 +85,10 @@ int main(int argc, char** argv) {
 	string numMetric = "manhattan";
 	string weightByDistanceMethod = "equal";
 	double weightByDistanceSigma = 2.0;
+	string neighborSearch = "exact";
+	double neighborRecall = 0.9;
+	string neighborCacheDirectory = "";
+	string inputDistanceMatrixFilename = "";
 	// diagnostic
 	string diagnosticLogFilename = "";
 	string diagnosticLevelsCountsFilename = "";
@@ -105,6 +113,7 @@ int main(int argc, char** argv) {
 		("verbose", "verbose output")
 		("convert", "convert data set to data set - no ec")
 		("fast-gwas", "run in fast GWAS mode with minimal metadata")
+		("packed-genotypes", "store SNPs in a 2-bit packed matrix to reduce memory use")
 		("monomorphic-filter", "exclude monomorphic SNPs from EC analysis")
 		("optimize-temp,T", "optimize coupling constant T")
 		(
@@ -271,6 +280,16 @@ int main(int argc, char** argv) {
 		"file of SNP names to be excluded"
 		)
 		(
+		"snp-load-include",
+		po::value<string > (&snpLoadIncludeFile),
+		"file of SNP names to load; others are skipped while reading (plinkbed)"
+		)
+		(
+		"snp-load-exclude",
+		po::value<string > (&snpLoadExcludeFile),
+		"file of SNP names skipped while reading the SNP data (plinkbed)"
+		)
+		(
 		"k-nearest-neighbors,k",
 		po::value<unsigned int>(&k)->default_value(k),
 		"set k nearest neighbors"
@@ -291,6 +310,26 @@ int main(int argc, char** argv) {
 		"weight by distance sigma"
 		)
 		(
+		"neighbor-search",
+		po::value<string > (&neighborSearch)->default_value(neighborSearch),
+		"nearest neighbor search (exact|lsh); lsh finds approximate neighbors by random projection hashing"
+		)
+		(
+		"neighbor-recall",
+		po::value<double>(&neighborRecall)->default_value(neighborRecall),
+		"fraction of the exact nearest neighbors --neighbor-search lsh must find, or it searches exactly"
+		)
+		(
+		"neighbor-cache",
+		po::value<string > (&neighborCacheDirectory),
+		"directory caching nearest neighbors between runs on the same data"
+		)
+		(
+		"input-distance-matrix",
+		po::value<string > (&inputDistanceMatrixFilename),
+		"find nearest neighbors from this binary or text distance matrix, matched by instance ID, instead of computing distances"
+		)
+		(
 		"diagnostic-tests,d",
 		po::value<string > (&diagnosticLogFilename),
 		"performs diagnostic tests and sends output to filename without running EC"
@@ -341,6 +380,16 @@ int main(int argc, char** argv) {
 		"create a distance matrix for the loaded samples and exit"
 		)
 		(
+		"distance-matrix-precision",
+		po::value<string > (&distanceMatrixPrecision)->default_value(distanceMatrixPrecision),
+		"distance matrix precision (float64|float32); float32 halves the memory"
+		)
+		(
+		"distance-matrix-format",
+		po::value<string > (&distanceMatrixFormat)->default_value(distanceMatrixFormat),
+		"distance matrix file format (text|binary); binary is one mmap-able file"
+		)
+		(
 		"gain-matrix",
 		po::value<string > (&gainMatrixFilename),
 		"create a GAIN matrix for the loaded samples and exit"
@@ -535,6 +584,12 @@ int main(int argc, char** argv) {
 			if(!ds) {
 				break;
 			}
+			if(!ds->SetAttributeLoadLists(snpLoadIncludeFile, snpLoadExcludeFile)) {
+				break;
+			}
+			if(vm.count("packed-genotypes")) {
+				ds->SetPackedGenotypeStorage(true);
+			}
 			datasetLoaded = ds->LoadDataset(snpsFilename, "",
 																			altPhenotypeFilename, indIds);
 			break;
@@ -553,6 +608,12 @@ int main(int argc, char** argv) {
 			if(!ds) {
 				break;
 			}
+			if(!ds->SetAttributeLoadLists(snpLoadIncludeFile, snpLoadExcludeFile)) {
+				break;
+			}
+			if(vm.count("packed-genotypes")) {
+				ds->SetPackedGenotypeStorage(true);
+			}
 			datasetLoaded = ds->LoadDataset(snpsFilename, numericsFilename,
 																			altPhenotypeFilename, indIds);
 			break;
@@ -752,24 +813,22 @@ int main(int argc, char** argv) {
 	/// distance matrix calculation(s) do their work, then exit main() before EC
 	if(vm.count("distance-matrix") || vm.count("gain-matrix")) {
 		if(vm.count("distance-matrix")) {
-			double** distanceMatrix = 0;
-		  /// create a distance matrix
-		  vector<string> instanceIds = ds->MaskGetInstanceIds();
-		  int numInstances = instanceIds.size();
-		  distanceMatrix = new double*[numInstances];
-		  for(int i = 0; i < numInstances; ++i) {
-		    distanceMatrix[i] = new double[numInstances];
-		    for(int j = 0; j < numInstances; ++j) {
-		      distanceMatrix[i][j] = 0.0;
-		    }
-		  }
-			if(ds->CalculateDistanceMatrix(distanceMatrix, distanceMatrixFilename)) {
-				for(unsigned int i=0; i < ds->NumInstances(); ++i) {
-					delete [] distanceMatrix[i];
-				}
-				delete [] distanceMatrix;
+			/// create a packed distance matrix
+			DistancePrecision precision;
+			if(!DistanceMatrix::ParsePrecision(distanceMatrixPrecision, precision)) {
+				cerr << "ERROR: Invalid --distance-matrix-precision: "
+						<< distanceMatrixPrecision << endl;
+				exit(COMMAND_LINE_ERROR);
 			}
-			else {
+			DistanceFileFormat fileFormat;
+			if(!DistanceMatrix::ParseFileFormat(distanceMatrixFormat, fileFormat)) {
+				cerr << "ERROR: Invalid --distance-matrix-format: "
+						<< distanceMatrixFormat << endl;
+				exit(COMMAND_LINE_ERROR);
+			}
+			DistanceMatrix distanceMatrix;
+			if(!ds->CalculateDistanceMatrix(distanceMatrix, precision,
+					distanceMatrixFilename, fileFormat)) {
 				cerr << "ERROR: Could not calculate a distance matrix." << endl;
 				exit(EXIT_FAILURE);
 			}
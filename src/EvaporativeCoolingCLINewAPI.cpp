@@ -57,6 +57,10 @@ int main(int argc, char** argv) {
   string numMetric = "manhattan";
   string weightByDistanceMethod = "equal";
   double weightByDistanceSigma = 2.0;
+  string neighborSearch = "exact";
+  double neighborRecall = 0.9;
+  string neighborCacheDirectory = "";
+  string inputDistanceMatrixFilename = "";
   // diagnostic
   string diagnosticLogFilename = "";
   string diagnosticLevelsCountsFilename = "";
@@ -161,6 +165,26 @@ int main(int argc, char** argv) {
            po::value<double>(&weightByDistanceSigma)->default_value(weightByDistanceSigma),
            "weight by distance sigma"
            )
+          (
+           "neighbor-search",
+           po::value<string > (&neighborSearch)->default_value(neighborSearch),
+           "nearest neighbor search (exact|lsh); lsh finds approximate neighbors by random projection hashing"
+           )
+          (
+           "neighbor-recall",
+           po::value<double>(&neighborRecall)->default_value(neighborRecall),
+           "fraction of the exact nearest neighbors --neighbor-search lsh must find, or it searches exactly"
+           )
+          (
+           "neighbor-cache",
+           po::value<string > (&neighborCacheDirectory),
+           "directory caching nearest neighbors between runs on the same data"
+           )
+          (
+           "input-distance-matrix",
+           po::value<string > (&inputDistanceMatrixFilename),
+           "find nearest neighbors from this binary or text distance matrix, matched by instance ID, instead of computing distances"
+           )
           (
            "diagnostic-tests,d",
            po::value<string > (&diagnosticLogFilename),
@@ -459,6 +483,18 @@ int main(int argc, char** argv) {
   configMap.insert(make_pair("weight-by-distance-method",weightByDistanceMethod));
   ss << weightByDistanceSigma;
   configMap.insert(make_pair("weight-by-distance-sigma", ss.str()));
+  ss.str("");
+  configMap.insert(make_pair("neighbor-search", neighborSearch));
+  ss << neighborRecall;
+  configMap.insert(make_pair("neighbor-recall", ss.str()));
+  ss.str("");
+  if(neighborCacheDirectory != "") {
+    configMap.insert(make_pair("neighbor-cache", neighborCacheDirectory));
+  }
+  if(inputDistanceMatrixFilename != "") {
+    configMap.insert(make_pair("input-distance-matrix",
+                               inputDistanceMatrixFilename));
+  }
   EvaporativeCooling ec(ds, configMap, analysisType);
 
   if(!ec.ComputeECScores()) {
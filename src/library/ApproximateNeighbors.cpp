@@ -0,0 +1,444 @@
+/*
+ * ApproximateNeighbors.cpp
+ *
+ * Approximate nearest neighbors by random projection hashing
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <climits>
+#include <omp.h>
+
+#include "ApproximateNeighbors.h"
+#include "PairwiseDistances.h"
+#include "NeighborSelections.h"
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "GSLRandomFlat.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// tables of the first recall measurement; doubled until the target is met
+static const unsigned int INITIAL_TABLES = 4;
+static const unsigned int MAX_TABLES = 64;
+/// most bits in a hash key
+static const unsigned int MAX_BITS = 24;
+/// most features in one sparse random projection
+static const unsigned int MAX_TERMS_PER_BIT = 64;
+/// instances per bucket to aim for, per nearest neighbor list entry
+static const unsigned int BUCKET_INSTANCES_PER_NEIGHBOR = 4;
+/// smallest bucket to aim for
+static const unsigned int MIN_BUCKET_INSTANCES = 32;
+/// queries whose exact neighbors measure the recall
+static const unsigned int RECALL_SAMPLE_SIZE = 100;
+/// projections are the same for the same data
+static const int PROJECTION_SEED = 20261015;
+/// recall target unless set
+static const double DEFAULT_RECALL_TARGET = 0.9;
+
+/// orders hash buckets by key only
+class BucketKeyLess
+{
+public:
+  bool operator()(const pair<unsigned int, unsigned int>& a,
+                  const pair<unsigned int, unsigned int>& b) const {
+    return a.first < b.first;
+  }
+};
+
+/// Count the approximate neighbors no farther than the worst exact neighbor.
+static void CountRecall(const DistancePairs& exact,
+                        const DistancePairs& approximate,
+                        unsigned int& found, unsigned int& wanted) {
+  if(exact.empty()) {
+    return;
+  }
+  double worstExact = max_element(exact.begin(), exact.end(),
+                                  DistancePairLess())->first;
+  unsigned int numFound = 0;
+  for(unsigned int i = 0; i < approximate.size(); ++i) {
+    if(approximate[i].first <= worstExact) {
+      ++numFound;
+    }
+  }
+  found += min(numFound, (unsigned int) exact.size());
+  wanted += exact.size();
+}
+
+ApproximateNeighbors::ApproximateNeighbors(Dataset* ds,
+                                           PairwiseDistances* exactSearch) {
+  dataset = ds;
+  exactDistances = exactSearch;
+  recallTarget = DEFAULT_RECALL_TARGET;
+  measuredRecall = 1.0;
+}
+
+bool ApproximateNeighbors::SetRecallTarget(double newRecallTarget) {
+  if((newRecallTarget <= 0.0) || (newRecallTarget > 1.0)) {
+    cerr << "ERROR: ApproximateNeighbors: recall target " << newRecallTarget
+            << " is not in (0, 1]" << endl;
+    return false;
+  }
+  recallTarget = newRecallTarget;
+
+  return true;
+}
+
+bool ApproximateNeighbors::ComputeNearestNeighbors(
+  const vector<unsigned int>& instanceIndices,
+  const vector<unsigned int>& queryIndices, unsigned int k) {
+  unsigned int numInstances = instanceIndices.size();
+  unsigned int numQueries = queryIndices.size();
+  measuredRecall = 1.0;
+  if(!exactDistances->PrepareBlocks(numInstances)) {
+    return false;
+  }
+  instances = instanceIndices;
+
+  map<unsigned int, unsigned int> instancePositions;
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    instancePositions[instanceIndices[i]] = i;
+  }
+  vector<unsigned int> queryPositions(numQueries);
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    map<unsigned int, unsigned int>::const_iterator positionIt =
+      instancePositions.find(queryIndices[q]);
+    if(positionIt == instancePositions.end()) {
+      cerr << "ERROR: ApproximateNeighbors: query instance " << queryIndices[q]
+              << " is not one of the instances" << endl;
+      return false;
+    }
+    queryPositions[q] = positionIt->second;
+  }
+
+  byClass = !dataset->HasContinuousPhenotypes();
+  classes.assign(numInstances, 0);
+  classCounts.clear();
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    if(byClass) {
+      classes[i] = dataset->GetInstance(instanceIndices[i])->GetClass();
+    }
+    ++classCounts[classes[i]];
+  }
+
+  // bits so the buckets hold a few instances per neighbor list entry
+  unsigned int bucketTarget = BUCKET_INSTANCES_PER_NEIGHBOR * k *
+    classCounts.size();
+  if(bucketTarget < MIN_BUCKET_INSTANCES) {
+    bucketTarget = MIN_BUCKET_INSTANCES;
+  }
+  numBits = 0;
+  while((numBits < MAX_BITS) &&
+        ((numInstances >> (numBits + 1)) >= bucketTarget)) {
+    ++numBits;
+  }
+  bool hasFeatures =
+    (dataset->HasGenotypes() &&
+     dataset->MaskGetAttributeIndices(DISCRETE_TYPE).size()) ||
+    (dataset->HasNumerics() &&
+     dataset->MaskGetAttributeIndices(NUMERIC_TYPE).size());
+  if(!numBits || !hasFeatures) {
+    cout << Timestamp() << "Too few instances to hash for approximate "
+            << "nearest neighbors; searching exactly" << endl;
+    return ComputeExactNeighbors(queryIndices, k);
+  }
+
+  // exact neighbors of evenly spaced queries, to measure the recall
+  unsigned int sampleStep = (numQueries > RECALL_SAMPLE_SIZE) ?
+    (numQueries / RECALL_SAMPLE_SIZE) : 1;
+  vector<unsigned int> sampleQueries;
+  vector<char> sampled(numQueries, 0);
+  for(unsigned int q = 0; (q < numQueries) &&
+        (sampleQueries.size() < RECALL_SAMPLE_SIZE); q += sampleStep) {
+    sampleQueries.push_back(q);
+    sampled[q] = 1;
+  }
+  vector<NeighborSelections> exactSelections(sampleQueries.size(),
+                                             NeighborSelections(k));
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int s = 0; s < (int) sampleQueries.size(); ++s) {
+    SelectNeighbors(queryPositions[sampleQueries[s]], vector<unsigned int>(),
+                    k, exactSelections[s]);
+  }
+
+  // more tables until the sampled queries reach the recall target
+  GSLRandomFlat rng(PROJECTION_SEED, 0.0, 1.0);
+  projections.clear();
+  featureMeans.clear();
+  keys.clear();
+  buckets.clear();
+  vector<NeighborSelections> selections(numQueries, NeighborSelections(k));
+  vector<char> searchedExactly(numQueries, 0);
+  for(unsigned int numTables = INITIAL_TABLES; numTables <= MAX_TABLES;
+      numTables *= 2) {
+    AddTables(numTables - keys.size(), rng);
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int s = 0; s < (int) sampleQueries.size(); ++s) {
+      unsigned int q = sampleQueries[s];
+      selections[q] = NeighborSelections(k);
+      searchedExactly[q] = SearchBuckets(queryPositions[q], k, selections[q]);
+    }
+    unsigned int found = 0;
+    unsigned int wanted = 0;
+    for(unsigned int s = 0; s < sampleQueries.size(); ++s) {
+      const NeighborSelections& exact = exactSelections[s];
+      const NeighborSelections& approximate = selections[sampleQueries[s]];
+      CountRecall(exact.hits.values(), approximate.hits.values(), found,
+                  wanted);
+      map<ClassLevel, NeighborSelector>::const_iterator missIt =
+        exact.misses.begin();
+      for(; missIt != exact.misses.end(); ++missIt) {
+        map<ClassLevel, NeighborSelector>::const_iterator approximateIt =
+          approximate.misses.find(missIt->first);
+        CountRecall(missIt->second.values(),
+                    (approximateIt == approximate.misses.end()) ?
+                    DistancePairs() : approximateIt->second.values(),
+                    found, wanted);
+      }
+    }
+    measuredRecall = wanted ? ((double) found / wanted) : 1.0;
+    cout << Timestamp() << "Approximate nearest neighbor recall "
+            << measuredRecall << " on " << sampleQueries.size()
+            << " sampled instances with " << numTables << " tables of "
+            << numBits << " bit keys" << endl;
+    if(measuredRecall >= recallTarget) {
+      break;
+    }
+  }
+  if(measuredRecall < recallTarget) {
+    cout << Timestamp() << "Approximate nearest neighbors missed the recall "
+            << "target " << recallTarget << "; searching exactly" << endl;
+    keys.clear();
+    buckets.clear();
+    measuredRecall = 1.0;
+    return ComputeExactNeighbors(queryIndices, k);
+  }
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for(int q = 0; q < (int) numQueries; ++q) {
+    if(!sampled[q]) {
+      searchedExactly[q] = SearchBuckets(queryPositions[q], k, selections[q]);
+    }
+  }
+  unsigned int numSearchedExactly = 0;
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    numSearchedExactly += searchedExactly[q];
+  }
+  cout << Timestamp() << "Approximate nearest neighbors of " << numQueries
+          << " of " << numInstances << " instances; " << numSearchedExactly
+          << " with too few candidates searched exactly" << endl;
+  keys.clear();
+  buckets.clear();
+
+#pragma omp parallel for
+  for(int q = 0; q < (int) numQueries; ++q) {
+    SetInstanceNeighbors(dataset->GetInstance(queryIndices[q]), selections[q],
+                         byClass);
+  }
+
+  return true;
+}
+
+void ApproximateNeighbors::AddTables(unsigned int numNewTables,
+                                     GSLRandomFlat& rng) {
+  vector<unsigned int> attributes;
+  if(dataset->HasGenotypes()) {
+    attributes = dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
+  }
+  vector<unsigned int> numerics;
+  if(dataset->HasNumerics()) {
+    numerics = dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
+  }
+  unsigned int numFeatures = attributes.size() + numerics.size();
+  unsigned int termsPerBit = (numFeatures < MAX_TERMS_PER_BIT) ?
+    numFeatures : MAX_TERMS_PER_BIT;
+
+  // sparse projections: random features with random signs
+  unsigned int firstTable = keys.size();
+  for(unsigned int bit = 0; bit < numNewTables * numBits; ++bit) {
+    vector<ProjectionTerm> terms(termsPerBit);
+    for(unsigned int t = 0; t < termsPerBit; ++t) {
+      unsigned int feature = (unsigned int) (rng.nextRandVal() * numFeatures);
+      if(feature >= numFeatures) {
+        feature = numFeatures - 1;
+      }
+      double sign = (rng.nextRandVal() < 0.5) ? -1.0 : 1.0;
+      ProjectionTerm& term = terms[t];
+      term.numeric = (feature >= attributes.size());
+      term.index = term.numeric ? numerics[feature - attributes.size()] :
+        attributes[feature];
+      term.center = FeatureMean(term.index, term.numeric);
+      term.weight = sign;
+      if(term.numeric) {
+        pair<double, double> minMax =
+          dataset->GetMinMaxForNumeric(term.index);
+        double range = minMax.second - minMax.first;
+        term.weight = (range > 0.0) ? (sign / range) : 0.0;
+      }
+    }
+    projections.push_back(terms);
+  }
+
+  unsigned int numInstances = instances.size();
+  keys.resize(firstTable + numNewTables, vector<HashKey>(numInstances, 0));
+#pragma omp parallel for schedule(dynamic, 64)
+  for(int i = 0; i < (int) numInstances; ++i) {
+    DatasetInstance* dsi = dataset->GetInstance(instances[i]);
+    for(unsigned int table = firstTable; table < keys.size(); ++table) {
+      HashKey key = 0;
+      for(unsigned int bit = 0; bit < numBits; ++bit) {
+        const vector<ProjectionTerm>& terms =
+          projections[table * numBits + bit];
+        double projection = 0.0;
+        for(unsigned int t = 0; t < terms.size(); ++t) {
+          const ProjectionTerm& term = terms[t];
+          // a missing value is the mean, adding nothing
+          if(term.numeric) {
+            NumericLevel value = dsi->numerics[term.index];
+            if(value != MISSING_NUMERIC_VALUE) {
+              projection += term.weight * (value - term.center);
+            }
+          } else {
+            AttributeLevel level = dsi->GetAttribute(term.index);
+            if(level != MISSING_ATTRIBUTE_VALUE) {
+              projection += term.weight * (level - term.center);
+            }
+          }
+        }
+        key = (key << 1) | ((projection > 0.0) ? 1 : 0);
+      }
+      keys[table][i] = key;
+    }
+  }
+
+  buckets.resize(keys.size());
+#pragma omp parallel for
+  for(int table = firstTable; table < (int) keys.size(); ++table) {
+    HashBuckets& tableBuckets = buckets[table];
+    tableBuckets.resize(numInstances);
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      tableBuckets[i] = make_pair(keys[table][i], i);
+    }
+    sort(tableBuckets.begin(), tableBuckets.end());
+  }
+}
+
+double ApproximateNeighbors::FeatureMean(unsigned int index, bool numeric) {
+  pair<bool, unsigned int> feature = make_pair(numeric, index);
+  map<pair<bool, unsigned int>, double>::const_iterator meanIt =
+    featureMeans.find(feature);
+  if(meanIt != featureMeans.end()) {
+    return meanIt->second;
+  }
+  double sum = 0.0;
+  unsigned int numPresent = 0;
+  for(unsigned int i = 0; i < instances.size(); ++i) {
+    DatasetInstance* dsi = dataset->GetInstance(instances[i]);
+    if(numeric) {
+      NumericLevel value = dsi->numerics[index];
+      if(value != MISSING_NUMERIC_VALUE) {
+        sum += value;
+        ++numPresent;
+      }
+    } else {
+      AttributeLevel level = dsi->GetAttribute(index);
+      if(level != MISSING_ATTRIBUTE_VALUE) {
+        sum += level;
+        ++numPresent;
+      }
+    }
+  }
+  double mean = numPresent ? (sum / numPresent) : 0.0;
+  featureMeans[feature] = mean;
+
+  return mean;
+}
+
+bool ApproximateNeighbors::SearchBuckets(unsigned int position, unsigned int k,
+                                         NeighborSelections& selections) {
+  vector<unsigned int> candidates;
+  for(unsigned int table = 0; table < keys.size(); ++table) {
+    pair<HashBuckets::const_iterator, HashBuckets::const_iterator> bucket =
+      equal_range(buckets[table].begin(), buckets[table].end(),
+                  make_pair(keys[table][position], 0u), BucketKeyLess());
+    for(; bucket.first != bucket.second; ++bucket.first) {
+      if(bucket.first->second != position) {
+        candidates.push_back(bucket.first->second);
+      }
+    }
+  }
+  sort(candidates.begin(), candidates.end());
+  candidates.erase(unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+  if(!candidates.empty()) {
+    SelectNeighbors(position, candidates, k, selections);
+    if(SelectionsFilled(position, k, selections)) {
+      return false;
+    }
+    selections = NeighborSelections(k);
+  }
+  SelectNeighbors(position, vector<unsigned int>(), k, selections);
+
+  return true;
+}
+
+void ApproximateNeighbors::SelectNeighbors(
+  unsigned int position, const vector<unsigned int>& candidates,
+  unsigned int k, NeighborSelections& selections) {
+  unsigned int queryIndex = instances[position];
+  unsigned int numCandidates = candidates.empty() ? instances.size() :
+    candidates.size();
+  for(unsigned int c = 0; c < numCandidates; ++c) {
+    unsigned int j = candidates.empty() ? c : candidates[c];
+    if(j == position) {
+      continue;
+    }
+    // lower position first, as the matrix's upper triangle computes it
+    double distance = (j < position) ?
+      dataset->ComputeInstanceToInstanceDistance(instances[j], queryIndex) :
+      dataset->ComputeInstanceToInstanceDistance(queryIndex, instances[j]);
+    OfferNeighbor(selections, k, byClass, classes[position], classes[j],
+                  make_pair(distance, instances[j]));
+  }
+}
+
+bool ApproximateNeighbors::SelectionsFilled(
+  unsigned int position, unsigned int k,
+  const NeighborSelections& selections) {
+  ClassLevel thisClass = classes[position];
+  unsigned int numHitCandidates = classCounts.find(thisClass)->second - 1;
+  if(selections.hits.values().size() < min(k, numHitCandidates)) {
+    return false;
+  }
+  if(!byClass) {
+    return true;
+  }
+  map<ClassLevel, unsigned int>::const_iterator classIt = classCounts.begin();
+  for(; classIt != classCounts.end(); ++classIt) {
+    if(classIt->first == thisClass) {
+      continue;
+    }
+    map<ClassLevel, NeighborSelector>::const_iterator missIt =
+      selections.misses.find(classIt->first);
+    unsigned int numMisses = (missIt == selections.misses.end()) ? 0 :
+      missIt->second.values().size();
+    if(numMisses < min(k, classIt->second)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool ApproximateNeighbors::ComputeExactNeighbors(
+  const vector<unsigned int>& queryIndices, unsigned int k) {
+  if(queryIndices.size() == instances.size()) {
+    return exactDistances->ComputeNearestNeighbors(instances, k);
+  }
+
+  return exactDistances->ComputeNearestNeighbors(instances, queryIndices, k);
+}
@@ -0,0 +1,142 @@
+/**
+ * \class ApproximateNeighbors
+ *
+ * \brief Approximate nearest neighbors by random projection hashing.
+ *
+ * An opt-in alternative to the exact searches of PairwiseDistances for data
+ * sets too large for n x n distances. Each instance is hashed into tables of
+ * locality sensitive hash keys: every key bit is the sign of a sparse random
+ * projection of the instance's centered genotypes and range-scaled numerics,
+ * so near instances tend to share keys. A query's candidates are the
+ * instances sharing a key with it in any table; they are ranked by their
+ * exact distances into the usual nearest hits and misses, or neighbors for
+ * continuous phenotypes, in the order the exact search would offer them.
+ * Queries whose candidates cannot fill every neighbor list are searched
+ * exactly.
+ *
+ * Recall is measured against the exact neighbors of a fixed sample of the
+ * queries: an approximate neighbor counts when it is no farther than the
+ * k-th exact neighbor of its list, so ties are not misses. Tables are added
+ * until the recall target is reached, or the search falls back to the exact
+ * one. Projections use a fixed seed, so the neighbors do not change from run
+ * to run or with the number of threads.
+ *
+ * \sa PairwiseDistances, ReliefF
+ */
+
+#ifndef APPROXIMATENEIGHBORS_H
+#define	APPROXIMATENEIGHBORS_H
+
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "Insilico.h"
+
+class Dataset;
+class PairwiseDistances;
+class GSLRandomFlat;
+struct NeighborSelections;
+
+class ApproximateNeighbors
+{
+public:
+  /*************************************************************************//**
+   * Construct an approximate search for a data set.
+   * \param [in] ds data set whose distance metrics and masks are used
+   * \param [in] exactSearch exact search used for its distance preparation
+   *                         and when the approximation is not good enough
+   ****************************************************************************/
+  ApproximateNeighbors(Dataset* ds, PairwiseDistances* exactSearch);
+  /*************************************************************************//**
+   * Find approximate k nearest neighbors of query instances and set them in
+   * those instances, like PairwiseDistances::ComputeNearestNeighbors.
+   * \param [in] instanceIndices data set indices of the n candidate instances
+   * \param [in] queryIndices data set indices of the m query instances, each
+   *                          one of the candidates, without repeats
+   * \param [in] k number of nearest neighbors
+   * \return success
+   ****************************************************************************/
+  bool ComputeNearestNeighbors(const std::vector<unsigned int>& instanceIndices,
+                               const std::vector<unsigned int>& queryIndices,
+                               unsigned int k);
+  /// Fraction of the exact neighbors to find, in (0, 1].
+  bool SetRecallTarget(double newRecallTarget);
+  double GetRecallTarget() const { return recallTarget; }
+  /// Recall measured by the last search, 1 if it searched exactly.
+  double GetMeasuredRecall() const { return measuredRecall; }
+private:
+  /// hash key of an instance in one table, one bit per projection
+  typedef unsigned int HashKey;
+  /// (hash key, instance position) of a table, sorted
+  typedef std::vector<std::pair<HashKey, unsigned int> > HashBuckets;
+  /// one feature of a sparse random projection
+  struct ProjectionTerm
+  {
+    /// attribute or numeric index
+    unsigned int index;
+    /// numeric, or else genotype?
+    bool numeric;
+    /// value subtracted, the feature's mean
+    double center;
+    /// random sign, over the numeric's range
+    double weight;
+  };
+  /*************************************************************************//**
+   * Add random projection hash tables over the current masks.
+   * \param [in] numNewTables tables to add
+   * \param [in,out] rng uniform [0, 1) draws choosing the projections
+   ****************************************************************************/
+  void AddTables(unsigned int numNewTables, GSLRandomFlat& rng);
+  /// Mean of a genotype or numeric over the instances, without missing values.
+  double FeatureMean(unsigned int index, bool numeric);
+  /*************************************************************************//**
+   * Select the neighbors of one query among the instances sharing a key with
+   * it, or among all instances if those cannot fill its neighbor lists.
+   * \param [in] position query's position among the instances
+   * \param [in] k number of nearest neighbors
+   * \param [out] selections query's nearest neighbors
+   * \return true if the query was searched exactly
+   ****************************************************************************/
+  bool SearchBuckets(unsigned int position, unsigned int k,
+                     NeighborSelections& selections);
+  /*************************************************************************//**
+   * Select the neighbors of one query among candidate instances, offered in
+   * increasing position with distances oriented as the exact search does.
+   * \param [in] position query's position among the instances
+   * \param [in] candidates sorted candidate positions; all if empty
+   * \param [in] k number of nearest neighbors
+   * \param [out] selections query's nearest neighbors
+   ****************************************************************************/
+  void SelectNeighbors(unsigned int position,
+                       const std::vector<unsigned int>& candidates,
+                       unsigned int k, NeighborSelections& selections);
+  /// Do the selections hold as many neighbors as the exact search finds?
+  bool SelectionsFilled(unsigned int position, unsigned int k,
+                        const NeighborSelections& selections);
+  /// Exact search of the queries by the PairwiseDistances engine.
+  bool ComputeExactNeighbors(const std::vector<unsigned int>& queryIndices,
+                             unsigned int k);
+
+  Dataset* dataset;
+  PairwiseDistances* exactDistances;
+  double recallTarget;
+  double measuredRecall;
+  /// the current search: data set indices of the candidate instances
+  std::vector<unsigned int> instances;
+  /// are there hits and misses, and the class and class sizes of instances
+  bool byClass;
+  std::vector<ClassLevel> classes;
+  std::map<ClassLevel, unsigned int> classCounts;
+  /// bits per hash key
+  unsigned int numBits;
+  /// projections of the tables: table by table, bit by bit
+  std::vector<std::vector<ProjectionTerm> > projections;
+  /// feature means, by (numeric?, index)
+  std::map<std::pair<bool, unsigned int>, double> featureMeans;
+  /// each table's hash key of every instance, and its sorted keys
+  std::vector<std::vector<HashKey> > keys;
+  std::vector<HashBuckets> buckets;
+};
+
+#endif	/* APPROXIMATENEIGHBORS_H */
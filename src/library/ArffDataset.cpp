@@ -97,7 +97,7 @@ bool ArffDataset::LoadSnps(string filename) {
 					}
 					if (attributeType == "NUMERIC") {
 						attributeTypes.push_back(ARFF_NUMERIC_TYPE);
-						numericsMask[attributeName] = numericsIndex;
+						numericsMask.Set(attributeName, numericsIndex);
 						numericsNames.push_back(attributeName);
 						++numericsIndex;
 					} else {
@@ -125,7 +125,7 @@ bool ArffDataset::LoadSnps(string filename) {
 						if ((nominals[0] == "0") && (nominals[1] == "1")
 								&& (nominals[2] == "2")) {
 							nominalValues[attributeName] = nominals;
-							attributesMask[attributeName] = attributeIndex;
+							attributesMask.Set(attributeName, attributeIndex);
 						} else {
 							cerr << "ERROR: This dataset is currently unsupported. SNP data "
 									<< "must be encoded with {0, 1, 2} for {homozygous1, "
@@ -298,7 +298,7 @@ bool ArffDataset::LoadSnps(string filename) {
 							instances.push_back(newInst);
 							instanceIds.push_back(ID);
 							// instanceIdsToLoad.push_back(ID);
-							instancesMask[ID] = instanceIndex;
+							instancesMask.Set(ID, instanceIndex);
 						} else {
 							cerr << "ERROR: loading ARFF @data section. "
 									<< "Could not create dataset instance for line number "
@@ -10,15 +10,104 @@
  * Created on: 4/7/04
  */
 
+#ifndef BESTN_H
+#define BESTN_H
+
 #include <vector>
 #include <algorithm>
-#include <boost/pointee.hpp>
+#include <iterator>
 
 namespace insilico
 {
 
   /***************************************************************************//**
-   * Get the best n values with ties keeping same original order.
+   * Keeps the best n of a stream of values, one value at a time: the
+   * selection step of best_n.
+   *
+   * The first n values fill n slots in order. After that, a value replaces
+   * the worst kept value only if it is strictly better, so among equal
+   * values the earlier ones stay. When several kept values are equally
+   * worst, the one in the lowest slot is replaced. The best values are
+   * returned in slot order. The same values in the same order always give
+   * the same result.
+   *
+   * The slots are ordered by a max-heap of slot numbers, worst value on top
+   * and lowest slot first among equals, so a replacement costs O(log n)
+   * instead of a rescan of all n slots.
+   ******************************************************************************/
+  template <typename T, typename Comp>
+  class best_n_selector
+  {
+  public:
+    /***************************************************************************//**
+     * Construct an empty selector.
+     * \param [in] size best n value
+     * \param [in] comp compare functor
+     ******************************************************************************/
+    best_n_selector(size_t size, Comp comp = Comp()) : n(size),
+      compare(comp) {
+      best.reserve(n);
+      worst.reserve(n);
+    }
+    /***************************************************************************//**
+     * Offer the next value of the stream.
+     * \param [in] value next value
+     ******************************************************************************/
+    void push(const T& value) {
+      if(best.size() < n) {
+        best.push_back(value);
+        worst.push_back(best.size() - 1);
+        if(best.size() == n) {
+          std::make_heap(worst.begin(), worst.end(),
+                         slot_order(best, compare));
+          worstValue = best[worst.front()];
+        }
+        return;
+      }
+
+      if(n && compare(value, worstValue)) {
+        slot_order order(best, compare);
+        // take the worst slot off the heap, then put it back with its new value
+        std::pop_heap(worst.begin(), worst.end(), order);
+        best[worst.back()] = value;
+        std::push_heap(worst.begin(), worst.end(), order);
+        worstValue = best[worst.front()];
+      }
+    }
+    /// The best values so far, in slot order.
+    const std::vector<T>& values() const { return best; }
+  private:
+    /// heap order of slots: worse values first, then lower slots
+    class slot_order
+    {
+    public:
+      slot_order(const std::vector<T>& slotValues, const Comp& comp) :
+        values(slotValues), compare(comp) { }
+      bool operator()(size_t a, size_t b) const {
+        if(compare(values[a], values[b]))
+          return true;
+        if(compare(values[b], values[a]))
+          return false;
+        return a > b;
+      }
+    private:
+      const std::vector<T>& values;
+      const Comp& compare;
+    };
+
+    size_t n;
+    /// the best values, one per slot
+    std::vector<T> best;
+    /// max-heap of the slots, worst value on top
+    std::vector<size_t> worst;
+    /// the value in the top slot, once all n slots are filled
+    T worstValue;
+    Comp compare;
+  };
+
+  /***************************************************************************//**
+   * Get the best n values with ties keeping same original order; see
+   * best_n_selector.
    * \param [in] begin iterator of the beginning of a input container
    * \param [in] end iterator of the end of a input container
    * \param [out] out iterator of the beginning of a output container
@@ -28,40 +117,17 @@ namespace insilico
    ******************************************************************************/
   template <typename InputIt, typename OutputIt, typename Comp>
   void best_n(InputIt begin, InputIt end, OutputIt out, size_t n, Comp comp) {
-    typedef typename boost::pointee<InputIt>::type T;
-    typename std::vector<T> best;
-    std::vector<size_t> indices(n);
-    int maxindex = 0;
-    int i = 0;
-
-    best.reserve(n);
-
-    for(typename std::vector<T>::const_iterator it = begin;
-        it != end; ++it, ++i) {
-      if(best.size() < n) {
-        indices[maxindex] = i;
-        best.push_back(*it);
-
-        if(best.size() == n)
-          maxindex = std::distance(best.begin(),
-                                   std::max_element(best.begin(), best.end(), comp));
-        else
-          ++maxindex;
+    typedef typename std::iterator_traits<InputIt>::value_type T;
+    best_n_selector<T, Comp> selector(n, comp);
 
-        continue;
-      }
+    for(InputIt it = begin; it != end; ++it)
+      selector.push(*it);
 
-      if(comp(*it, best[maxindex])) {
-        indices[maxindex] = i;
-        best[maxindex] = *it;
-        maxindex = std::distance(best.begin(),
-                                 std::max_element(best.begin(), best.end(), comp));
-      }
-    }
-
-    for(typename std::vector<T>::iterator i = best.begin();
-        i != best.end(); ++i)
+    for(typename std::vector<T>::const_iterator i = selector.values().begin();
+        i != selector.values().end(); ++i)
       *out++ = *i;
   }
 
 }
+
+#endif /* BESTN_H */
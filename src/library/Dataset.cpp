@@ -42,6 +42,8 @@
 #include "DgeData.h"
 #include "BirdseedData.h"
 #include "DistanceMetrics.h"
+#include "DistanceMetricPolicies.h"
+#include "PairwiseDistances.h"
 
 using namespace std;
 using namespace insilico;
@@ -60,11 +62,20 @@ Dataset::Dataset() {
 	hasPhenotypes = true;
 	hasContinuousPhenotypes = false;
 	fastGWAS = false;
+	usePackedGenotypes = false;
+	genotypeBitPlanesVersion = 0;
+	numericsMatrixVersion = 0;
+	distanceVersion = 0;
+	missingBitmapsBuilt = false;
+	missingBitmapsVersion = 0;
+	missingBitmapsInstances = 0;
 	
 	classColumn = 0;
 
 	maskIsPushed = false;
 
+	attributesFilteredOnLoad = false;
+
 	/// Load attribute mutation map for transitions/transversions.
 	attributeMutationMap[make_pair('A', 'G')] = TRANSITION_MUTATION;
 	attributeMutationMap[make_pair('G', 'A')] = TRANSITION_MUTATION;
@@ -145,7 +156,7 @@ bool Dataset::LoadDataset(vector<vector<AttributeLevel> >& dataMatrix,
 
 	for (unsigned int i = 0; i < numAttributes; ++i) {
 		attributeNames.push_back(attrNames[i]);
-		attributesMask[attrNames[i]] = i;
+		attributesMask.Set(attrNames[i], i);
 	}
 
 	cout << Timestamp() << attributeNames.size() << " attribute names read"
@@ -166,7 +177,7 @@ bool Dataset::LoadDataset(vector<vector<AttributeLevel> >& dataMatrix,
 		classIndexes[classLabels[rowIndex]].push_back(rowIndex);
 		instances.push_back(dsi);
 		instanceIds.push_back(ID);
-		instancesMask[ID] = rowIndex;
+		instancesMask.Set(ID, rowIndex);
 	}
 
 	hasGenotypes = true;
@@ -179,6 +190,12 @@ bool Dataset::LoadDataset(vector<vector<AttributeLevel> >& dataMatrix,
 	PrintStatsSimple();
 	// PrintLevelCounts();
 
+	if (usePackedGenotypes && hasGenotypes && !PackGenotypes()) {
+		return false;
+	}
+
+	PrepareMissingBitmaps();
+
 	// create and seed a random number generator for random sampling
 	// TODO: need to save the seed for repeatability? used to randomly sample
 	rng = new GSLRandomFlat(getpid() * time((time_t*) 0), 0.0, NumInstances());
@@ -208,6 +225,19 @@ bool Dataset::LoadDataset(string snpsFilename, string numericsFilename,
 			cerr << "ERROR in LoadDataset. Could not load SNPs file" << endl;
 			return false;
 		}
+		// mask out attributes the loader could not skip while reading
+		if (!attributesFilteredOnLoad
+				&& (attributeNamesToInclude.size() || attributeNamesToExclude.size())) {
+			vector<string> loadedNames = attributesMask.GetNames();
+			for (unsigned int i = 0; i < loadedNames.size(); ++i) {
+				if (!IsLoadableAttributeName(loadedNames[i])) {
+					MaskRemoveVariableType(loadedNames[i], DISCRETE_TYPE);
+				}
+			}
+			cout << Timestamp() << attributesMask.size()
+					<< " attributes remain after applying include/exclude lists"
+					<< endl;
+		}
 		if (instancesMask.size() == 0) {
 			cerr << "ERROR: No instances for analysis" << endl;
 			return false;
@@ -229,7 +259,7 @@ bool Dataset::LoadDataset(string snpsFilename, string numericsFilename,
 			cout << Timestamp() << "Finding matching IDs" << endl;
 			vector<DatasetInstance*> tempInstances;
 			vector<string> tempInstanceIds;
-			map<string, unsigned int> tempInstancesMask;
+			DatasetMask tempInstancesMask;
 			for (unsigned int i = 0; i < instanceIdsToLoad.size(); ++i) {
 				unsigned int instanceIndex = 0;
 				string ID = instanceIdsToLoad[i];
@@ -240,7 +270,7 @@ bool Dataset::LoadDataset(string snpsFilename, string numericsFilename,
 				}
 				tempInstances.push_back(instances[instanceIndex]);
 				tempInstanceIds.push_back(ID);
-				tempInstancesMask[ID] = nextInstanceIndex;
+				tempInstancesMask.Set(ID, nextInstanceIndex);
 				++nextInstanceIndex;
 			}
 			instances = tempInstances;
@@ -273,6 +303,10 @@ bool Dataset::LoadDataset(string snpsFilename, string numericsFilename,
 
 	hasPhenotypes = true;
 
+	if (usePackedGenotypes && hasGenotypes && !PackGenotypes()) {
+		return false;
+	}
+
 	// create and seed a random number generator for random sampling
 	rng = new GSLRandomFlat(getpid() * time((time_t*) 0), 0.0, NumInstances());
 
@@ -292,7 +326,7 @@ bool Dataset::LoadDataset(DgeData* dgeData) {
 		numericsNames.push_back(geneNames[geneIndex]);
 		numericsMinMax.push_back(dgeData->GetGeneMinMax(geneIndex));
 		numericsSums.push_back(dgeData->GetGeneCountsSum(geneIndex));
-		numericsMask[geneNames[geneIndex]] = geneIndex;
+		numericsMask.Set(geneNames[geneIndex], geneIndex);
 	}
 
 	// load the data set instances: set the instance numerics,
@@ -310,7 +344,7 @@ bool Dataset::LoadDataset(DgeData* dgeData) {
 		string ID = sampleNames[instanceIndex] + sampleNames[instanceIndex];
 		instanceIds.push_back(ID);
 		numericsIds.push_back(ID);
-		instancesMask[ID] = instanceIndex;
+		instancesMask.Set(ID, instanceIndex);
 		ClassLevel thisClass = dgeData->GetSamplePhenotype(instanceIndex);
 		dsi->SetClass(thisClass);
 		classIndexes[thisClass].push_back(instanceIndex);
@@ -323,6 +357,10 @@ bool Dataset::LoadDataset(DgeData* dgeData) {
 	hasNumerics = true;
 	hasAllelicInfo = false;
 
+	if (usePackedGenotypes && hasGenotypes && !PackGenotypes()) {
+		return false;
+	}
+
 	// create and seed a random number generator for random sampling
 	rng = new GSLRandomFlat(getpid() * time((time_t*) 0), 0.0, NumInstances());
 
@@ -341,7 +379,7 @@ bool Dataset::LoadDataset(BirdseedData* birdseedData) {
 	int numAttributes = snpNames.size();
 	for (int i = 0; i < numAttributes; ++i) {
 		attributeNames.push_back(snpNames[i]);
-		attributesMask[snpNames[i]] = i;
+		attributesMask.Set(snpNames[i], i);
 	}
 	attributeLevelsSeen.resize(numAttributes);
 	genotypeCounts.resize(numAttributes);
@@ -374,7 +412,7 @@ bool Dataset::LoadDataset(BirdseedData* birdseedData) {
 		string ID = sampleNames[instanceIndex] + sampleNames[instanceIndex];
 		instanceIds.push_back(ID);
 //			attributeIds.push_back(ID);
-		instancesMask[ID] = instanceIndex;
+		instancesMask.Set(ID, instanceIndex);
 
 		vector<unsigned int> bsMissingValues;
 		bool hasMissingValues = birdseedData->GetMissingValues(ID,
@@ -428,6 +466,10 @@ bool Dataset::LoadDataset(BirdseedData* birdseedData) {
 	UpdateAllLevelCounts();
 	// PrintLevelCounts();
 
+	if (usePackedGenotypes && hasGenotypes && !PackGenotypes()) {
+		return false;
+	}
+
 	// create and seed a random number generator for random sampling
 	rng = new GSLRandomFlat(getpid() * time((time_t*) 0), 0.0, NumInstances());
 
@@ -501,7 +543,7 @@ bool Dataset::WriteNewDataset(string newDatasetFilename,
 		newDatasetStream << "@RELATION dataset" << endl << endl;
 	}
 	cout << Timestamp() << "Writing new data set header" << endl;
-	map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+	DatasetMask::const_iterator ait = attributesMask.begin();
 	for (; ait != attributesMask.end(); ++ait) {
 		switch (outputDatasetType) {
 		case TAB_DELIMITED_DATASET:
@@ -524,7 +566,7 @@ bool Dataset::WriteNewDataset(string newDatasetFilename,
 		}
 	}
 
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		switch (outputDatasetType) {
 		case TAB_DELIMITED_DATASET:
@@ -703,7 +745,7 @@ bool Dataset::WriteNewDataset(string newDatasetFilename,
 	if (outputDatasetType == ARFF_DATASET) {
 		newDatasetStream << "@RELATION dataset" << endl << endl;
 	}
-	map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+	DatasetMask::const_iterator ait = attributesMask.begin();
 	for (; ait != attributesMask.end(); ++ait) {
 		/// is this attribute in the list passed in as a parameter
 		if (find(attributes.begin(), attributes.end(), ait->first)
@@ -730,7 +772,7 @@ bool Dataset::WriteNewDataset(string newDatasetFilename,
 			return false;
 		}
 	}
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		switch (outputDatasetType) {
 		if (find(attributes.begin(), attributes.end(), nit->first)
@@ -1002,23 +1044,20 @@ DatasetInstance* Dataset::GetInstance(unsigned int index) {
 }
 
 DatasetInstance* Dataset::GetRandomInstance() {
-	unsigned int index = (unsigned int) rng->nextRandVal();
-	return instances[index];
+	return instances[GetRandomInstanceIndex()];
+}
+
+unsigned int Dataset::GetRandomInstanceIndex() {
+	return (unsigned int) rng->nextRandVal();
 }
 
 vector<string> Dataset::GetInstanceIds() {
-	vector<string> idsToReturn;
-	map<string, unsigned int>::const_iterator it = instancesMask.begin();
-	for (; it != instancesMask.end(); ++it) {
-		idsToReturn.push_back(it->first);
-	}
-	return idsToReturn;
+	return instancesMask.GetNames();
 }
 
 bool Dataset::GetInstanceIndexForID(string ID, unsigned int& instanceIndex) {
 
-	if (instancesMask.find(ID) != instancesMask.end()) {
-		instanceIndex = instancesMask[ID];
+	if (instancesMask.Find(ID, instanceIndex)) {
 		return true;
 	}
 
@@ -1032,12 +1071,7 @@ unsigned int Dataset::NumAttributes() {
 }
 
 vector<string> Dataset::GetAttributeNames() {
-	vector<string> names;
-	map<string, unsigned int>::const_iterator it = attributesMask.begin();
-	for (; it != attributesMask.end(); ++it) {
-		names.push_back(it->first);
-	}
-	return names;
+	return attributesMask.GetNames();
 }
 
 vector<string> Dataset::GetFileAttributeNames() {
@@ -1061,7 +1095,18 @@ bool Dataset::GetAttributeValues(unsigned int attributeIndex,
 	}
 	if (hasGenotypes) {
 		attributeValues.clear();
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
+		if (packedGenotypes.IsAllocated()) {
+			// read the column straight out of the packed matrix
+			vector<unsigned int> packedIndices;
+			packedIndices.reserve(instancesMask.size());
+			for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
+				packedIndices.push_back(instances[it->second]->GetPackedIndex());
+			}
+			packedGenotypes.GetAttributeValues(attributeIndex, packedIndices,
+					attributeValues);
+			return true;
+		}
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			AttributeLevel thisAttribute = instances[it->second]->GetAttribute(
 					attributeIndex);
@@ -1109,9 +1154,9 @@ AttributeLevel Dataset::GetAttribute(unsigned instanceIndex, string name) {
 				<< " out of range" << endl;
 		exit(1);
 	}
-	map<string, unsigned int>::iterator pos = attributesMask.find(name);
-	if (pos != attributesMask.end()) {
-		return instances[instanceIndex]->GetAttribute(pos->second);
+	unsigned int attributeIndex = 0;
+	if (attributesMask.Find(name, attributeIndex)) {
+		return instances[instanceIndex]->GetAttribute(attributeIndex);
 	} else {
 		cerr << "ERROR: Dataset::GetAttribute: " << name
 				<< " at instance index: " << instanceIndex << " not found"
@@ -1194,6 +1239,46 @@ bool Dataset::ProcessExclusionFile(string exclusionFilename) {
 	return true;
 }
 
+bool Dataset::SetAttributeLoadLists(string includeFilename,
+		string excludeFilename) {
+	vector<string> listFilenames;
+	listFilenames.push_back(includeFilename);
+	listFilenames.push_back(excludeFilename);
+	vector<set<string>*> listNames;
+	listNames.push_back(&attributeNamesToInclude);
+	listNames.push_back(&attributeNamesToExclude);
+	for (unsigned int listIdx = 0; listIdx < listFilenames.size(); ++listIdx) {
+		listNames[listIdx]->clear();
+		if (listFilenames[listIdx] == "") {
+			continue;
+		}
+		ifstream dataStream(listFilenames[listIdx].c_str());
+		if (!dataStream.is_open()) {
+			cerr << "ERROR: Could not open attribute list file: "
+					<< listFilenames[listIdx] << endl;
+			return false;
+		}
+		string line;
+		while (getline(dataStream, line)) {
+			string attributeName = trim(line);
+			if (attributeName.size()) {
+				listNames[listIdx]->insert(attributeName);
+			}
+		}
+		dataStream.close();
+	}
+	if (attributeNamesToInclude.size()) {
+		cout << Timestamp() << attributeNamesToInclude.size()
+				<< " attributes in the include list" << endl;
+	}
+	if (attributeNamesToExclude.size()) {
+		cout << Timestamp() << attributeNamesToExclude.size()
+				<< " attributes in the exclude list" << endl;
+	}
+
+	return true;
+}
+
 AttributeMutationType Dataset::GetAttributeMutationType(
 		unsigned int attributeIndex) {
 	if ((attributeIndex >= 0)
@@ -1203,46 +1288,43 @@ AttributeMutationType Dataset::GetAttributeMutationType(
 	return UNKNOWN_MUTATION;
 }
 
-double Dataset::GetJukesCantorDistance(DatasetInstance* dsi1,
+/// Mismatch counts of two instances at the attributes, as in diffKM.
+static GenotypeBitPlanes::MutationCounts CountMutations(Dataset* ds,
+		const vector<unsigned int>& attributeIndices, DatasetInstance* dsi1,
 		DatasetInstance* dsi2) {
-	double returnValue = 0.0;
-
-	double d = 0.0;
-	vector<unsigned int> attributeIndicies = MaskGetAttributeIndices(
-			DISCRETE_TYPE);
-	for (unsigned int attrIdx = 0; attrIdx < attributeIndicies.size();
-			++attrIdx) {
-		AttributeLevel dsi1Al = dsi1->GetAttribute(attributeIndicies[attrIdx]);
-		AttributeLevel dsi2Al = dsi2->GetAttribute(attributeIndicies[attrIdx]);
-		d += ((dsi1Al == dsi2Al) ? 0 : 1);
-	}
-
-	returnValue = (-3.0 / 4.0) * log(1.0 - (4.0 / 3.0) * ((double) d));
-
-	return returnValue;
-}
-
-double Dataset::GetKimuraDistance(DatasetInstance* dsi1,
-		DatasetInstance* dsi2) {
-	vector<unsigned int> attributeIndicies = MaskGetAttributeIndices(
-			DISCRETE_TYPE);
-	double p = 0, q = 0;
-	for (unsigned int attrIdx = 0; attrIdx < attributeIndicies.size();
+	GenotypeBitPlanes::MutationCounts counts = { 0, 0, 0 };
+	for (unsigned int attrIdx = 0; attrIdx < attributeIndices.size();
 			++attrIdx) {
-		AttributeLevel dsi1Al = dsi1->GetAttribute(attributeIndicies[attrIdx]);
-		AttributeLevel dsi2Al = dsi2->GetAttribute(attributeIndicies[attrIdx]);
+		AttributeLevel dsi1Al = dsi1->GetAttribute(attributeIndices[attrIdx]);
+		AttributeLevel dsi2Al = dsi2->GetAttribute(attributeIndices[attrIdx]);
 		if (dsi1Al != dsi2Al) {
-			if (GetAttributeMutationType(attributeIndicies[attrIdx])
-					== TRANSITION_MUTATION) {
-				++p;
+			++counts.mismatches;
+			AttributeMutationType mutationType = ds->GetAttributeMutationType(
+					attributeIndices[attrIdx]);
+			if (mutationType == TRANSITION_MUTATION) {
+				++counts.transitions;
 			}
-			if (GetAttributeMutationType(attributeIndicies[attrIdx])
-					== TRANSVERSION_MUTATION) {
-				++q;
+			if (mutationType == TRANSVERSION_MUTATION) {
+				++counts.transversions;
 			}
 		}
 	}
-	double npos = (double) attributeIndicies.size();
+	return counts;
+}
+
+/// Jukes-Cantor distance from mismatch counts.
+static double JukesCantorDistance(
+		const GenotypeBitPlanes::MutationCounts& counts) {
+	double d = (double) counts.mismatches;
+	return (-3.0 / 4.0) * log(1.0 - (4.0 / 3.0) * ((double) d));
+}
+
+/// Kimura distance from mismatch counts over numAttributes attributes.
+static double KimuraDistance(const GenotypeBitPlanes::MutationCounts& counts,
+		unsigned int numAttributes) {
+	double p = (double) counts.transitions;
+	double q = (double) counts.transversions;
+	double npos = (double) numAttributes;
 	double P = p / npos;
 	double Q = q / npos;
 	double w1 = 1.0 - 2.0 * P - Q;
@@ -1252,6 +1334,21 @@ double Dataset::GetKimuraDistance(DatasetInstance* dsi1,
 	return kimuraDistance;
 }
 
+double Dataset::GetJukesCantorDistance(DatasetInstance* dsi1,
+		DatasetInstance* dsi2) {
+	return JukesCantorDistance(
+			CountMutations(this, MaskGetAttributeIndices(DISCRETE_TYPE), dsi1,
+					dsi2));
+}
+
+double Dataset::GetKimuraDistance(DatasetInstance* dsi1,
+		DatasetInstance* dsi2) {
+	const vector<unsigned int>& attributeIndicies = MaskGetAttributeIndices(
+			DISCRETE_TYPE);
+	return KimuraDistance(CountMutations(this, attributeIndicies, dsi1, dsi2),
+			attributeIndicies.size());
+}
+
 unsigned int Dataset::NumLevels(unsigned int index) {
 	if ((index >= 0) && (index < attributeLevelsSeen.size())) {
 		return attributeLevelsSeen[index].size();
@@ -1276,12 +1373,7 @@ unsigned int Dataset::NumNumerics() {
 }
 
 vector<string> Dataset::GetNumericsNames() {
-	vector<string> names;
-	map<string, unsigned int>::const_iterator it = numericsMask.begin();
-	for (; it != numericsMask.end(); ++it) {
-		names.push_back(it->first);
-	}
-	return names;
+	return numericsMask.GetNames();
 }
 
 vector<string> Dataset::GetFileNumericsNames() {
@@ -1302,7 +1394,7 @@ pair<NumericLevel, NumericLevel> Dataset::GetMinMaxForNumeric(
 
 double Dataset::GetMeanForNumeric(unsigned int numericIdx) {
 	double sum = 0.0;
-	vector<unsigned int> instanceIndicies = MaskGetInstanceIndices();
+	const vector<unsigned int>& instanceIndicies = MaskGetInstanceIndices();
 	for (unsigned int i = 0; i < instanceIndicies.size(); ++i) {
 		sum += instances[instanceIndicies[i]]->numerics[numericIdx];
 	}
@@ -1324,9 +1416,9 @@ NumericLevel Dataset::GetNumeric(unsigned instanceIndex, string name) {
 				<< " out of range" << endl;
 		exit(1);
 	}
-	map<string, unsigned int>::iterator pos = numericsMask.find(name);
-	if (pos != numericsMask.end()) {
-		return instances[instanceIndex]->GetNumeric(pos->second);
+	unsigned int numericIndex = 0;
+	if (numericsMask.Find(name, numericIndex)) {
+		return instances[instanceIndex]->GetNumeric(numericIndex);
 	} else {
 		cerr << "ERROR: Dataset::GetNumeric" << endl;
 		exit(1);
@@ -1361,12 +1453,15 @@ unsigned int Dataset::GetNumericIndexFromName(string numericName) {
 }
 
 bool Dataset::TransformNumericsNormalize() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	// the numerics matrix holds copies of the old values
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
 		double thisColSum = numericsSums[thisNumIndex];
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			DatasetInstance* dsi = instances[it->second];
 			double thisVal = dsi->GetNumeric(thisNumIndex);
@@ -1379,7 +1474,9 @@ bool Dataset::TransformNumericsNormalize() {
 }
 
 bool Dataset::TransformNumericsZScore() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
@@ -1388,7 +1485,7 @@ bool Dataset::TransformNumericsZScore() {
 		vector<NumericLevel> zValues;
 		ZTransform(colValues, zValues);
 		vector<NumericLevel>::const_iterator zIt = zValues.begin();
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end();
 				++it, ++zIt) {
 			DatasetInstance* dsi = instances[it->second];
@@ -1399,7 +1496,9 @@ bool Dataset::TransformNumericsZScore() {
 }
 
 bool Dataset::TransformNumericsStandardize() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
@@ -1407,7 +1506,7 @@ bool Dataset::TransformNumericsStandardize() {
 		double thisColAvg = thisColSum / ((double) NumInstances());
 		pair<double, double> thisColMinMax = numericsMinMax[thisNumIndex];
 		double thisColRange = thisColMinMax.second - thisColMinMax.first;
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			DatasetInstance* dsi = instances[it->second];
 			double thisVal = dsi->GetNumeric(thisNumIndex);
@@ -1421,11 +1520,13 @@ bool Dataset::TransformNumericsStandardize() {
 }
 
 bool Dataset::TransformNumericsLog() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			DatasetInstance* dsi = instances[it->second];
 			double thisVal = dsi->GetNumeric(thisNumIndex);
@@ -1439,11 +1540,13 @@ bool Dataset::TransformNumericsLog() {
 }
 
 bool Dataset::TransformNumericsSqrt() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			DatasetInstance* dsi = instances[it->second];
 			double thisVal = dsi->GetNumeric(thisNumIndex);
@@ -1456,12 +1559,14 @@ bool Dataset::TransformNumericsSqrt() {
 }
 
 bool Dataset::TransformNumericsAnscombe() {
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	numericsMatrix.Clear();
+	++distanceVersion;
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	double threeEighths = 3.0 / 8.0;
 	for (; nit != numericsMask.end(); ++nit) {
 		string thisNumName = nit->first;
 		unsigned int thisNumIndex = nit->second;
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			DatasetInstance* dsi = instances[it->second];
 			double thisVal = dsi->GetNumeric(thisNumIndex);
@@ -1491,7 +1596,7 @@ unsigned int Dataset::GetClassColumn() {
 bool Dataset::GetClassValues(vector<ClassLevel>& classValues) {
 	if (hasPhenotypes) {
 		classValues.clear();
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			classValues.push_back(instances[it->second]->GetClass());
 		}
@@ -1533,15 +1638,15 @@ pair<double, double> Dataset::GetMinMaxForContinuousPhenotype() {
 void Dataset::Print() {
 	PrintStats();
 	cout << Timestamp() << "Data set values:" << endl << endl;
-	map<string, unsigned int>::const_iterator it;
+	DatasetMask::const_iterator it;
 	for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 		DatasetInstance* dsi = instances[it->second];
 		cout << instanceIds[it->second] << "\t";
-		map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+		DatasetMask::const_iterator ait = attributesMask.begin();
 		for (; ait != attributesMask.end(); ++ait) {
-			cout << dsi->attributes[ait->second] << "\t";
+			cout << dsi->GetAttribute(ait->second) << "\t";
 		}
-		map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+		DatasetMask::const_iterator nit = numericsMask.begin();
 		for (; nit != numericsMask.end(); ++nit) {
 			cout << dsi->numerics[nit->second] << "\t";
 		}
@@ -1842,22 +1947,15 @@ bool Dataset::MaskRemoveVariable(string variableName) {
 
 bool Dataset::MaskRemoveVariableType(string variableName,
 		AttributeType varType) {
-	map<string, unsigned int>::iterator pos;
 	if (varType == DISCRETE_TYPE) {
-		pos = attributesMask.find(variableName);
-		if (pos != attributesMask.end()) {
-			attributesMask.erase(pos);
-		} else {
+		if (!attributesMask.Remove(variableName)) {
 			cerr
 					<< "ERROR: Dataset::MaskRemoveVariable failed for SNP attribute name: "
 					<< variableName << ". name not found" << endl;
 			return false;
 		}
 	} else {
-		pos = numericsMask.find(variableName);
-		if (pos != numericsMask.end()) {
-			numericsMask.erase(pos);
-		} else {
+		if (!numericsMask.Remove(variableName)) {
 			cerr << "ERROR: Dataset::MaskRemoveVariable failed for numerics"
 					<< " attribute name: " << variableName << ". name not found"
 					<< endl;
@@ -1869,21 +1967,10 @@ bool Dataset::MaskRemoveVariableType(string variableName,
 
 bool Dataset::MaskSearchVariableType(string variableName,
 		AttributeType varType) {
-	map<string, unsigned int>::iterator pos;
 	if (varType == DISCRETE_TYPE) {
-		pos = attributesMask.find(variableName);
-		if (pos != attributesMask.end()) {
-			return true;
-		} else {
-			return false;
-		}
+		return attributesMask.Contains(variableName);
 	} else {
-		pos = numericsMask.find(variableName);
-		if (pos != numericsMask.end()) {
-			return true;
-		} else {
-			return false;
-		}
+		return numericsMask.Contains(variableName);
 	}
 }
 
@@ -1893,7 +1980,7 @@ bool Dataset::MaskIncludeAllAttributes(AttributeType attrType) {
 		unsigned int attributeIndex = 0;
 		vector<string>::const_iterator it = attributeNames.begin();
 		for (; it != attributeNames.end(); ++it) {
-			attributesMask[*it] = attributeIndex;
+			attributesMask.Set(*it, attributeIndex);
 			++attributeIndex;
 		}
 		return true;
@@ -1902,31 +1989,23 @@ bool Dataset::MaskIncludeAllAttributes(AttributeType attrType) {
 		unsigned int attributeIndex = 0;
 		vector<string>::const_iterator it = numericsNames.begin();
 		for (; it != numericsNames.end(); ++it) {
-			numericsMask[*it] = attributeIndex;
+			numericsMask.Set(*it, attributeIndex);
 			++attributeIndex;
 		}
 		return true;
 	}
 }
 
-vector<unsigned int> Dataset::MaskGetAttributeIndices(AttributeType attrType) {
-	vector<unsigned int> indices;
+const vector<unsigned int>& Dataset::MaskGetAttributeIndices(
+		AttributeType attrType) {
 	if (attrType == DISCRETE_TYPE) {
-		map<string, unsigned int>::const_iterator it = attributesMask.begin();
-		for (; it != attributesMask.end(); ++it) {
-			indices.push_back(it->second);
-		}
+		return attributesMask.GetIndices();
 	} else {
-		map<string, unsigned int>::const_iterator it = numericsMask.begin();
-		for (; it != numericsMask.end(); ++it) {
-			indices.push_back(it->second);
-		}
+		return numericsMask.GetIndices();
 	}
-	return indices;
 }
 
-const map<string, unsigned int>&
-Dataset::MaskGetAttributeMask(AttributeType attrType) {
+const DatasetMask& Dataset::MaskGetAttributeMask(AttributeType attrType) {
 	if (attrType == DISCRETE_TYPE) {
 		return attributesMask;
 	} else {
@@ -1936,11 +2015,11 @@ Dataset::MaskGetAttributeMask(AttributeType attrType) {
 
 vector<string> Dataset::MaskGetAllVariableNames() {
 	vector<string> names;
-	map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+	DatasetMask::const_iterator ait = attributesMask.begin();
 	for (; ait != attributesMask.end(); ++ait) {
 		names.push_back(ait->first);
 	}
-	map<string, unsigned int>::const_iterator nit = numericsMask.begin();
+	DatasetMask::const_iterator nit = numericsMask.begin();
 	for (; nit != numericsMask.end(); ++nit) {
 		names.push_back(nit->first);
 	}
@@ -1948,10 +2027,7 @@ vector<string> Dataset::MaskGetAllVariableNames() {
 }
 
 bool Dataset::MaskRemoveInstance(std::string instanceId) {
-	map<string, unsigned int>::iterator pos = instancesMask.find(instanceId);
-	if (pos != instancesMask.end()) {
-		instancesMask.erase(pos);
-	} else {
+	if (!instancesMask.Remove(instanceId)) {
 		cerr << "ERROR: Dataset::MaskRemoveInstance failed for instance ID: "
 				<< instanceId << endl;
 		return false;
@@ -1960,12 +2036,7 @@ bool Dataset::MaskRemoveInstance(std::string instanceId) {
 }
 
 bool Dataset::MaskSearchInstance(string instanceId) {
-	map<string, unsigned int>::iterator pos = instancesMask.find(instanceId);
-	if (pos != instancesMask.end()) {
-		return true;
-	} else {
-		return false;
-	}
+	return instancesMask.Contains(instanceId);
 }
 
 bool Dataset::MaskIncludeAllInstances() {
@@ -1973,32 +2044,22 @@ bool Dataset::MaskIncludeAllInstances() {
 	vector<string>::const_iterator it = instanceIds.begin();
 	unsigned int instanceIndex = 0;
 	for (; it != instanceIds.end(); ++it) {
-		instancesMask[*it] = instanceIndex;
+		instancesMask.Set(*it, instanceIndex);
 		++instanceIndex;
 	}
 
 	return true;
 }
 
-vector<unsigned int> Dataset::MaskGetInstanceIndices() {
-	vector<unsigned int> indices;
-	map<string, unsigned int>::const_iterator it = instancesMask.begin();
-	for (; it != instancesMask.end(); ++it) {
-		indices.push_back(it->second);
-	}
-	return indices;
+const vector<unsigned int>& Dataset::MaskGetInstanceIndices() {
+	return instancesMask.GetIndices();
 }
 
-vector<string> Dataset::MaskGetInstanceIds() {
-	vector<string> ids;
-	map<string, unsigned int>::const_iterator it = instancesMask.begin();
-	for (; it != instancesMask.end(); ++it) {
-		ids.push_back(it->first);
-	}
-	return ids;
+const vector<string>& Dataset::MaskGetInstanceIds() {
+	return instancesMask.GetNames();
 }
 
-const map<string, unsigned int>& Dataset::MaskGetInstanceMask() {
+const DatasetMask& Dataset::MaskGetInstanceMask() {
 	return instancesMask;
 }
 
@@ -2686,8 +2747,6 @@ bool Dataset::CalculateGainMatrix(double** gainMatrix, string matrixFilename) {
 		return false;
 	}
 
-	map<string, unsigned int> attributeMask = MaskGetAttributeMask(
-			DISCRETE_TYPE);
 	vector<string> attributeNames = MaskGetAllVariableNames();
 	int numAttributes = attributeNames.size();
 
@@ -2753,8 +2812,6 @@ bool Dataset::CalculateRegainMatrix(double** gainMatrix,
 		return false;
 	}
 
-	map<string, unsigned int> attributeMask = MaskGetAttributeMask(
-			NUMERIC_TYPE);
 	vector<string> attributeNames = MaskGetAllVariableNames();
 	int numAttributes = attributeNames.size();
 
@@ -2804,11 +2861,8 @@ double Dataset::ComputeInstanceToInstanceDistance(DatasetInstance* dsi1,
 			if (snpMetric == "JC") {
 				distance = GetJukesCantorDistance(dsi1, dsi2);
 			} else {
-				vector<unsigned int> attributeIndices = MaskGetAttributeIndices(
-						DISCRETE_TYPE);
-				for (unsigned int i = 0; i < attributeIndices.size(); ++i) {
-					distance += snpDiff(attributeIndices[i], dsi1, dsi2);
-				}
+				distance = AddAttributeDiffs(MaskGetAttributeIndices(DISCRETE_TYPE),
+						dsi1, dsi2, distance);
 			}
 		}
 		// cout << "SNP distance = " << distance << endl;
@@ -2818,21 +2872,381 @@ double Dataset::ComputeInstanceToInstanceDistance(DatasetInstance* dsi1,
 	// compute numeric distances
 	if (HasNumerics()) {
 		//cout << "Computing numeric instance-to-instance distance..." << endl;
-		vector<unsigned int> numericIndices = MaskGetAttributeIndices(
-				NUMERIC_TYPE);
-		//cout << "\tNumber of numerics: " << numericIndices.size() << endl;
-		for (unsigned int i = 0; i < numericIndices.size(); ++i) {
-			//cout << "\t\tNumeric index: " << numericIndices[i] << endl;
-			double numDistance = numDiff(numericIndices[i], dsi1, dsi2);
-			//cout << "Numeric distance " << i << " => " << numDistance << endl;
-			distance += numDistance;
+		distance = AddNumericDiffs(MaskGetAttributeIndices(NUMERIC_TYPE), dsi1,
+				dsi2, distance);
+	}
+
+	return distance;
+}
+
+double Dataset::ComputeInstanceToInstanceDistance(unsigned int dsi1Index,
+		unsigned int dsi2Index) {
+	bool bitPlanesCurrent = genotypeBitPlanes.IsBuilt()
+			&& (genotypeBitPlanesVersion == attributesMask.GetVersion())
+			&& (genotypeBitPlanes.NumInstances() == instances.size());
+	bool numericsMatrixCurrent = numericsMatrix.IsBuilt()
+			&& (numericsMatrixVersion == numericsMask.GetVersion())
+			&& (numericsMatrix.NumInstances() == instances.size())
+			&& (numDiff == diffManhattan);
+	if (HasGenotypes() && !bitPlanesCurrent) {
+		return ComputeInstanceToInstanceDistance(instances[dsi1Index],
+				instances[dsi2Index]);
+	}
+
+	double distance = 0;
+	if (HasGenotypes()) {
+		if (IsMutationMetric()) {
+			GenotypeBitPlanes::MutationCounts counts =
+					genotypeBitPlanes.CountsMutations(dsi1Index, dsi2Index);
+			if (snpMetric == "KM") {
+				distance = KimuraDistance(counts, genotypeBitPlanes.NumAttributes());
+			} else if (snpMetric == "JC") {
+				distance = JukesCantorDistance(counts);
+			} else {
+				// diffKM: 1 per transition and 2 per transversion mismatch
+				distance = (double) (counts.transitions
+						+ (2 * counts.transversions));
+			}
+		} else if (snpDiff == diffAMM) {
+			distance = genotypeBitPlanes.DistanceAM(dsi1Index, dsi2Index);
+		} else {
+			distance = genotypeBitPlanes.DistanceGM(dsi1Index, dsi2Index);
+		}
+	}
+	if (HasNumerics()) {
+		if (numericsMatrixCurrent) {
+			distance += numericsMatrix.DistanceManhattan(dsi1Index, dsi2Index);
+		} else {
+			distance = AddNumericDiffs(MaskGetAttributeIndices(NUMERIC_TYPE),
+					instances[dsi1Index], instances[dsi2Index], distance);
+		}
+	}
+
+	return distance;
+}
+
+/// attributes per block of the missing value fast path
+static const unsigned int MISSING_CHECK_BLOCK = 64;
+
+/// Add a metric's diffs over attributes to a distance, in order. With
+/// current missing value bitmaps, blocks of attributes where neither
+/// instance has a missing value skip the missing value checks.
+template<class Metric>
+static double AddDiffs(Metric diff, const vector<unsigned int>& indices,
+		DatasetInstance* dsi1, DatasetInstance* dsi2, double distance,
+		AttributeType attributeType, bool bitmapsCurrent) {
+	unsigned int numIndices = indices.size();
+	if (!bitmapsCurrent) {
+		for (unsigned int i = 0; i < numIndices; ++i) {
+			distance += diff(indices[i], dsi1, dsi2);
+		}
+		return distance;
+	}
+	PresentValues<Metric> presentDiff(diff);
+	bool anyMissing = dsi1->GetMissingBitmap(attributeType).size()
+			|| dsi2->GetMissingBitmap(attributeType).size();
+	if (!anyMissing) {
+		for (unsigned int i = 0; i < numIndices; ++i) {
+			distance += presentDiff(indices[i], dsi1, dsi2);
+		}
+		return distance;
+	}
+	for (unsigned int begin = 0; begin < numIndices; begin +=
+			MISSING_CHECK_BLOCK) {
+		unsigned int end = min(begin + MISSING_CHECK_BLOCK, numIndices);
+		if (dsi1->AnyMissing(attributeType, indices, begin, end)
+				|| dsi2->AnyMissing(attributeType, indices, begin, end)) {
+			for (unsigned int i = begin; i < end; ++i) {
+				distance += diff(indices[i], dsi1, dsi2);
+			}
+		} else {
+			for (unsigned int i = begin; i < end; ++i) {
+				distance += presentDiff(indices[i], dsi1, dsi2);
+			}
+		}
+	}
+	return distance;
+}
+
+double Dataset::AddAttributeDiffs(const vector<unsigned int>& attributeIndices,
+		DatasetInstance* dsi1, DatasetInstance* dsi2, double distance) {
+	bool bitmapsCurrent = HasMissingBitmaps();
+	if (snpDiff == diffGMM) {
+		return AddDiffs(GMMetric(), attributeIndices, dsi1, dsi2, distance,
+				DISCRETE_TYPE, bitmapsCurrent);
+	}
+	if (snpDiff == diffAMM) {
+		return AddDiffs(AMMetric(), attributeIndices, dsi1, dsi2, distance,
+				DISCRETE_TYPE, bitmapsCurrent);
+	}
+	if (snpDiff == diffNCA) {
+		return AddDiffs(NCAMetric(), attributeIndices, dsi1, dsi2, distance,
+				DISCRETE_TYPE, bitmapsCurrent);
+	}
+	if (snpDiff == diffNCA6) {
+		return AddDiffs(NCA6Metric(), attributeIndices, dsi1, dsi2, distance,
+				DISCRETE_TYPE, bitmapsCurrent);
+	}
+	if (snpDiff == diffKM) {
+		return AddDiffs(KMMetric(), attributeIndices, dsi1, dsi2, distance,
+				DISCRETE_TYPE, bitmapsCurrent);
+	}
+	return AddDiffs(PointerMetric(snpDiff), attributeIndices, dsi1, dsi2,
+			distance, DISCRETE_TYPE, bitmapsCurrent);
+}
+
+double Dataset::AddNumericDiffs(const vector<unsigned int>& numericIndices,
+		DatasetInstance* dsi1, DatasetInstance* dsi2, double distance) {
+	bool bitmapsCurrent = HasMissingBitmaps();
+	if (numDiff == diffManhattan) {
+		return AddDiffs(ManhattanMetric(), numericIndices, dsi1, dsi2, distance,
+				NUMERIC_TYPE, bitmapsCurrent);
+	}
+	if (numDiff == diffEuclidean) {
+		return AddDiffs(EuclideanMetric(), numericIndices, dsi1, dsi2, distance,
+				NUMERIC_TYPE, bitmapsCurrent);
+	}
+	return AddDiffs(PointerMetric(numDiff), numericIndices, dsi1, dsi2,
+			distance, NUMERIC_TYPE, bitmapsCurrent);
+}
+
+bool Dataset::IsMutationMetric() {
+	return (snpMetric == "KM") || (snpMetric == "JC") || (snpDiff == diffKM);
+}
+
+void Dataset::RefreshMasks() {
+	attributesMask.Refresh();
+	numericsMask.Refresh();
+	instancesMask.Refresh();
+}
+
+bool Dataset::PrepareGenotypeBitPlanes() {
+	RefreshMasks();
+	if (!HasGenotypes()
+			|| (!IsMutationMetric() && (snpDiff != diffGMM)
+					&& (snpDiff != diffAMM))) {
+		genotypeBitPlanes.Clear();
+		return false;
+	}
+	if (genotypeBitPlanes.IsBuilt()
+			&& (genotypeBitPlanesVersion == attributesMask.GetVersion())
+			&& (genotypeBitPlanes.NumInstances() == instances.size())) {
+		return true;
+	}
+	const vector<unsigned int>& attributeIndices = MaskGetAttributeIndices(
+			DISCRETE_TYPE);
+	if (!genotypeBitPlanes.Build(instances, attributeIndices)) {
+		return false;
+	}
+	// transition and transversion masks, under the current mask like
+	// GetAttributeMutationType in the per attribute distances
+	vector<AttributeMutationType> mutationTypes(attributeIndices.size());
+	for (unsigned int i = 0; i < attributeIndices.size(); ++i) {
+		mutationTypes[i] = GetAttributeMutationType(attributeIndices[i]);
+	}
+	if (!genotypeBitPlanes.SetMutationTypes(mutationTypes)) {
+		return false;
+	}
+	genotypeBitPlanesVersion = attributesMask.GetVersion();
+
+	return true;
+}
+
+const GenotypeBitPlanes* Dataset::GetGenotypeBitPlanes() {
+	if (genotypeBitPlanes.IsBuilt()
+			&& (genotypeBitPlanesVersion == attributesMask.GetVersion())
+			&& (genotypeBitPlanes.NumInstances() == instances.size())) {
+		return &genotypeBitPlanes;
+	}
+	return NULL;
+}
+
+bool Dataset::PrepareNumericsMatrix() {
+	RefreshMasks();
+	if (!HasNumerics() || (numDiff != diffManhattan)) {
+		numericsMatrix.Clear();
+		return false;
+	}
+	if (numericsMatrix.IsBuilt()
+			&& (numericsMatrixVersion == numericsMask.GetVersion())
+			&& (numericsMatrix.NumInstances() == instances.size())) {
+		return true;
+	}
+	if (!numericsMatrix.Build(instances, MaskGetAttributeIndices(NUMERIC_TYPE),
+			numericsMinMax)) {
+		return false;
+	}
+	numericsMatrixVersion = numericsMask.GetVersion();
+
+	return true;
+}
+
+bool Dataset::PrepareMissingBitmaps() {
+	RefreshMasks();
+	if (HasMissingBitmaps()) {
+		return true;
+	}
+	int numInstances = instances.size();
+#pragma omp parallel for
+	for (int i = 0; i < numInstances; ++i) {
+		instances[i]->UpdateMissingBitmaps();
+	}
+	missingAttributeColumns.clear();
+	missingNumericColumns.clear();
+	for (int i = 0; i < numInstances; ++i) {
+		const vector<DatasetInstance::MissingWord>& attributeBitmap =
+				instances[i]->GetMissingBitmap(DISCRETE_TYPE);
+		if (attributeBitmap.size() > missingAttributeColumns.size()) {
+			missingAttributeColumns.resize(attributeBitmap.size(), 0);
+		}
+		for (unsigned int word = 0; word < attributeBitmap.size(); ++word) {
+			missingAttributeColumns[word] |= attributeBitmap[word];
+		}
+		const vector<DatasetInstance::MissingWord>& numericBitmap =
+				instances[i]->GetMissingBitmap(NUMERIC_TYPE);
+		if (numericBitmap.size() > missingNumericColumns.size()) {
+			missingNumericColumns.resize(numericBitmap.size(), 0);
+		}
+		for (unsigned int word = 0; word < numericBitmap.size(); ++word) {
+			missingNumericColumns[word] |= numericBitmap[word];
+		}
+	}
+	missingBitmapsBuilt = true;
+	missingBitmapsVersion = distanceVersion;
+	missingBitmapsInstances = instances.size();
+
+	return true;
+}
+
+bool Dataset::HasMissingBitmaps() {
+	return missingBitmapsBuilt && (missingBitmapsVersion == distanceVersion)
+			&& (missingBitmapsInstances == instances.size());
+}
+
+bool Dataset::PrepareNucleotideCountTables() {
+	RefreshMasks();
+	if (!HasGenotypes() || !hasAllelicInfo) {
+		return false;
+	}
+	unsigned int numAttributes = attributeAlleles.size();
+	if (ncaDistances.size() && (ncaDistances.size()
+			== (numAttributes * GENOTYPE_PAIRS))) {
+		return true;
+	}
+	ncaDistances.resize(numAttributes * GENOTYPE_PAIRS);
+	nca6Distances.resize(numAttributes * GENOTYPE_PAIRS);
+	for (unsigned int attributeIndex = 0; attributeIndex < numAttributes;
+			++attributeIndex) {
+		for (AttributeLevel level1 = 0; level1 < 3; ++level1) {
+			for (AttributeLevel level2 = 0; level2 < 3; ++level2) {
+				unsigned int tableIndex = (attributeIndex * GENOTYPE_PAIRS)
+						+ (level1 * 3) + level2;
+				ncaDistances[tableIndex] = (unsigned char) diffNucleotideCounts(
+						attributeAlleles[attributeIndex], level1, level2, false);
+				nca6Distances[tableIndex] = (unsigned char) diffNucleotideCounts(
+						attributeAlleles[attributeIndex], level1, level2, true);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool Dataset::IsDistanceAdditive() {
+	return !HasGenotypes() || ((snpMetric != "KM") && (snpMetric != "JC"));
+}
+
+bool Dataset::PrepareDistanceContribution(
+		const vector<unsigned int>& attributeIndices,
+		const vector<unsigned int>& numericIndices) {
+	RefreshMasks();
+	if (!IsDistanceAdditive()) {
+		cerr << "ERROR: PrepareDistanceContribution: the " << snpMetric
+				<< " distance is not a sum over attributes" << endl;
+		return false;
+	}
+	contributionAttributes = attributeIndices;
+	contributionNumerics = numericIndices;
+	contributionBitPlanes.Clear();
+	contributionNumericsMatrix.Clear();
+	if (HasGenotypes() && contributionAttributes.size()
+			&& ((snpDiff == diffGMM) || (snpDiff == diffAMM))) {
+		if (!contributionBitPlanes.Build(instances, contributionAttributes)) {
+			return false;
+		}
+	}
+	if (HasNumerics() && contributionNumerics.size()
+			&& (numDiff == diffManhattan)) {
+		if (!contributionNumericsMatrix.Build(instances, contributionNumerics,
+				numericsMinMax)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+double Dataset::ComputeDistanceContribution(unsigned int dsi1Index,
+		unsigned int dsi2Index) {
+	double distance = 0;
+	if (HasGenotypes()) {
+		if (contributionBitPlanes.IsBuilt()) {
+			if (snpDiff == diffAMM) {
+				distance = contributionBitPlanes.DistanceAM(dsi1Index, dsi2Index);
+			} else {
+				distance = contributionBitPlanes.DistanceGM(dsi1Index, dsi2Index);
+			}
+		} else {
+			distance = AddAttributeDiffs(contributionAttributes,
+					instances[dsi1Index], instances[dsi2Index], distance);
+		}
+	}
+	if (HasNumerics()) {
+		if (contributionNumericsMatrix.IsBuilt()) {
+			distance += contributionNumericsMatrix.DistanceManhattan(dsi1Index,
+					dsi2Index);
+		} else {
+			distance = AddNumericDiffs(contributionNumerics, instances[dsi1Index],
+					instances[dsi2Index], distance);
 		}
 	}
 
 	return distance;
 }
 
+bool Dataset::HasDistanceCounts() {
+	return HasGenotypes() && !HasNumerics()
+			&& ((snpDiff == diffGMM) || (snpDiff == diffAMM))
+			&& genotypeBitPlanes.IsBuilt()
+			&& (genotypeBitPlanesVersion == attributesMask.GetVersion())
+			&& (genotypeBitPlanes.NumInstances() == instances.size());
+}
+
+GenotypeBitPlanes::DistanceCounts Dataset::ComputeDistanceCounts(
+		unsigned int dsi1Index, unsigned int dsi2Index) {
+	if (snpDiff == diffAMM) {
+		return genotypeBitPlanes.CountsAM(dsi1Index, dsi2Index);
+	}
+	return genotypeBitPlanes.CountsGM(dsi1Index, dsi2Index);
+}
+
+GenotypeBitPlanes::DistanceCounts Dataset::ComputeDistanceContributionCounts(
+		unsigned int dsi1Index, unsigned int dsi2Index) {
+	if (!contributionBitPlanes.IsBuilt()) {
+		GenotypeBitPlanes::DistanceCounts noCounts = { 0, 0 };
+		return noCounts;
+	}
+	if (snpDiff == diffAMM) {
+		return contributionBitPlanes.CountsAM(dsi1Index, dsi2Index);
+	}
+	return contributionBitPlanes.CountsGM(dsi1Index, dsi2Index);
+}
+
 bool Dataset::SetDistanceMetrics(string newSnpMetric, string newNumMetric) {
+	// bit planes are only valid for the metric they were prepared for;
+	// PrepareGenotypeBitPlanes builds them again for the new one
+	genotypeBitPlanes.Clear();
+	contributionBitPlanes.Clear();
 	/// set the SNP metric function pointer
 	bool snpMetricFunctionUnset = true;
 	if (snpMetricFunctionUnset && to_upper(newSnpMetric) == "GM") {
@@ -2875,6 +3289,7 @@ bool Dataset::SetDistanceMetrics(string newSnpMetric, string newNumMetric) {
 		}
 	}
 	numMetric = newNumMetric;
+	++distanceVersion;
 
 	cout << Timestamp() << "New SNP distance metric for nearest neighbors: "
 			<< snpMetric << endl;
@@ -2974,42 +3389,48 @@ bool Dataset::WriteSnpTiTvInfo(string titvFilename) {
 	return true;
 }
 
-bool Dataset::CalculateDistanceMatrix(double** distanceMatrix,
-		string matrixFilename) {
+bool Dataset::CalculateDistanceMatrix(DistanceMatrix& distanceMatrix,
+		DistancePrecision precision, string matrixFilename,
+		DistanceFileFormat fileFormat) {
 	cout << Timestamp() << "Calculating distance matrix" << endl;
-	map<string, unsigned int> instanceMask = MaskGetInstanceMask();
 	vector<string> instanceIds = MaskGetInstanceIds();
 	int numInstances = instanceIds.size();
+	if (!distanceMatrix.Allocate(numInstances, precision, true)) {
+		return false;
+	}
+	cout << Timestamp() << "Packed upper triangle of "
+			<< ((precision == DISTANCE_FLOAT32) ? "float32" : "float64")
+			<< " distances: " << distanceMatrix.Bytes() << " bytes" << endl;
 
-	// populate the matrix - upper triangular
-	// NOTE: make complete symmetric matrix for neighbor-to-neighbor sums
+	// populate the upper triangle; the matrix is symmetric
 	cout << Timestamp() << "Computing instance-to-instance distances... "
 			<< endl;
-	//  omp_set_nested(1);
-#pragma omp parallel for schedule(dynamic, 1)
-	for (int i = 0; i < numInstances; ++i) {
-		// cout << "Computing instance to instance distances. Row: " << i << endl;
-		// #pragma omp parallel for
-		for (int j = i + 1; j < numInstances; ++j) {
-			unsigned int dsi1Index;
-			GetInstanceIndexForID(instanceIds[i], dsi1Index);
-			unsigned int dsi2Index;
-			GetInstanceIndexForID(instanceIds[j], dsi2Index);
-			distanceMatrix[i][j] = distanceMatrix[j][i] =
-					ComputeInstanceToInstanceDistance(GetInstance(dsi1Index),
-							GetInstance(dsi2Index));
-			// cout << i << ", " << j << " => " << distanceMatrix[i][j] << endl;
-		}
-		distanceMatrix[i][i] = 0.0;
-
-		if (i && (i % 100 == 0)) {
-			cout << Timestamp() << i << "/" << numInstances << endl;
-		}
+	PairwiseDistances pairwiseDistances(this);
+	if (!pairwiseDistances.ComputeDistanceMatrix(MaskGetInstanceIndices(),
+			distanceMatrix)) {
+		return false;
 	}
 	cout << Timestamp() << numInstances << "/" << numInstances << " done"
 			<< endl;
 
-	if (matrixFilename != "") {
+	if ((matrixFilename != "") && (fileFormat == DISTANCE_FILE_BINARY)) {
+		cout << Timestamp() << "Writing binary distance matrix to file ["
+				<< matrixFilename << "]" << endl;
+		vector<double> phenotypes(numInstances);
+		for (int i = 0; i < numInstances; ++i) {
+			unsigned int dsiIndex;
+			GetInstanceIndexForID(instanceIds[i], dsiIndex);
+			if (hasContinuousPhenotypes) {
+				phenotypes[i] = instances[dsiIndex]->GetPredictedValueTau();
+			} else {
+				phenotypes[i] = instances[dsiIndex]->GetClass();
+			}
+		}
+		if (!distanceMatrix.WriteBinary(matrixFilename, instanceIds, phenotypes,
+				hasContinuousPhenotypes)) {
+			return false;
+		}
+	} else if (matrixFilename != "") {
 		cout << Timestamp() << "Writing distance matrix to file ["
 				<< matrixFilename << "]" << endl;
 		ofstream outFile(matrixFilename.c_str());
@@ -3026,9 +3447,9 @@ bool Dataset::CalculateDistanceMatrix(double** distanceMatrix,
 		for (int i = 0; i < numInstances; ++i) {
 			for (int j = 0; j < numInstances; ++j) {
 				if (j)
-					outFile << "\t" << distanceMatrix[i][j];
+					outFile << "\t" << distanceMatrix.Get(i, j);
 				else
-					outFile << distanceMatrix[i][j];
+					outFile << distanceMatrix.Get(i, j);
 			}
 			outFile << endl;
 		}
@@ -3055,23 +3476,41 @@ bool Dataset::CalculateDistanceMatrix(double** distanceMatrix,
 	return true;
 }
 
-bool Dataset::CalculateDistanceMatrix(vector<vector<double> >& distanceMatrix) {
-	map<string, unsigned int> instanceMask = MaskGetInstanceMask();
-	vector<string> instanceIds = MaskGetInstanceIds();
-	int numInstances = instanceIds.size();
+bool Dataset::CalculateDistanceMatrix(double** distanceMatrix,
+		string matrixFilename) {
+	DistanceMatrix packedMatrix;
+	if (!CalculateDistanceMatrix(packedMatrix, DISTANCE_FLOAT64,
+			matrixFilename)) {
+		return false;
+	}
+	for (unsigned int i = 0; i < packedMatrix.Size(); ++i) {
+		for (unsigned int j = 0; j < packedMatrix.Size(); ++j) {
+			distanceMatrix[i][j] = packedMatrix.Get(i, j);
+		}
+	}
 
-#pragma omp parallel for schedule(dynamic, 1)
-	for (int i = 0; i < numInstances; ++i) {
-		for (int j = i + 1; j < numInstances; ++j) {
-			unsigned int dsi1Index;
-			GetInstanceIndexForID(instanceIds[i], dsi1Index);
-			unsigned int dsi2Index;
-			GetInstanceIndexForID(instanceIds[j], dsi2Index);
-			distanceMatrix[i][j] = distanceMatrix[j][i] =
-					ComputeInstanceToInstanceDistance(GetInstance(dsi1Index),
-							GetInstance(dsi2Index));
+	return true;
+}
+
+bool Dataset::CalculateDistanceMatrix(vector<vector<double> >& distanceMatrix) {
+	const vector<unsigned int>& instanceIndices = MaskGetInstanceIndices();
+	if (instanceIndices.empty()) {
+		return true;
+	}
+	DistanceMatrix packedMatrix;
+	if (!packedMatrix.Allocate(instanceIndices.size(), DISTANCE_FLOAT64,
+			true)) {
+		return false;
+	}
+	PairwiseDistances pairwiseDistances(this);
+	if (!pairwiseDistances.ComputeDistanceMatrix(instanceIndices,
+			packedMatrix)) {
+		return false;
+	}
+	for (unsigned int i = 0; i < packedMatrix.Size(); ++i) {
+		for (unsigned int j = 0; j < packedMatrix.Size(); ++j) {
+			distanceMatrix[i][j] = packedMatrix.Get(i, j);
 		}
-		distanceMatrix[i][i] = 0.0;
 	}
 
 	return true;
@@ -3111,7 +3550,7 @@ bool Dataset::LoadSnps(std::string filename) {
 			classColumn = classIndex;
 		} else {
 			attributeNames.push_back(*it);
-			attributesMask[*it] = numAttributes;
+			attributesMask.Set(*it, numAttributes);
 			++numAttributes;
 		}
 		++classIndex;
@@ -3253,7 +3692,7 @@ bool Dataset::LoadSnps(std::string filename) {
 			newInst->LoadInstanceFromVector(attributeVector);
 			instances.push_back(newInst);
 			instanceIds.push_back(ID);
-			instancesMask[ID] = instanceIndex;
+			instancesMask.Set(ID, instanceIndex);
 		} else {
 			cerr << "ERROR: loading tab-delimited data set. "
 					<< "Could not create dataset instance for line number "
@@ -3311,7 +3750,7 @@ void Dataset::UpdateAllLevelCounts() {
 		levelCounts[i][2] = 0;
 	}
 	unsigned int instanceCount = 0;
-	map<string, unsigned int>::const_iterator it = instancesMask.begin();
+	DatasetMask::const_iterator it = instancesMask.begin();
 	for (; it != instancesMask.end(); ++it) {
 		UpdateLevelCounts(instances[it->second]);
 		if (instanceCount && ((instanceCount % 100) == 0)) {
@@ -3327,7 +3766,7 @@ void Dataset::UpdateAllLevelCounts() {
 
 void Dataset::UpdateLevelCounts(DatasetInstance* dsi) {
 	ClassLevel thisClassLevel = dsi->GetClass();
-	map<string, unsigned int>::const_iterator it = attributesMask.begin();
+	DatasetMask::const_iterator it = attributesMask.begin();
 	for (; it != attributesMask.end(); ++it) {
 		unsigned int attributeIndex = it->second;
 		AttributeLevel thisAttributeLevel = dsi->GetAttribute(attributeIndex);
@@ -3407,11 +3846,13 @@ void Dataset::ExcludeMonomorphs() {
 
 void Dataset::CreateDummyAlleles() {
 	attributeAlleles.clear();
+	ncaDistances.clear();
+	nca6Distances.clear();
 	attributeAlleleCounts.clear();
 	attributeMinorAllele.clear();
-	map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+	DatasetMask::const_iterator ait = attributesMask.begin();
 	for (; ait != attributesMask.end(); ++ait) {
-		map<string, unsigned int>::const_iterator it = instancesMask.begin();
+		DatasetMask::const_iterator it = instancesMask.begin();
 		map<char, unsigned int> alleleCounts;
 		for (; it != instancesMask.end(); ++it) {
 			DatasetInstance* dsi = instances[it->second];
@@ -3485,7 +3926,7 @@ bool Dataset::LoadNumerics(string filename) {
 	vector<string>::const_iterator it = numericsNames.begin();
 	unsigned int numIdx = 0;
 	for (; it != numericsNames.end(); ++it) {
-		numericsMask[*it] = numIdx;
+		numericsMask.Set(*it, numIdx);
 		++numIdx;
 	}
 
@@ -3541,7 +3982,7 @@ bool Dataset::LoadNumerics(string filename) {
 		// cout << "Numerics ID string from file: " << thisID << endl;
 		numericsIds.push_back(ID);
 		if (!hasGenotypes) {
-			instancesMask[ID] = newInstanceIdx++;
+			instancesMask.Set(ID, newInstanceIdx++);
 			tempInstance = new DatasetInstance(this);
 		}
 		// skip the first two columns: familiy and individual IDs
@@ -3617,7 +4058,7 @@ bool Dataset::GetNumericValues(unsigned int numericIndex,
 			return false;
 		}
 		numericValues.clear();
-		map<string, unsigned int>::const_iterator it;
+		DatasetMask::const_iterator it;
 		for (it = instancesMask.begin(); it != instancesMask.end(); it++) {
 			double thisNumeric = instances[it->second]->GetNumeric(
 					numericIndex);
@@ -3780,7 +4221,8 @@ bool Dataset::LoadAlternatePhenotypes(string phenotypesFilename) {
 				delIt != idsToDelete.end(); ++delIt) {
 
 			string delId = *delIt;
-			unsigned int delIdIndex = instancesMask[delId];
+			unsigned int delIdIndex = 0;
+			instancesMask.Find(delId, delIdIndex);
 			ClassLevel delClass = instances[delIdIndex]->GetClass();
 
 			// remove instanceIndex from classIndexes
@@ -3799,11 +4241,7 @@ bool Dataset::LoadAlternatePhenotypes(string phenotypesFilename) {
 			}
 
 			// remove from instancesMask
-			map<string, unsigned int>::iterator imIt = instancesMask.find(
-					delId);
-			if (imIt != instancesMask.end()) {
-				instancesMask.erase(imIt);
-			}
+			instancesMask.Remove(delId);
 		}
 		classIndexes.erase(MISSING_DISCRETE_CLASS_VALUE);
 	}
@@ -3835,6 +4273,17 @@ bool Dataset::IsLoadableInstanceID(std::string ID) {
 	}
 }
 
+bool Dataset::IsLoadableAttributeName(std::string name) {
+	if (attributeNamesToInclude.size()
+			&& (attributeNamesToInclude.find(name) == attributeNamesToInclude.end())) {
+		return false;
+	}
+	if (attributeNamesToExclude.find(name) != attributeNamesToExclude.end()) {
+		return false;
+	}
+	return true;
+}
+
 bool Dataset::WriteNewPlinkPedDataset(string baseDatasetFilename) {
 	// only write ped format if it makes sense
 	if (!hasAllelicInfo) {
@@ -3857,7 +4306,7 @@ bool Dataset::WriteNewPlinkPedDataset(string baseDatasetFilename) {
 				<< ".map" << endl;
 		return false;
 	}
-	map<string, unsigned int>::const_iterator ait = attributesMask.begin();
+	DatasetMask::const_iterator ait = attributesMask.begin();
 	for (; ait != attributesMask.end(); ++ait) {
 		newMapStream << "0 " << ait->first << " 0 0" << endl;
 	}
@@ -3942,3 +4391,51 @@ void Dataset::SetFastGwasMode(bool fastGwasFlag) {
 bool Dataset::GetFastGwasMode() {
 	return fastGWAS;
 }
+
+void Dataset::SetPackedGenotypeStorage(bool packedFlag) {
+	usePackedGenotypes = packedFlag;
+}
+
+bool Dataset::GetPackedGenotypeStorage() {
+	return usePackedGenotypes;
+}
+
+const PackedGenotypes* Dataset::GetPackedGenotypes() {
+	if (packedGenotypes.IsAllocated()) {
+		return &packedGenotypes;
+	}
+	return NULL;
+}
+
+bool Dataset::PackGenotypes() {
+	if (!instances.size()) {
+		return true;
+	}
+	unsigned int numAttributes = instances[0]->NumAttributes();
+	unsigned int numInstances = instances.size();
+	cout << Timestamp() << "Packing " << numAttributes << " SNPs x "
+			<< numInstances << " instances into a 2-bit genotype matrix" << endl;
+	if (!packedGenotypes.Allocate(numAttributes, numInstances)) {
+		return false;
+	}
+	// each attribute is a separate column of the packed matrix, so
+	// parallel attribute updates should not require a critical section
+	#pragma omp parallel for
+	for (unsigned int attributeIndex = 0; attributeIndex < numAttributes;
+			++attributeIndex) {
+		for (unsigned int instanceIndex = 0; instanceIndex < numInstances;
+				++instanceIndex) {
+			packedGenotypes.Set(attributeIndex, instanceIndex,
+					instances[instanceIndex]->attributes[attributeIndex]);
+		}
+	}
+	for (unsigned int instanceIndex = 0; instanceIndex < numInstances;
+			++instanceIndex) {
+		instances[instanceIndex]->SetPackedGenotypes(&packedGenotypes,
+				instanceIndex);
+	}
+	cout << Timestamp() << "Packed genotypes use "
+			<< (packedGenotypes.NumBytes() / 1024) << " KB" << endl;
+
+	return true;
+}
@@ -26,6 +26,12 @@
 #include <climits>
 
 #include "DatasetInstance.h"
+#include "PackedGenotypes.h"
+#include "DatasetMask.h"
+#include "GenotypeBitPlanes.h"
+#include "NumericsMatrix.h"
+#include "DistanceMatrix.h"
+#include "DistanceMetrics.h"
 #include "Insilico.h"
 
 // GSL random number generator base class
@@ -163,6 +169,12 @@ public:
    * \return pointer to a data set instance
    ****************************************************************************/
   DatasetInstance* GetRandomInstance();
+  /*************************************************************************//**
+   * Returns the index of a randomly chosen data set instance, drawn the same
+   * way as GetRandomInstance.
+   * \return instance index
+   ****************************************************************************/
+  unsigned int GetRandomInstanceIndex();
   /*************************************************************************//**
    * Get all instance IDs.
    * \return vector of instance IDs
@@ -242,6 +254,17 @@ public:
    * \return success
    ****************************************************************************/
   bool ProcessExclusionFile(std::string exclusionFilename);
+  /*************************************************************************//**
+   * Read files of attribute names to include and/or exclude when loading.
+   * Must be called before LoadDataset. Data set types that can select
+   * attributes while reading skip the others; all others mask them out
+   * after loading.
+   * \param [in] includeFilename file of attribute names to load or empty string
+   * \param [in] excludeFilename file of attribute names to skip or empty string
+   * \return success
+   ****************************************************************************/
+  bool SetAttributeLoadLists(std::string includeFilename,
+                             std::string excludeFilename);
   /*************************************************************************//**
    * Get attribute mutation type.
    * \param [in] attribute index
@@ -412,16 +435,16 @@ public:
   /*************************************************************************//**
    * Return a vector of all the attribute indices under consideration.
    * \param attrType attribute type
+   * The vector is cached by the mask and stays valid until the mask changes.
    * \return vector of indices into currently considered discrete attributes
    ****************************************************************************/
-  std::vector<unsigned int> MaskGetAttributeIndices(AttributeType attrType);
+  const std::vector<unsigned int>& MaskGetAttributeIndices(AttributeType attrType);
   /*************************************************************************//**
    * Return a map of attribute name to attribute index of attributes to include.
    * \param [in] attrType attribute type
    * \return attributes mask: name->index
    ****************************************************************************/
-  const std::map<std::string, unsigned int>&
-  MaskGetAttributeMask(AttributeType attrType);
+  const DatasetMask& MaskGetAttributeMask(AttributeType attrType);
   /*************************************************************************//**
    * Return a vector of all the variable names under consideration.
    * \return vector of discrete and numeric variable
@@ -446,19 +469,21 @@ public:
   bool MaskIncludeAllInstances();
   /*************************************************************************//**
    * Return a vector of all the instance indices under consideration.
+   * The vector is cached by the mask and stays valid until the mask changes.
    * \retrun vector of indices into current instances
    ****************************************************************************/
-  std::vector<unsigned int> MaskGetInstanceIndices();
+  const std::vector<unsigned int>& MaskGetInstanceIndices();
   /*************************************************************************//**
    * Return a vector of all the instance ids under consideration.
+   * The vector is cached by the mask and stays valid until the mask changes.
    * \return vector of ids of currently included instances
    ****************************************************************************/
-  std::vector<std::string> MaskGetInstanceIds();
+  const std::vector<std::string>& MaskGetInstanceIds();
   /*************************************************************************//**
    * Return a map of instance name to instance index of instances to include.
    * \return instances mask: instance ID=>vector of instance indices
    ****************************************************************************/
-  const std::map<std::string, unsigned int>& MaskGetInstanceMask();
+  const DatasetMask& MaskGetInstanceMask();
   /*************************************************************************//**
    * Save the current masks for later restore.
    * \return success
@@ -549,7 +574,23 @@ public:
   		std::string matrixFilename="");
   /*************************************************************************//**
    * Calculate the instance-to-instance distance matrix for this data set.
-   * Uses OpenMP to calculate matrix entries in parallel threads.
+   * Uses OpenMP to calculate matrix entries in parallel threads. Only the
+   * upper triangle is stored, packed; float32 halves it again.
+   * \param [out] distanceMatrix allocated here for the m instances
+   * \param [in] precision float64 or float32 distances
+   * \param [in] distanceMatrixFilename filename to write matrix
+   * \param [in] fileFormat tab-delimited text with a .pheno file, or one
+   *                        mmap-able binary file, see DistanceMatrix
+   * \return success
+   ****************************************************************************/
+  bool CalculateDistanceMatrix(DistanceMatrix& distanceMatrix,
+                               DistancePrecision precision=DISTANCE_FLOAT64,
+                               std::string matrixFilename="",
+                               DistanceFileFormat fileFormat=DISTANCE_FILE_TEXT);
+  /*************************************************************************//**
+   * Calculate the instance-to-instance distance matrix for this data set.
+   * Uses OpenMP to calculate matrix entries in parallel threads. Computed
+   * into a packed float64 DistanceMatrix, then copied out.
    * \param [out] distanceMatrix pointer to an allocated m x m matrix,
    *                         m = number of instances
    * \param [in] distanceMatrixFilename filename to write matrix
@@ -559,7 +600,8 @@ public:
   		std::string matrixFilename="");
   /*************************************************************************//**
    * Calculate the instance-to-instance distance matrix for this data set.
-   * Uses OpenMP to calculate matrix entries in parallel threads.
+   * Uses OpenMP to calculate matrix entries in parallel threads. Computed
+   * into a packed float64 DistanceMatrix, then copied out.
    * \param [out] distanceMatrix vector of vectors of double: m x m matrix,
    *                         m = number of instances
    * \return success
@@ -573,6 +615,157 @@ public:
    ****************************************************************************/
   double ComputeInstanceToInstanceDistance(DatasetInstance* dsi1,
                                            DatasetInstance* dsi2);
+  /*************************************************************************//**
+   * Compute the distance between two instances by index. Uses the genotype
+   * bit planes for the GM, AM, KM and JC metrics and the numerics matrix
+   * for the Manhattan metric if they are current.
+   * \param [in] dsi1Index instance index 1
+   * \param [in] dsi2Index instance index 2
+   * \return distance
+   ****************************************************************************/
+  double ComputeInstanceToInstanceDistance(unsigned int dsi1Index,
+                                           unsigned int dsi2Index);
+  /*************************************************************************//**
+   * Build the genotype bit planes for the GM, AM, KM or JC metric and the
+   * current attribute mask, if needed, with the transition and transversion
+   * masks for the mutation metrics. Call before computing distances in
+   * parallel.
+   * \return true if bit plane distances are available
+   ****************************************************************************/
+  bool PrepareGenotypeBitPlanes();
+  /*************************************************************************//**
+   * The genotype bit planes of the current attribute mask, for kernels that
+   * work on them directly. Call PrepareGenotypeBitPlanes first.
+   * \return bit planes, or NULL if they are not current
+   ****************************************************************************/
+  const GenotypeBitPlanes* GetGenotypeBitPlanes();
+  /*************************************************************************//**
+   * Build the numerics matrix for the Manhattan metric and the current
+   * numerics mask, if needed. Call before computing distances in parallel.
+   * \return true if numerics matrix distances are available
+   ****************************************************************************/
+  bool PrepareNumericsMatrix();
+  /*************************************************************************//**
+   * Build every instance's missing value bitmaps and the per attribute and
+   * per numeric missing flags, if needed. Done at load time and again after
+   * the numeric values change. Call before computing distances in parallel.
+   * \return true
+   ****************************************************************************/
+  bool PrepareMissingBitmaps();
+  /*************************************************************************//**
+   * Are the instances' missing value bitmaps current? Distance loops check
+   * every value when they are not.
+   * \return true if the bitmaps are current
+   ****************************************************************************/
+  bool HasMissingBitmaps();
+  /*************************************************************************//**
+   * Is an attribute or numeric missing in any instance? Requires current
+   * missing value bitmaps.
+   * \param [in] attributeType DISCRETE_TYPE or NUMERIC_TYPE
+   * \param [in] index attribute or numeric index
+   * \return true if missing anywhere
+   ****************************************************************************/
+  bool IsMissingInAnyInstance(AttributeType attributeType, unsigned int index) {
+    const std::vector<DatasetInstance::MissingWord>& columns =
+      (attributeType == NUMERIC_TYPE) ? missingNumericColumns :
+      missingAttributeColumns;
+    unsigned int word = index / DatasetInstance::BITS_PER_MISSING_WORD;
+    return (word < columns.size()) &&
+      ((columns[word] >> (index % DatasetInstance::BITS_PER_MISSING_WORD)) & 1);
+  }
+  /*************************************************************************//**
+   * Build the per-SNP NCA and NCA6 distance tables from the attribute
+   * alleles, if needed: the distance of every pair of genotypes, so the
+   * metrics are lookups. Call before computing NCA distances in parallel.
+   * \return true if the tables are available
+   ****************************************************************************/
+  bool PrepareNucleotideCountTables();
+  /*************************************************************************//**
+   * NCA or NCA6 distance between two genotypes of an attribute: a lookup in
+   * the prepared tables, or diffNucleotideCounts if they are not prepared.
+   * \param [in] attributeIndex attribute index
+   * \param [in] level1 genotype 1, not missing
+   * \param [in] level2 genotype 2, not missing
+   * \param [in] withSums NCA6 instead of NCA?
+   * \return distance
+   ****************************************************************************/
+  double GetNucleotideCountDistance(unsigned int attributeIndex,
+                                    AttributeLevel level1,
+                                    AttributeLevel level2, bool withSums) {
+    const std::vector<unsigned char>& table =
+      withSums ? nca6Distances : ncaDistances;
+    if(table.size() && (level1 < 3) && (level2 < 3)) {
+      return table[(attributeIndex * GENOTYPE_PAIRS) + (level1 * 3) + level2];
+    }
+    return diffNucleotideCounts(GetAttributeAlleles(attributeIndex), level1,
+                                level2, withSums);
+  }
+  /*************************************************************************//**
+   * Is the SNP distance made of genotype mismatches by mutation type: the KM
+   * and JC distances or the diffKM sum?
+   * \return true if the SNP metric counts mutation types
+   ****************************************************************************/
+  bool IsMutationMetric();
+  /*************************************************************************//**
+   * Is the instance distance a sum over the attributes and numerics? True
+   * for every metric except the KM and JC genotype distances. Removing an
+   * attribute then takes its contribution off every pair distance.
+   * \return true if the distance is additive
+   ****************************************************************************/
+  bool IsDistanceAdditive();
+  /*************************************************************************//**
+   * Prepare ComputeDistanceContribution for a set of attributes and
+   * numerics, e.g. ones about to be removed from the masks. Builds bit planes
+   * and a numerics matrix of just those columns when the metrics allow.
+   * Call before computing contributions in parallel.
+   * \param [in] attributeIndices indices of the attributes
+   * \param [in] numericIndices indices of the numerics
+   * \return success
+   ****************************************************************************/
+  bool PrepareDistanceContribution(
+    const std::vector<unsigned int>& attributeIndices,
+    const std::vector<unsigned int>& numericIndices);
+  /*************************************************************************//**
+   * The part of an additive distance between two instances contributed by
+   * the attributes and numerics given to PrepareDistanceContribution.
+   * \param [in] dsi1Index instance index 1
+   * \param [in] dsi2Index instance index 2
+   * \return distance contribution
+   ****************************************************************************/
+  double ComputeDistanceContribution(unsigned int dsi1Index,
+                                     unsigned int dsi2Index);
+  /*************************************************************************//**
+   * Are index distances made of genotype bit plane counts only: the GM or
+   * AM metric with current bit planes and no numerics? Such distances can be
+   * kept as counts and updated exactly.
+   * \return true if distance counts are available
+   ****************************************************************************/
+  bool HasDistanceCounts();
+  /*************************************************************************//**
+   * The genotype counts behind the index distance between two instances.
+   * Requires HasDistanceCounts.
+   * \param [in] dsi1Index instance index 1
+   * \param [in] dsi2Index instance index 2
+   * \return half steps and missing counts
+   ****************************************************************************/
+  GenotypeBitPlanes::DistanceCounts ComputeDistanceCounts(
+    unsigned int dsi1Index, unsigned int dsi2Index);
+  /*************************************************************************//**
+   * The genotype counts behind the prepared distance contribution between
+   * two instances. Requires HasDistanceCounts.
+   * \param [in] dsi1Index instance index 1
+   * \param [in] dsi2Index instance index 2
+   * \return half steps and missing counts
+   ****************************************************************************/
+  GenotypeBitPlanes::DistanceCounts ComputeDistanceContributionCounts(
+    unsigned int dsi1Index, unsigned int dsi2Index);
+  /*************************************************************************//**
+   * Version of the instance distances apart from the masks: changes when the
+   * distance metrics or the numeric values change, so saved distances can be
+   * checked before they are reused.
+   * \return distance version
+   ****************************************************************************/
+  unsigned long GetDistanceVersion() { return distanceVersion; }
   /*************************************************************************//**
    * Set the the distance metrics used to compute instance-to-instance distances.
    * \param [in] snpMetric name of SNP metric
@@ -600,6 +793,11 @@ public:
 	/// fast GWAS mode
 	void SetFastGwasMode(bool fastGwasFlag);
 	bool GetFastGwasMode();
+	/// store SNPs in a 2-bit packed matrix; must be set before loading
+	void SetPackedGenotypeStorage(bool packedFlag);
+	bool GetPackedGenotypeStorage();
+	/// Get the packed genotype matrix; NULL if genotypes are not packed
+	const PackedGenotypes* GetPackedGenotypes();
 protected:
   /*************************************************************************//**
    * Load SNPs from file using the data set filename.
@@ -614,6 +812,11 @@ protected:
   void UpdateAllLevelCountsByAttribute();
   /// Create dummy alleles from genotypes for data sets that have no allele info
   void CreateDummyAlleles();
+  /// Move all instances' discrete attributes into the packed genotype matrix
+  bool PackGenotypes();
+  /// Rebuild changed masks' index vectors, so parallel distance loops only
+  /// read them; the Prepare methods call this
+  void RefreshMasks();
   /*************************************************************************//**
    * Update all attribute level counts from one data set instance.
    * Updates levelCountsByClass.
@@ -650,6 +853,13 @@ protected:
    * \return [out] success
    ****************************************************************************/
   bool IsLoadableInstanceID(std::string ID);
+  /*************************************************************************//**
+   * Is the passed attribute name loadable (not filtered by the attribute
+   * include/exclude lists).
+   * \param [in] name attribute name
+   * \return [out] success
+   ****************************************************************************/
+  bool IsLoadableAttributeName(std::string name);
   /*************************************************************************//**
    * Write the dataset to a new PLINK PED/MAP format, respecting masked
    * attributes class/phenotype data type.
@@ -664,6 +874,30 @@ protected:
    * \return success
    ****************************************************************************/
   bool WriteNewPlinkCovarDataset(std::string baseDatasetFilename);
+  /*************************************************************************//**
+   * Add the SNP metric's diffs of some attributes to a distance. The metric
+   * is chosen from snpDiff once and inlined into the loop over attributes.
+   * \param [in] attributeIndices attributes to sum over, in order
+   * \param [in] dsi1 pointer to DatasetInstance 1
+   * \param [in] dsi2 pointer to DatasetInstance 2
+   * \param [in] distance distance to add the diffs to
+   * \return distance with the diffs added
+   ****************************************************************************/
+  double AddAttributeDiffs(const std::vector<unsigned int>& attributeIndices,
+                           DatasetInstance* dsi1, DatasetInstance* dsi2,
+                           double distance);
+  /*************************************************************************//**
+   * Add the numeric metric's diffs of some numerics to a distance, like
+   * AddAttributeDiffs.
+   * \param [in] numericIndices numerics to sum over, in order
+   * \param [in] dsi1 pointer to DatasetInstance 1
+   * \param [in] dsi2 pointer to DatasetInstance 2
+   * \param [in] distance distance to add the diffs to
+   * \return distance with the diffs added
+   ****************************************************************************/
+  double AddNumericDiffs(const std::vector<unsigned int>& numericIndices,
+                         DatasetInstance* dsi1, DatasetInstance* dsi2,
+                         double distance);
   /*************************************************************************//**
    * Compute the discrete difference in an attribute between two instances
    * for determining nearest neighbors.
@@ -750,6 +984,12 @@ protected:
   std::vector<std::string> instanceIds;
   /// IDs of instances to load from numeric and/or phenotype files
   std::vector<std::string> instanceIdsToLoad;
+  /// attribute names to load; all attributes are loaded if empty
+  std::set<std::string> attributeNamesToInclude;
+  /// attribute names not to load
+  std::set<std::string> attributeNamesToExclude;
+  /// were the attribute include/exclude lists applied while reading?
+  bool attributesFilteredOnLoad;
   /// missing discrete values and their instance indices
   std::map<std::string, std::vector<unsigned int> > missingValues;
   /// missing continuous values and their instance indices
@@ -763,15 +1003,15 @@ protected:
   /***
    * Masks specify the columns from the data set being considered
    * when algorithms call methods on this object:
-   * key = attribute name, value = original index into all.
+   * name => original index into all, iterated in name order.
    */
-  std::map<std::string, unsigned int> attributesMask;
-  std::map<std::string, unsigned int> numericsMask;
-  std::map<std::string, unsigned int> instancesMask;
+  DatasetMask attributesMask;
+  DatasetMask numericsMask;
+  DatasetMask instancesMask;
   /// masks can be temporarily pushed and popped
-  std::map<std::string, unsigned int> attributesMaskPushed;
-  std::map<std::string, unsigned int> numericsMaskPushed;
-  std::map<std::string, unsigned int> instancesMaskPushed;
+  DatasetMask attributesMaskPushed;
+  DatasetMask numericsMaskPushed;
+  DatasetMask instancesMaskPushed;
   bool maskIsPushed;
 
   /// random number generator classes use GNU Scientific Library (GSL)
@@ -779,6 +1019,46 @@ protected:
 	
 	/// fast GWAS mode to run as fast as possible with minimal metadata
 	bool fastGWAS;
+
+	/// keep discrete attributes in packedGenotypes instead of the instances?
+	bool usePackedGenotypes;
+	/// SNP-major, 2-bit packed genotypes of all instances
+	PackedGenotypes packedGenotypes;
+
+	/// genotype pairs in an NCA table: genotype 1 * 3 + genotype 2
+	static const unsigned int GENOTYPE_PAIRS = 9;
+	/// NCA and NCA6 distances of each attribute's genotype pairs
+	std::vector<unsigned char> ncaDistances;
+	std::vector<unsigned char> nca6Distances;
+
+	/// instance-major genotype bit planes for GM/AM distances
+	GenotypeBitPlanes genotypeBitPlanes;
+	/// attributesMask version the bit planes were built from
+	unsigned long genotypeBitPlanesVersion;
+	/// instance-major numerics for Manhattan distances
+	NumericsMatrix numericsMatrix;
+	/// numericsMask version the numerics matrix was built from
+	unsigned long numericsMatrixVersion;
+	/// attributes whose distance contribution is prepared
+	std::vector<unsigned int> contributionAttributes;
+	/// numerics whose distance contribution is prepared
+	std::vector<unsigned int> contributionNumerics;
+	/// bit planes of the contribution attributes, if the metric allows
+	GenotypeBitPlanes contributionBitPlanes;
+	/// numerics matrix of the contribution numerics, if the metric allows
+	NumericsMatrix contributionNumericsMatrix;
+	/// changes with the distance metrics and numeric values
+	unsigned long distanceVersion;
+	/// have the instances' missing value bitmaps been built?
+	bool missingBitmapsBuilt;
+	/// distanceVersion the missing value bitmaps were built at
+	unsigned long missingBitmapsVersion;
+	/// number of instances with missing value bitmaps
+	unsigned int missingBitmapsInstances;
+	/// attributes missing in any instance, one bit each
+	std::vector<DatasetInstance::MissingWord> missingAttributeColumns;
+	/// numerics missing in any instance, one bit each
+	std::vector<DatasetInstance::MissingWord> missingNumericColumns;
 };
 
 #endif // DATASET_H
@@ -12,6 +12,7 @@
 
 #include "Dataset.h"
 #include "DatasetInstance.h"
+#include "PackedGenotypes.h"
 #include "StringUtils.h"
 #include "BestN.h"
 
@@ -32,6 +33,8 @@ public:
 
 DatasetInstance::DatasetInstance(Dataset* ds) {
   dataset = ds;
+  packedGenotypes = 0;
+  packedGenotypesIndex = 0;
   classLabel = MISSING_DISCRETE_CLASS_VALUE;
   predictedValueTau = MISSING_DISCRETE_CLASS_VALUE;
 }
@@ -58,10 +61,21 @@ DatasetInstance::LoadInstanceFromVector(vector<AttributeLevel> newAttributes) {
 }
 
 unsigned int DatasetInstance::NumAttributes() {
+  if(packedGenotypes) {
+    return packedGenotypes->NumAttributes();
+  }
   return(attributes.size());
 }
 
 AttributeLevel DatasetInstance::GetAttribute(unsigned int index) {
+  if(packedGenotypes) {
+    if(index < packedGenotypes->NumAttributes()) {
+      return packedGenotypes->Get(index, packedGenotypesIndex);
+    } else {
+      cerr << "ERROR: Attribute index is out of range: " << index << endl;
+      exit(1);
+    }
+  }
   if(attributes.size()) {
     if(index < attributes.size()) {
       return attributes[index];
@@ -132,9 +146,9 @@ bool DatasetInstance::AddInfluenceFactorD(double factor) {
 }
 
 void DatasetInstance::Print() {
-  vector<AttributeLevel>::const_iterator it = attributes.begin();
-  for(; it != attributes.end(); ++it) {
-    cout << *it << " ";
+  for(unsigned int attributeIndex = 0; attributeIndex < NumAttributes();
+      ++attributeIndex) {
+    cout << GetAttribute(attributeIndex) << " ";
   }
   if(numerics.size()) {
     cout << " | ";
@@ -152,10 +166,10 @@ void DatasetInstance::Print() {
 }
 
 bool DatasetInstance::SwapAttributes(unsigned int a1, unsigned int a2) {
-  if(a1 >= attributes.size()) {
+  if(a1 >= NumAttributes()) {
     return false;
   }
-  if(a2 >= attributes.size()) {
+  if(a2 >= NumAttributes()) {
     return false;
   }
   // hahaha
@@ -163,6 +177,26 @@ bool DatasetInstance::SwapAttributes(unsigned int a1, unsigned int a2) {
     return true;
   }
 
+  if(missingAttributes.size()) {
+    MissingWord bit1 = (missingAttributes[a1 / BITS_PER_MISSING_WORD] >>
+                        (a1 % BITS_PER_MISSING_WORD)) & 1;
+    MissingWord bit2 = (missingAttributes[a2 / BITS_PER_MISSING_WORD] >>
+                        (a2 % BITS_PER_MISSING_WORD)) & 1;
+    if(bit1 != bit2) {
+      missingAttributes[a1 / BITS_PER_MISSING_WORD] ^=
+        (MissingWord) 1 << (a1 % BITS_PER_MISSING_WORD);
+      missingAttributes[a2 / BITS_PER_MISSING_WORD] ^=
+        (MissingWord) 1 << (a2 % BITS_PER_MISSING_WORD);
+    }
+  }
+
+  if(packedGenotypes) {
+    AttributeLevel packedTemp = GetAttribute(a1);
+    packedGenotypes->Set(a1, packedGenotypesIndex, GetAttribute(a2));
+    packedGenotypes->Set(a2, packedGenotypesIndex, packedTemp);
+    return true;
+  }
+
   AttributeLevel temp = attributes[a1];
   attributes[a1] = attributes[a2];
   attributes[a2] = temp;
@@ -170,13 +204,49 @@ bool DatasetInstance::SwapAttributes(unsigned int a1, unsigned int a2) {
   return true;
 }
 
+void DatasetInstance::UpdateMissingBitmaps() {
+  unsigned int numAttributes = NumAttributes();
+  missingAttributes.assign((numAttributes + BITS_PER_MISSING_WORD - 1) /
+                           BITS_PER_MISSING_WORD, 0);
+  bool anyMissing = false;
+  for(unsigned int i = 0; i < numAttributes; ++i) {
+    if(GetAttribute(i) == MISSING_ATTRIBUTE_VALUE) {
+      missingAttributes[i / BITS_PER_MISSING_WORD] |=
+        (MissingWord) 1 << (i % BITS_PER_MISSING_WORD);
+      anyMissing = true;
+    }
+  }
+  if(!anyMissing) {
+    vector<MissingWord>().swap(missingAttributes);
+  }
+
+  missingNumerics.assign((numerics.size() + BITS_PER_MISSING_WORD - 1) /
+                         BITS_PER_MISSING_WORD, 0);
+  anyMissing = false;
+  for(unsigned int i = 0; i < numerics.size(); ++i) {
+    if(numerics[i] == MISSING_NUMERIC_VALUE) {
+      missingNumerics[i / BITS_PER_MISSING_WORD] |=
+        (MissingWord) 1 << (i % BITS_PER_MISSING_WORD);
+      anyMissing = true;
+    }
+  }
+  if(!anyMissing) {
+    vector<MissingWord>().swap(missingNumerics);
+  }
+}
+
+void DatasetInstance::SetPackedGenotypes(PackedGenotypes* packed,
+                                         unsigned int packedIndex) {
+  packedGenotypes = packed;
+  packedGenotypesIndex = packedIndex;
+  // the packed matrix is now the only copy of the attributes
+  vector<AttributeLevel>().swap(attributes);
+}
+
 void DatasetInstance::SetDistanceSums(unsigned int kNearestNeighbors,
                                       DistancePairs& sameClassSums,
                                       map<ClassLevel, DistancePairs>& diffClassSums) {
   // added 9/22/11 for iterative Relief-F and EC
-  bestNeighborIdsSameClass.clear();
-  bestNeighborIdsDiffClass.clear();
-
   // use Nate's best_n.h algorithm
   // cout << "Same class sums:" << endl;
   // PrintDistancePairs(sameClassSum);
@@ -184,38 +254,22 @@ void DatasetInstance::SetDistanceSums(unsigned int kNearestNeighbors,
   best_n(sameClassSums.begin(), sameClassSums.end(),
          back_insert_iterator<DistancePairs > (bestInstancesHits),
          kNearestNeighbors, deref_less_bcw());
-  // cout << "Hits:" << endl;
-  DistancePairsIt hit;
-  for(hit = bestInstancesHits.begin(); hit != bestInstancesHits.end(); ++hit) {
-    DistancePair thisHit = *hit;
-    // cout << thisHit.first << " => " << thisHit.second << endl;
-    bestNeighborIdsSameClass.push_back(thisHit.second);
-  }
 
+  map<ClassLevel, DistancePairs> bestInstancesMisses;
   map<ClassLevel, DistancePairs>::const_iterator it = diffClassSums.begin();
   for(; it != diffClassSums.end(); ++it) {
     ClassLevel thisClass = it->first;
-    DistancePairs thisDiffSums = it->second;
-    DistancePairs bestInstancesMisses;
+    const DistancePairs& thisDiffSums = it->second;
     best_n(thisDiffSums.begin(), thisDiffSums.end(),
-           back_insert_iterator<DistancePairs > (bestInstancesMisses),
+           back_insert_iterator<DistancePairs > (bestInstancesMisses[thisClass]),
            kNearestNeighbors, deref_less_bcw());
-    DistancePairsIt mit;
-    // cout << "Class " << thisClass << ", Different class sums:" << endl;
-    // PrintDistancePairs(bestInstanceMisses);
-    for(mit = bestInstancesMisses.begin(); mit != bestInstancesMisses.end(); ++mit) {
-      DistancePair thisMiss = *mit;
-      // cout << thisMiss.first << " => " << thisMiss.second << endl;
-      bestNeighborIdsDiffClass[thisClass].push_back(thisMiss.second);
-    }
   }
-  // cout << "----------------------------------------------------------" << endl;
+
+  SetNearestNeighbors(bestInstancesHits, bestInstancesMisses);
 }
 
 void DatasetInstance::SetDistanceSums(unsigned int kNearestNeighbors,
                                       DistancePairs instanceSums) {
-  bestNeighborIds.clear();
-
   //  cout << "Instance sums:" << endl;
   //  PrintDistancePairs(instanceSums);
 
@@ -228,13 +282,41 @@ void DatasetInstance::SetDistanceSums(unsigned int kNearestNeighbors,
   //  cout << "Best instances:" << endl;
   //  PrintDistancePairs(bestInstances);
 
-  DistancePairsIt it = bestInstances.begin();
-  for(; it != bestInstances.end(); ++it) {
-    //    cout << it->first << " => " << it->second << endl;
-    bestNeighborIds.push_back(it->second);
+  SetNearestNeighbors(bestInstances);
+}
+
+void DatasetInstance::SetNearestNeighbors(const DistancePairs& nearestHits,
+                                          const map<ClassLevel,
+                                          DistancePairs>& nearestMisses) {
+  bestNeighborsSameClass.clear();
+  bestNeighborsDiffClass.clear();
+
+  DistancePairsIt hit;
+  for(hit = nearestHits.begin(); hit != nearestHits.end(); ++hit) {
+    bestNeighborsSameClass.push_back(hit->second);
+  }
+
+  map<ClassLevel, DistancePairs>::const_iterator it = nearestMisses.begin();
+  for(; it != nearestMisses.end(); ++it) {
+    if(it->second.empty()) {
+      continue;
+    }
+    vector<unsigned int>& classMisses = bestNeighborsDiffClass[it->first];
+    DistancePairsIt mit;
+    for(mit = it->second.begin(); mit != it->second.end(); ++mit) {
+      classMisses.push_back(mit->second);
+    }
   }
-  //  PrintVector(bestNeighborIds, "Best neighbor IDs");
-  //  cout << "----------------------------------------------------------" << endl;
+}
+
+void DatasetInstance::SetNearestNeighbors(const DistancePairs& nearestNeighbors) {
+  bestNeighbors.clear();
+
+  DistancePairsIt it = nearestNeighbors.begin();
+  for(; it != nearestNeighbors.end(); ++it) {
+    bestNeighbors.push_back(it->second);
+  }
+  //  PrintVector(bestNeighbors, "Best neighbor indices");
 }
 
 void DatasetInstance::PrintDistancePairs(const DistancePairs& distPairs) {
@@ -246,24 +328,21 @@ void DatasetInstance::PrintDistancePairs(const DistancePairs& distPairs) {
 bool DatasetInstance::GetNNearestInstances(unsigned int n,
                                            vector<unsigned int>& sameClassInstances,
                                            vector<unsigned int>& diffClassInstances) {
-  if((bestNeighborIdsSameClass.size() < n) || (bestNeighborIdsDiffClass.size() < n)) {
+  // case-control: the misses come from the one other class
+  if((bestNeighborsSameClass.size() < n) || !bestNeighborsDiffClass.size() ||
+     (bestNeighborsDiffClass.begin()->second.size() < n)) {
     cerr << endl << "ERROR: GetNNearestInstances: N: [" << n
             << "] is larger than the number of neighbors: "
-            << "Same: " << bestNeighborIdsSameClass.size()
-            << ", Different: " << bestNeighborIdsDiffClass.size() << endl;
+            << "Same: " << bestNeighborsSameClass.size()
+            << ", Different classes: " << bestNeighborsDiffClass.size() << endl;
     return false;
   }
 
-  sameClassInstances.clear();
-  diffClassInstances.clear();
-  for(unsigned int i = 0; i < n; ++i) {
-    unsigned int sameIdx;
-    dataset->GetInstanceIndexForID(bestNeighborIdsSameClass[i], sameIdx);
-    sameClassInstances.push_back(sameIdx);
-    unsigned int diffIdx;
-    dataset->GetInstanceIndexForID(bestNeighborIdsSameClass[i], diffIdx);
-    sameClassInstances.push_back(diffIdx);
-  }
+  const vector<unsigned int>& diffNeighbors =
+    bestNeighborsDiffClass.begin()->second;
+  sameClassInstances.assign(bestNeighborsSameClass.begin(),
+                            bestNeighborsSameClass.begin() + n);
+  diffClassInstances.assign(diffNeighbors.begin(), diffNeighbors.begin() + n);
 
   return true;
 }
@@ -276,41 +355,32 @@ DatasetInstance::GetNNearestInstances
  map<ClassLevel, vector<unsigned int> >& diffClassInstances
  ) {
 
-  if(bestNeighborIdsSameClass.size() < n) {
+  if(bestNeighborsSameClass.size() < n) {
     cerr << endl << "ERROR: GetNNearestInstances: N: [" << n
             << "] is larger than the number of neighbors "
-            << "in same class: [" << bestNeighborIdsSameClass.size()
+            << "in same class: [" << bestNeighborsSameClass.size()
             << "]" << endl;
     return false;
   }
 
-  sameClassInstances.clear();
-  for(unsigned int i = 0; i < n; ++i) {
-    unsigned int sameIdx;
-    dataset->GetInstanceIndexForID(bestNeighborIdsSameClass[i], sameIdx);
-    //    cout << bestNeighborIdsSameClass[i] << ", " << sameIdx << endl;
-    sameClassInstances.push_back(sameIdx);
-  }
-  //  cout << "------" << endl;
+  sameClassInstances.assign(bestNeighborsSameClass.begin(),
+                            bestNeighborsSameClass.begin() + n);
   // diffClassInstances.clear();
-  map<ClassLevel, std::vector<std::string> >::const_iterator it;
-  for(it = bestNeighborIdsDiffClass.begin();
-      it != bestNeighborIdsDiffClass.end(); ++it) {
+  map<ClassLevel, std::vector<unsigned int> >::const_iterator it;
+  for(it = bestNeighborsDiffClass.begin();
+      it != bestNeighborsDiffClass.end(); ++it) {
     ClassLevel thisClass = it->first;
-    vector<string> ids = it->second;
-    if(ids.size() < n) {
+    const vector<unsigned int>& neighbors = it->second;
+    if(neighbors.size() < n) {
       cerr << endl << "ERROR: GetNNearestInstances: N: [" << n
               << "] is larger than the number of neighbors for class "
-              << thisClass << ": [" << bestNeighborIdsDiffClass.size()
+              << thisClass << ": [" << bestNeighborsDiffClass.size()
               << "]" << endl;
       return false;
     }
-    for(unsigned int i = 0; i < n; ++i) {
-      unsigned int diffIdx;
-      dataset->GetInstanceIndexForID(ids[i], diffIdx);
-      //      cout << ids[i] << ", " << diffIdx << endl;
-      diffClassInstances[thisClass].push_back(diffIdx);
-    }
+    diffClassInstances[thisClass].insert(diffClassInstances[thisClass].end(),
+                                         neighbors.begin(),
+                                         neighbors.begin() + n);
   }
   return true;
 }
@@ -318,7 +388,7 @@ DatasetInstance::GetNNearestInstances
 bool DatasetInstance::GetNNearestInstances(unsigned int n,
                                            vector<unsigned int>& closestInstances) {
 
-  if(bestNeighborIds.size() < n) {
+  if(bestNeighbors.size() < n) {
     cerr << "ERROR: GetNNearestInstances: k: [" << n
             << "] is larger than the number of neighbors" << endl;
     return false;
@@ -327,12 +397,7 @@ bool DatasetInstance::GetNNearestInstances(unsigned int n,
   //  cout << "Same sums (" << sameSums.size() << ")" << endl;
   //  copy(neighborSums.begin(), neighborSums.end(), ostream_iterator<double>(cout, "\n"));
 
-  closestInstances.clear();
-  for(unsigned int i = 0; i < n; ++i) {
-    unsigned int instanceIndex;
-    dataset->GetInstanceIndexForID(bestNeighborIds[i], instanceIndex);
-    closestInstances.push_back(instanceIndex);
-  }
+  closestInstances.assign(bestNeighbors.begin(), bestNeighbors.begin() + n);
 
   return true;
 }
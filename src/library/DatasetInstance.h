@@ -19,11 +19,13 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <stdint.h>
 
 #include "Insilico.h"
 
 /// forward reference to avoid circular include problems
 class Dataset;
+class PackedGenotypes;
 
 class DatasetInstance
 {
@@ -88,6 +90,62 @@ public:
    * \return bool success
    ****************************************************************************/
   bool SwapAttributes(unsigned int a1, unsigned int a2);
+  /*************************************************************************//**
+   * Read and write this instance's discrete attributes through a packed
+   * genotype matrix instead of the attributes vector.
+   * \param [in] packed pointer to the data set's packed genotype matrix
+   * \param [in] packedIndex this instance's row in the packed matrix
+   ****************************************************************************/
+  void SetPackedGenotypes(PackedGenotypes* packed, unsigned int packedIndex);
+  /// Does this instance read its attributes from a packed genotype matrix?
+  bool HasPackedGenotypes() { return packedGenotypes != 0; }
+  /// This instance's row in the packed genotype matrix.
+  unsigned int GetPackedIndex() { return packedGenotypesIndex; }
+  /// one word of a missing value bitmap: one bit per attribute or numeric
+  typedef uint64_t MissingWord;
+  /// attributes or numerics per missing value bitmap word
+  static const unsigned int BITS_PER_MISSING_WORD = 64;
+  /*************************************************************************//**
+   * Record which discrete attributes and numerics are missing, one bit each,
+   * so distance loops can skip the missing value checks where neither
+   * instance has a missing value. Call again after changing the values;
+   * SwapAttributes keeps the bitmaps.
+   ****************************************************************************/
+  void UpdateMissingBitmaps();
+  /*************************************************************************//**
+   * Missing value bitmap of the discrete attributes or the numerics, by
+   * attribute or numeric index; empty when none are missing.
+   * \param [in] attributeType DISCRETE_TYPE or NUMERIC_TYPE
+   * \return bitmap words
+   ****************************************************************************/
+  const std::vector<MissingWord>& GetMissingBitmap(AttributeType attributeType)
+    const {
+    return (attributeType == NUMERIC_TYPE) ? missingNumerics :
+      missingAttributes;
+  }
+  /*************************************************************************//**
+   * Are any of a range of attributes or numerics missing, by the bitmaps of
+   * the last UpdateMissingBitmaps?
+   * \param [in] attributeType DISCRETE_TYPE or NUMERIC_TYPE
+   * \param [in] indices attribute or numeric indices
+   * \param [in] begin first position in indices
+   * \param [in] end one past the last position in indices
+   * \return true if any are missing
+   ****************************************************************************/
+  bool AnyMissing(AttributeType attributeType,
+                  const std::vector<unsigned int>& indices,
+                  unsigned int begin, unsigned int end) const {
+    const std::vector<MissingWord>& bitmap = GetMissingBitmap(attributeType);
+    if(bitmap.empty()) {
+      return false;
+    }
+    MissingWord missing = 0;
+    for(unsigned int i = begin; i < end; ++i) {
+      missing |= bitmap[indices[i] / BITS_PER_MISSING_WORD] >>
+        (indices[i] % BITS_PER_MISSING_WORD);
+    }
+    return (missing & 1) != 0;
+  }
   /*************************************************************************//**
    * Set the best kNearestNeighbors from the same and different classes
    * SIDE_EFFECT: Sorts and loads class the vairables: sameSums snd diffSums
@@ -110,6 +168,21 @@ public:
    ****************************************************************************/
   void SetDistanceSums(unsigned int kNearestNeighbors,
                        DistancePairs instancesSums);
+  /*************************************************************************//**
+   * Set the nearest neighbors from the same and different classes, already
+   * selected, e.g. by a best_n_selector.
+   * \param [in] nearestHits nearest same class pairs <distance, instance>
+   * \param [in] nearestMisses nearest pairs <distance, instance> of each
+   *                           other class
+   ****************************************************************************/
+  void SetNearestNeighbors(const DistancePairs& nearestHits,
+                           const std::map<ClassLevel,
+                           DistancePairs>& nearestMisses);
+  /*************************************************************************//**
+   * Set the nearest neighbors from all other instances, already selected.
+   * \param [in] nearestNeighbors nearest pairs <distance, instance>
+   ****************************************************************************/
+  void SetNearestNeighbors(const DistancePairs& nearestNeighbors);
   /*************************************************************************//**
    * Prints passed distance pairs.
    * \param [in] distPairs distance pairs
@@ -143,21 +216,42 @@ public:
    ****************************************************************************/
   bool GetNNearestInstances(unsigned int n,
                             std::vector<unsigned int>& closestInstances);
-  /// discrete attributes
+  /// Nearest same class instance indices, nearest first.
+  const std::vector<unsigned int>& GetNearestHits() const {
+    return bestNeighborsSameClass;
+  }
+  /// Nearest instance indices for each other class, nearest first.
+  const std::map<ClassLevel, std::vector<unsigned int> >&
+  GetNearestMisses() const {
+    return bestNeighborsDiffClass;
+  }
+  /// Nearest instance indices for continuous class, nearest first.
+  const std::vector<unsigned int>& GetNearestNeighbors() const {
+    return bestNeighbors;
+  }
+  /// discrete attributes; empty when stored in a packed genotype matrix
   std::vector<AttributeLevel> attributes;
   /// continuous attributes
   std::vector<NumericLevel> numerics;
 private:
   /// pointer to a Dataset object
   Dataset* dataset;
+  /// packed genotype matrix holding the discrete attributes, if any
+  PackedGenotypes* packedGenotypes;
+  /// row of this instance in the packed genotype matrix
+  unsigned int packedGenotypesIndex;
+  /// missing discrete attributes, one bit each; empty if none are missing
+  std::vector<MissingWord> missingAttributes;
+  /// missing numerics, one bit each; empty if none are missing
+  std::vector<MissingWord> missingNumerics;
   /// the class value for this instance
   ClassLevel classLabel;
-  /// vector of instance IDs for the best neighbors in this instance's class
-  std::vector<std::string> bestNeighborIdsSameClass;
-  /// vector of instance IDs for the best neighbors of different class(es)
-  std::map<ClassLevel, std::vector<std::string> > bestNeighborIdsDiffClass;
-  /// best neighbor IDs for continuous class
-  std::vector<std::string> bestNeighborIds;
+  /// instance indices of the best neighbors in this instance's class
+  std::vector<unsigned int> bestNeighborsSameClass;
+  /// instance indices of the best neighbors of different class(es)
+  std::map<ClassLevel, std::vector<unsigned int> > bestNeighborsDiffClass;
+  /// instance indices of the best neighbors for continuous class
+  std::vector<unsigned int> bestNeighbors;
   /// nearest neighbor weighting factors
   std::vector<double> neighborInfluenceFactorDs;
   /// continuous value for this class
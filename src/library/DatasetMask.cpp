@@ -0,0 +1,159 @@
+/*
+ * DatasetMask.cpp
+ *
+ * Bitset mask of active data set columns or rows with a hash name index
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "DatasetMask.h"
+
+using namespace std;
+
+/// last version number handed out to any mask
+static unsigned long lastMaskVersion = 0;
+
+/// A version number no mask has had before; masks are changed from
+/// parallel regions, so the counter is only touched under a lock.
+static unsigned long NextMaskVersion() {
+  unsigned long nextVersion = 0;
+#pragma omp critical(DatasetMaskVersion)
+  nextVersion = ++lastMaskVersion;
+  return nextVersion;
+}
+
+DatasetMask::DatasetMask() {
+  numActive = 0;
+  version = NextMaskVersion();
+  cacheVersion = 0;
+}
+
+void DatasetMask::Set(const string& name, unsigned int index) {
+  NameIndexMap::iterator pos = nameIndex.find(name);
+  if(pos != nameIndex.end()) {
+    if(pos->second == index) {
+      if(!activeBits.test(index)) {
+        activeBits.set(index);
+        ++numActive;
+        Changed();
+      }
+      return;
+    }
+    // the name moves to a new index
+    ReleaseIndex(pos->second);
+  }
+  if(index >= indexNames.size()) {
+    indexNames.resize(index + 1);
+    activeBits.resize(index + 1);
+  } else {
+    // another name held this index
+    ReleaseIndex(index);
+  }
+  nameIndex[name] = index;
+  indexNames[index] = name;
+  activeBits.set(index);
+  ++numActive;
+  Changed();
+}
+
+bool DatasetMask::Remove(const string& name) {
+  NameIndexMap::const_iterator pos = nameIndex.find(name);
+  if((pos == nameIndex.end()) || !activeBits.test(pos->second)) {
+    return false;
+  }
+  activeBits.reset(pos->second);
+  --numActive;
+  Changed();
+
+  return true;
+}
+
+bool DatasetMask::Contains(const string& name) const {
+  unsigned int index = 0;
+  return Find(name, index);
+}
+
+bool DatasetMask::Find(const string& name, unsigned int& index) const {
+  NameIndexMap::const_iterator pos = nameIndex.find(name);
+  if((pos == nameIndex.end()) || !activeBits.test(pos->second)) {
+    return false;
+  }
+  index = pos->second;
+
+  return true;
+}
+
+bool DatasetMask::IsIndexActive(unsigned int index) const {
+  return (index < activeBits.size()) && activeBits.test(index);
+}
+
+void DatasetMask::clear() {
+  nameIndex.clear();
+  indexNames.clear();
+  activeBits.clear();
+  numActive = 0;
+  Changed();
+}
+
+DatasetMask::const_iterator DatasetMask::begin() const {
+  Refresh();
+  return cachedEntries.begin();
+}
+
+DatasetMask::const_iterator DatasetMask::end() const {
+  Refresh();
+  return cachedEntries.end();
+}
+
+const vector<unsigned int>& DatasetMask::GetIndices() const {
+  Refresh();
+  return cachedIndices;
+}
+
+const vector<string>& DatasetMask::GetNames() const {
+  Refresh();
+  return cachedNames;
+}
+
+void DatasetMask::ReleaseIndex(unsigned int index) {
+  if(index >= indexNames.size()) {
+    return;
+  }
+  NameIndexMap::iterator pos = nameIndex.find(indexNames[index]);
+  if((pos != nameIndex.end()) && (pos->second == index)) {
+    nameIndex.erase(pos);
+  }
+  indexNames[index].clear();
+  if(activeBits.test(index)) {
+    activeBits.reset(index);
+    --numActive;
+  }
+  Changed();
+}
+
+void DatasetMask::Changed() {
+  version = NextMaskVersion();
+}
+
+void DatasetMask::Refresh() const {
+  if(cacheVersion == version) {
+    return;
+  }
+  cachedEntries.clear();
+  cachedEntries.reserve(numActive);
+  boost::dynamic_bitset<>::size_type index = activeBits.find_first();
+  for(; index != boost::dynamic_bitset<>::npos;
+      index = activeBits.find_next(index)) {
+    cachedEntries.push_back(make_pair(indexNames[index], (unsigned int) index));
+  }
+  sort(cachedEntries.begin(), cachedEntries.end());
+  cachedIndices.resize(cachedEntries.size());
+  cachedNames.resize(cachedEntries.size());
+  for(unsigned int i = 0; i < cachedEntries.size(); ++i) {
+    cachedNames[i] = cachedEntries[i].first;
+    cachedIndices[i] = cachedEntries[i].second;
+  }
+  cacheVersion = version;
+}
@@ -0,0 +1,108 @@
+/**
+ * \class DatasetMask
+ *
+ * \brief Set of active named columns or rows of a Dataset.
+ *
+ * Each name maps to an index in the data set: an attribute column or an
+ * instance row. Membership is a dense bitset over those indices. Names are
+ * found through a hash index. Each index belongs to at most one name.
+ *
+ * The active names and indices are also kept in sorted name order, the order
+ * the old std::map masks used. These vectors are cached and rebuilt by the
+ * first read or Refresh after the mask changes. Every change gets a new
+ * version number. Version numbers are unique across all masks, so equal
+ * versions mean equal contents, even after a mask is copied and restored.
+ *
+ * \sa Dataset
+ */
+
+#ifndef DATASETMASK_H
+#define	DATASETMASK_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/dynamic_bitset.hpp>
+#include <boost/unordered_map.hpp>
+
+class DatasetMask
+{
+public:
+  /// name and index of an active entry
+  typedef std::pair<std::string, unsigned int> Entry;
+  /// iterates over active entries in name order
+  typedef std::vector<Entry>::const_iterator const_iterator;
+
+  DatasetMask();
+  /*************************************************************************//**
+   * Add a name to the mask or give it a new index. The name becomes active.
+   * \param [in] name column or row name
+   * \param [in] index column or row index in the data set
+   ****************************************************************************/
+  void Set(const std::string& name, unsigned int index);
+  /*************************************************************************//**
+   * Make a name inactive.
+   * \param [in] name column or row name
+   * \return true if the name was active
+   ****************************************************************************/
+  bool Remove(const std::string& name);
+  /// Is the name active?
+  bool Contains(const std::string& name) const;
+  /*************************************************************************//**
+   * Look up the index of an active name.
+   * \param [in] name column or row name
+   * \param [out] index column or row index
+   * \return true if the name is active
+   ****************************************************************************/
+  bool Find(const std::string& name, unsigned int& index) const;
+  /// Is the column or row index active?
+  bool IsIndexActive(unsigned int index) const;
+  /// Remove all names.
+  void clear();
+  /// Number of active names.
+  unsigned int size() const { return numActive; }
+  /// First active entry in name order.
+  const_iterator begin() const;
+  /// End of the active entries.
+  const_iterator end() const;
+  /// Active indices in name order.
+  const std::vector<unsigned int>& GetIndices() const;
+  /// Active names in sorted order.
+  const std::vector<std::string>& GetNames() const;
+  /// Active indices as a bitset over all indices.
+  const boost::dynamic_bitset<>& GetIndexBits() const { return activeBits; }
+  /// Version number of the current contents.
+  unsigned long GetVersion() const { return version; }
+  /*************************************************************************//**
+   * Rebuild the name-ordered vectors if the mask changed since last time.
+   * The readers above call this and are plain reads once it is done, but the
+   * rebuild itself is not thread safe: refresh a changed mask before reading
+   * it from a parallel region.
+   ****************************************************************************/
+  void Refresh() const;
+private:
+  /// Deactivate an index and forget its name.
+  void ReleaseIndex(unsigned int index);
+  /// Record a change to the mask.
+  void Changed();
+
+  typedef boost::unordered_map<std::string, unsigned int> NameIndexMap;
+  /// name => index for every name in the mask, active or not
+  NameIndexMap nameIndex;
+  /// index => name; empty for unused indices
+  std::vector<std::string> indexNames;
+  /// active indices
+  boost::dynamic_bitset<> activeBits;
+  unsigned int numActive;
+  unsigned long version;
+
+  /// active entries, indices and names in name order
+  mutable std::vector<Entry> cachedEntries;
+  mutable std::vector<unsigned int> cachedIndices;
+  mutable std::vector<std::string> cachedNames;
+  /// version the cached vectors were built from
+  mutable unsigned long cacheVersion;
+};
+
+#endif	/* DATASETMASK_H */
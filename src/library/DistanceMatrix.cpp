@@ -0,0 +1,374 @@
+/*
+ * DistanceMatrix.cpp
+ *
+ * Packed upper triangular instance distance matrix
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "DistanceMatrix.h"
+
+using namespace std;
+
+/// alignment of the packed distances: a huge page, or a cache line
+static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+static const size_t CACHE_LINE_BYTES = 64;
+/// binary file distances start on a page boundary, for mmap
+static const size_t FILE_DATA_ALIGNMENT = 4096;
+/// bytes per write of the distances
+static const size_t WRITE_CHUNK_BYTES = 64 * 1024 * 1024;
+static const char DISTANCE_FILE_MAGIC[8] = {
+  'E', 'C', 'D', 'I', 'S', 'T', 'M', 'X'
+};
+
+DistanceMatrix::DistanceMatrix() {
+  size = 0;
+  precision = DISTANCE_FLOAT64;
+  storage = 0;
+  mapping = 0;
+  mappingBytes = 0;
+  doubles = 0;
+  floats = 0;
+}
+
+DistanceMatrix::~DistanceMatrix() {
+  Clear();
+}
+
+bool DistanceMatrix::Allocate(unsigned int newSize,
+                              DistancePrecision newPrecision,
+                              bool hugePages) {
+  Clear();
+  size = newSize;
+  precision = newPrecision;
+  size_t numBytes = Bytes();
+  // huge pages only pay off for matrices of several pages
+  bool useHugePages = hugePages && (numBytes >= 4 * HUGE_PAGE_BYTES);
+  size_t alignment = useHugePages ? HUGE_PAGE_BYTES : CACHE_LINE_BYTES;
+  if(posix_memalign(&storage, alignment, numBytes ? numBytes : alignment)) {
+    cerr << "ERROR: DistanceMatrix::Allocate could not allocate " << numBytes
+            << " bytes for " << newSize << " x " << newSize << " distances"
+            << endl;
+    storage = 0;
+    size = 0;
+    return false;
+  }
+#ifdef MADV_HUGEPAGE
+  if(useHugePages) {
+    // advice only: without transparent huge pages this is a no-op
+    madvise(storage, numBytes, MADV_HUGEPAGE);
+  }
+#endif
+  memset(storage, 0, numBytes);
+  if(precision == DISTANCE_FLOAT32) {
+    floats = static_cast<float*>(storage);
+  } else {
+    doubles = static_cast<double*>(storage);
+  }
+
+  return true;
+}
+
+void DistanceMatrix::Clear() {
+  if(storage) {
+    free(storage);
+  }
+  if(mapping) {
+    munmap(mapping, mappingBytes);
+  }
+  storage = 0;
+  mapping = 0;
+  mappingBytes = 0;
+  doubles = 0;
+  floats = 0;
+  size = 0;
+}
+
+size_t DistanceMatrix::Bytes() const {
+  size_t numPairs = ((size_t) size * (size ? (size - 1) : 0)) / 2;
+  return numPairs *
+    ((precision == DISTANCE_FLOAT32) ? sizeof(float) : sizeof(double));
+}
+
+bool DistanceMatrix::WriteBinary(string filename,
+                                 const vector<string>& instanceIds,
+                                 const vector<double>& phenotypes,
+                                 bool continuousPhenotypes) const {
+  if((instanceIds.size() != size) || (phenotypes.size() != size)) {
+    cerr << "ERROR: DistanceMatrix::WriteBinary: " << instanceIds.size()
+            << " IDs and " << phenotypes.size() << " phenotypes for "
+            << size << " instances" << endl;
+    return false;
+  }
+
+  DistanceMatrixFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DISTANCE_FILE_MAGIC, sizeof(header.magic));
+  header.byteOrder = DISTANCE_FILE_BYTE_ORDER;
+  header.version = DISTANCE_FILE_VERSION;
+  header.precision = precision;
+  header.triangular = 1;
+  header.numInstances = size;
+  header.continuousPhenotypes = continuousPhenotypes ? 1 : 0;
+  header.phenotypesOffset = sizeof(header);
+  header.idsOffset = header.phenotypesOffset + size * sizeof(double);
+  uint64_t idsBytes = 0;
+  for(unsigned int i = 0; i < size; ++i) {
+    idsBytes += instanceIds[i].size() + 1;
+  }
+  header.dataOffset = ((header.idsOffset + idsBytes + FILE_DATA_ALIGNMENT - 1) /
+                       FILE_DATA_ALIGNMENT) * FILE_DATA_ALIGNMENT;
+  header.dataBytes = Bytes();
+
+  ofstream outFile(filename.c_str(), ios::out | ios::binary);
+  if(!outFile.is_open()) {
+    cerr << "ERROR: DistanceMatrix::WriteBinary could not open " << filename
+            << endl;
+    return false;
+  }
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if(size) {
+    outFile.write(reinterpret_cast<const char*>(&phenotypes[0]),
+                  size * sizeof(double));
+  }
+  for(unsigned int i = 0; i < size; ++i) {
+    outFile.write(instanceIds[i].c_str(), instanceIds[i].size() + 1);
+  }
+  vector<char> padding(header.dataOffset - (header.idsOffset + idsBytes), 0);
+  if(padding.size()) {
+    outFile.write(&padding[0], padding.size());
+  }
+  // the packed distances straight from the one allocation, in large writes
+  const char* data = (precision == DISTANCE_FLOAT32) ?
+    reinterpret_cast<const char*>(floats) :
+    reinterpret_cast<const char*>(doubles);
+  for(size_t written = 0; written < header.dataBytes;
+      written += WRITE_CHUNK_BYTES) {
+    size_t chunkBytes = header.dataBytes - written;
+    if(chunkBytes > WRITE_CHUNK_BYTES) {
+      chunkBytes = WRITE_CHUNK_BYTES;
+    }
+    outFile.write(data + written, chunkBytes);
+  }
+  outFile.close();
+  if(outFile.fail()) {
+    cerr << "ERROR: DistanceMatrix::WriteBinary could not write " << filename
+            << endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool DistanceMatrix::MapBinary(string filename, vector<string>& instanceIds,
+                               vector<double>& phenotypes,
+                               bool& continuousPhenotypes) {
+  Clear();
+  int fileDescriptor = open(filename.c_str(), O_RDONLY);
+  if(fileDescriptor == -1) {
+    cerr << "ERROR: DistanceMatrix::MapBinary could not open " << filename
+            << endl;
+    return false;
+  }
+  struct stat fileStatus;
+  if((fstat(fileDescriptor, &fileStatus) == -1) ||
+     ((size_t) fileStatus.st_size < sizeof(DistanceMatrixFileHeader))) {
+    cerr << "ERROR: DistanceMatrix::MapBinary: " << filename
+            << " is too short for a distance matrix" << endl;
+    close(fileDescriptor);
+    return false;
+  }
+  size_t fileBytes = fileStatus.st_size;
+  void* mappedFile = mmap(0, fileBytes, PROT_READ, MAP_SHARED, fileDescriptor,
+                          0);
+  close(fileDescriptor);
+  if(mappedFile == MAP_FAILED) {
+    cerr << "ERROR: DistanceMatrix::MapBinary could not map " << filename
+            << endl;
+    return false;
+  }
+
+  const char* fileStart = static_cast<const char*>(mappedFile);
+  DistanceMatrixFileHeader header;
+  memcpy(&header, fileStart, sizeof(header));
+  string problem = "";
+  if(memcmp(header.magic, DISTANCE_FILE_MAGIC, sizeof(header.magic))) {
+    problem = "is not a binary distance matrix";
+  } else if(header.byteOrder != DISTANCE_FILE_BYTE_ORDER) {
+    problem = "was written with another byte order";
+  } else if(header.version != DISTANCE_FILE_VERSION) {
+    problem = "is an unknown version";
+  } else if(((header.precision != DISTANCE_FLOAT64) &&
+             (header.precision != DISTANCE_FLOAT32)) || !header.triangular) {
+    problem = "has an unknown precision or layout";
+  } else if((header.numInstances > UINT_MAX) ||
+            (header.phenotypesOffset != sizeof(header)) ||
+            (header.numInstances >
+             (fileBytes - sizeof(header)) / sizeof(double)) ||
+            (header.idsOffset != header.phenotypesOffset +
+             header.numInstances * sizeof(double)) ||
+            (header.dataOffset < header.idsOffset) ||
+            (header.dataOffset > fileBytes) ||
+            (header.dataOffset % sizeof(double)) ||
+            (header.dataBytes > fileBytes - header.dataOffset)) {
+    // bounded by subtraction, so no sum of offsets can wrap
+    problem = "is truncated or inconsistent";
+  }
+  if(problem == "") {
+    size = header.numInstances;
+    precision = (DistancePrecision) header.precision;
+    if(header.dataBytes != Bytes()) {
+      problem = "has the wrong number of distances";
+    }
+  }
+  // every ID ends before the distances
+  instanceIds.clear();
+  const char* id = fileStart + header.idsOffset;
+  const char* idsEnd = fileStart + header.dataOffset;
+  for(unsigned int i = 0; (problem == "") && (i < size); ++i) {
+    const char* idEnd = static_cast<const char*>(memchr(id, 0, idsEnd - id));
+    if(!idEnd) {
+      problem = "has a truncated instance ID table";
+      break;
+    }
+    instanceIds.push_back(string(id, idEnd));
+    id = idEnd + 1;
+  }
+  if(problem != "") {
+    cerr << "ERROR: DistanceMatrix::MapBinary: " << filename << " " << problem
+            << endl;
+    munmap(mappedFile, fileBytes);
+    size = 0;
+    instanceIds.clear();
+    return false;
+  }
+
+  phenotypes.resize(size);
+  if(size) {
+    memcpy(&phenotypes[0], fileStart + header.phenotypesOffset,
+           size * sizeof(double));
+  }
+  continuousPhenotypes = (header.continuousPhenotypes != 0);
+  mapping = mappedFile;
+  mappingBytes = fileBytes;
+  void* data = const_cast<char*>(fileStart + header.dataOffset);
+  if(precision == DISTANCE_FLOAT32) {
+    floats = static_cast<float*>(data);
+  } else {
+    doubles = static_cast<double*>(data);
+  }
+
+  return true;
+}
+
+bool DistanceMatrix::ReadText(string filename, vector<string>& instanceIds) {
+  Clear();
+  instanceIds.clear();
+  ifstream inFile(filename.c_str());
+  if(!inFile.is_open()) {
+    cerr << "ERROR: DistanceMatrix::ReadText could not open " << filename
+            << endl;
+    return false;
+  }
+  string line;
+  if(getline(inFile, line)) {
+    istringstream header(line);
+    string id;
+    while(header >> id) {
+      instanceIds.push_back(id);
+    }
+  }
+  unsigned int numInstances = instanceIds.size();
+  if(!numInstances) {
+    cerr << "ERROR: DistanceMatrix::ReadText: " << filename
+            << " has no instance IDs header line" << endl;
+    return false;
+  }
+  if(!Allocate(numInstances, DISTANCE_FLOAT64, true)) {
+    instanceIds.clear();
+    return false;
+  }
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    unsigned int numRead = 0;
+    if(getline(inFile, line)) {
+      const char* field = line.c_str();
+      char* fieldEnd = 0;
+      for(; numRead < numInstances; ++numRead) {
+        double distance = strtod(field, &fieldEnd);
+        if(fieldEnd == field) {
+          break;
+        }
+        if(numRead > i) {
+          Set(i, numRead, distance);
+        }
+        field = fieldEnd;
+      }
+    }
+    if(numRead != numInstances) {
+      cerr << "ERROR: DistanceMatrix::ReadText: " << filename << " row "
+              << (i + 1) << " does not have " << numInstances << " distances"
+              << endl;
+      Clear();
+      instanceIds.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool DistanceMatrix::Load(string filename, vector<string>& instanceIds) {
+  char magic[sizeof(DISTANCE_FILE_MAGIC)];
+  ifstream inFile(filename.c_str(), ios::in | ios::binary);
+  if(!inFile.is_open()) {
+    cerr << "ERROR: DistanceMatrix::Load could not open " << filename << endl;
+    return false;
+  }
+  bool isBinary = inFile.read(magic, sizeof(magic)) &&
+    !memcmp(magic, DISTANCE_FILE_MAGIC, sizeof(magic));
+  inFile.close();
+  if(isBinary) {
+    vector<double> phenotypes;
+    bool continuousPhenotypes;
+    return MapBinary(filename, instanceIds, phenotypes, continuousPhenotypes);
+  }
+
+  return ReadText(filename, instanceIds);
+}
+
+bool DistanceMatrix::ParsePrecision(string name, DistancePrecision& parsed) {
+  if(name == "float64") {
+    parsed = DISTANCE_FLOAT64;
+    return true;
+  }
+  if(name == "float32") {
+    parsed = DISTANCE_FLOAT32;
+    return true;
+  }
+
+  return false;
+}
+
+bool DistanceMatrix::ParseFileFormat(string name, DistanceFileFormat& parsed) {
+  if(name == "text") {
+    parsed = DISTANCE_FILE_TEXT;
+    return true;
+  }
+  if(name == "binary") {
+    parsed = DISTANCE_FILE_BINARY;
+    return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,184 @@
+/**
+ * \class DistanceMatrix
+ *
+ * \brief Packed upper triangular instance distance matrix.
+ *
+ * A symmetric distance matrix with a zero diagonal only needs the pairs
+ * above the diagonal: n (n - 1) / 2 entries instead of n x n. They are
+ * packed row by row in one contiguous allocation, as doubles or as floats.
+ * Floats halve the memory again, a quarter of a dense double matrix, at
+ * about seven significant digits. Large matrices can ask for transparent
+ * huge pages, so walking the matrix takes fewer TLB misses; where the system
+ * has none this is an ordinary allocation.
+ *
+ * Get and Set take any (row, column) pair; the packed position is the same
+ * either way round.
+ *
+ * WriteBinary saves the matrix with its instance IDs and phenotypes in a
+ * binary file that other tools can mmap: a DistanceMatrixFileHeader, n
+ * double phenotypes, n NUL-terminated instance IDs, zero padding to a page
+ * boundary, then the packed distances exactly as they are in memory, in the
+ * byte order of the machine that wrote them. MapBinary maps such a file as
+ * a read-only matrix without reading the distances. Load also reads the
+ * tab-delimited text matrix Dataset::CalculateDistanceMatrix writes, so
+ * distances from other tools can be given in either form.
+ *
+ * \sa PairwiseDistances, Dataset::CalculateDistanceMatrix
+ */
+
+#ifndef DISTANCEMATRIX_H
+#define	DISTANCEMATRIX_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+/// precision of the stored distances
+typedef enum
+{
+  DISTANCE_FLOAT64,
+  DISTANCE_FLOAT32
+} DistancePrecision;
+
+/// distance matrix file formats
+typedef enum
+{
+  DISTANCE_FILE_TEXT,
+  DISTANCE_FILE_BINARY
+} DistanceFileFormat;
+
+/// start of a binary distance matrix file; offsets are from the file start
+struct DistanceMatrixFileHeader
+{
+  /// "ECDISTMX"
+  char magic[8];
+  /// DISTANCE_FILE_BYTE_ORDER as written; anything else is foreign
+  uint32_t byteOrder;
+  /// DISTANCE_FILE_VERSION
+  uint32_t version;
+  /// DistancePrecision of the distances
+  uint32_t precision;
+  /// 1: packed upper triangle without the diagonal, row by row
+  uint32_t triangular;
+  /// number of instances n
+  uint64_t numInstances;
+  /// 1: the phenotypes are continuous; 0: class levels
+  uint32_t continuousPhenotypes;
+  uint32_t reserved;
+  /// n doubles
+  uint64_t phenotypesOffset;
+  /// n NUL-terminated instance IDs
+  uint64_t idsOffset;
+  /// packed distances, page aligned
+  uint64_t dataOffset;
+  uint64_t dataBytes;
+};
+
+const static uint32_t DISTANCE_FILE_BYTE_ORDER = 0x01020304;
+const static uint32_t DISTANCE_FILE_VERSION = 1;
+
+class DistanceMatrix
+{
+public:
+  DistanceMatrix();
+  ~DistanceMatrix();
+  /*************************************************************************//**
+   * Allocate a zeroed matrix, releasing any previous one.
+   * \param [in] newSize number of instances n
+   * \param [in] newPrecision doubles or floats
+   * \param [in] hugePages advise transparent huge pages for the allocation
+   * \return success
+   ****************************************************************************/
+  bool Allocate(unsigned int newSize, DistancePrecision newPrecision,
+                bool hugePages=false);
+  /// Release the matrix.
+  void Clear();
+  /// Number of instances n.
+  unsigned int Size() const { return size; }
+  DistancePrecision Precision() const { return precision; }
+  /// Bytes of the packed distances.
+  std::size_t Bytes() const;
+  /// Distance between instances i and j; zero on the diagonal.
+  double Get(unsigned int i, unsigned int j) const {
+    if(i == j) {
+      return 0.0;
+    }
+    std::size_t index = (i < j) ? PackedIndex(i, j) : PackedIndex(j, i);
+    return (precision == DISTANCE_FLOAT32) ?
+      (double) floats[index] : doubles[index];
+  }
+  /// Set the distance between different instances i and j.
+  void Set(unsigned int i, unsigned int j, double distance) {
+    std::size_t index = (i < j) ? PackedIndex(i, j) : PackedIndex(j, i);
+    if(precision == DISTANCE_FLOAT32) {
+      floats[index] = (float) distance;
+    } else {
+      doubles[index] = distance;
+    }
+  }
+  /*************************************************************************//**
+   * Write the matrix to a binary file, see DistanceMatrixFileHeader.
+   * \param [in] filename file to write
+   * \param [in] instanceIds ID of each of the n instances
+   * \param [in] phenotypes phenotype of each of the n instances
+   * \param [in] continuousPhenotypes are the phenotypes continuous?
+   * \return success
+   ****************************************************************************/
+  bool WriteBinary(std::string filename,
+                   const std::vector<std::string>& instanceIds,
+                   const std::vector<double>& phenotypes,
+                   bool continuousPhenotypes) const;
+  /*************************************************************************//**
+   * Map a binary distance matrix file read-only, releasing any previous
+   * matrix. Do not Set distances in a mapped matrix.
+   * \param [in] filename file written by WriteBinary
+   * \param [out] instanceIds ID of each of the n instances
+   * \param [out] phenotypes phenotype of each of the n instances
+   * \param [out] continuousPhenotypes are the phenotypes continuous?
+   * \return success
+   ****************************************************************************/
+  bool MapBinary(std::string filename, std::vector<std::string>& instanceIds,
+                 std::vector<double>& phenotypes, bool& continuousPhenotypes);
+  /*************************************************************************//**
+   * Read a tab-delimited text matrix: a header line of the n instance IDs,
+   * then n rows of n distances. Only the upper triangle is kept.
+   * \param [in] filename text matrix file
+   * \param [out] instanceIds ID of each of the n instances
+   * \return success
+   ****************************************************************************/
+  bool ReadText(std::string filename, std::vector<std::string>& instanceIds);
+  /*************************************************************************//**
+   * Map a binary matrix file or read a text one, whichever the file is.
+   * \param [in] filename binary or text matrix file
+   * \param [out] instanceIds ID of each of the n instances
+   * \return success
+   ****************************************************************************/
+  bool Load(std::string filename, std::vector<std::string>& instanceIds);
+  /// Is the matrix a mapped file?
+  bool IsMapped() const { return mapping != 0; }
+  /// Parse "float64" or "float32"; false for anything else.
+  static bool ParsePrecision(std::string name, DistancePrecision& parsed);
+  /// Parse "text" or "binary"; false for anything else.
+  static bool ParseFileFormat(std::string name, DistanceFileFormat& parsed);
+private:
+  /// no copies of the one allocation
+  DistanceMatrix(const DistanceMatrix&);
+  DistanceMatrix& operator=(const DistanceMatrix&);
+  /// Position of pair (i, j), i < j, in the packed upper triangle.
+  std::size_t PackedIndex(std::size_t i, std::size_t j) const {
+    return (i * (2 * (std::size_t) size - i - 1)) / 2 + (j - i - 1);
+  }
+
+  unsigned int size;
+  DistancePrecision precision;
+  /// the one allocation, viewed as doubles or floats
+  void* storage;
+  /// or the mapped file holding them
+  void* mapping;
+  std::size_t mappingBytes;
+  double* doubles;
+  float* floats;
+};
+
+#endif	/* DISTANCEMATRIX_H */
@@ -0,0 +1,215 @@
+/**
+ * \file DistanceMetricPolicies.h
+ *
+ * \brief Inlineable distance metric policies for ReliefF.
+ *
+ * The diff functions of DistanceMetrics.h as function objects, so loops
+ * over attributes can be templates on the metric: the compiler sees the
+ * metric's body and inlines it, where a diff function pointer is an
+ * indirect call per attribute. Callers choose the template instance once,
+ * from the diff function pointer, before the loop. Each policy returns
+ * exactly what its diff function returns; the diff functions call them.
+ * PointerMetric keeps the indirect call, for comparison and for any other
+ * diff function.
+ *
+ * Present() is the diff of two values known not to be missing, without the
+ * missing value checks. PresentValues turns it into a policy for blocks of
+ * attributes where the missing value bitmaps show no missing values.
+ */
+
+#ifndef DISTANCEMETRICPOLICIES_H
+#define	DISTANCEMETRICPOLICIES_H
+
+#include <cstdlib>
+#include <cmath>
+#include <utility>
+
+#include "Insilico.h"
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "DistanceMetrics.h"
+
+/// Diff of a missing genotype: RELIEF-D, see CheckMissing.
+inline double MissingGenotypeDiff() {
+  return 2.0 / 3.0;
+}
+
+/// Genotype mismatch metric: diffGMM.
+struct GMMetric {
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    AttributeLevel level1 = dsi1->GetAttribute(attributeIndex);
+    AttributeLevel level2 = dsi2->GetAttribute(attributeIndex);
+    if((level1 == MISSING_ATTRIBUTE_VALUE) ||
+       (level2 == MISSING_ATTRIBUTE_VALUE)) {
+      return MissingGenotypeDiff();
+    }
+    return (level1 != level2) ? 1.0 : 0.0;
+  }
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return (dsi1->GetAttribute(attributeIndex) !=
+            dsi2->GetAttribute(attributeIndex)) ? 1.0 : 0.0;
+  }
+};
+
+/// Allele mismatch metric: diffAMM.
+struct AMMetric {
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    AttributeLevel level1 = dsi1->GetAttribute(attributeIndex);
+    AttributeLevel level2 = dsi2->GetAttribute(attributeIndex);
+    if((level1 == MISSING_ATTRIBUTE_VALUE) ||
+       (level2 == MISSING_ATTRIBUTE_VALUE)) {
+      return MissingGenotypeDiff();
+    }
+    return (double) abs((int) level1 - (int) level2) * 0.5;
+  }
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return (double) abs((int) dsi1->GetAttribute(attributeIndex) -
+                        (int) dsi2->GetAttribute(attributeIndex)) * 0.5;
+  }
+};
+
+/// Nucleotide count array metric: diffNCA.
+struct NCAMetric {
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    AttributeLevel level1 = dsi1->GetAttribute(attributeIndex);
+    AttributeLevel level2 = dsi2->GetAttribute(attributeIndex);
+    if((level1 == MISSING_ATTRIBUTE_VALUE) ||
+       (level2 == MISSING_ATTRIBUTE_VALUE)) {
+      return MissingGenotypeDiff();
+    }
+    return dsi1->GetDatasetPtr()->GetNucleotideCountDistance(attributeIndex,
+                                                             level1, level2,
+                                                             false);
+  }
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return dsi1->GetDatasetPtr()->GetNucleotideCountDistance(
+      attributeIndex, dsi1->GetAttribute(attributeIndex),
+      dsi2->GetAttribute(attributeIndex), false);
+  }
+};
+
+/// Nucleotide count array + G/C sum + A/T sum metric: diffNCA6.
+struct NCA6Metric {
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    AttributeLevel level1 = dsi1->GetAttribute(attributeIndex);
+    AttributeLevel level2 = dsi2->GetAttribute(attributeIndex);
+    if((level1 == MISSING_ATTRIBUTE_VALUE) ||
+       (level2 == MISSING_ATTRIBUTE_VALUE)) {
+      return MissingGenotypeDiff();
+    }
+    return dsi1->GetDatasetPtr()->GetNucleotideCountDistance(attributeIndex,
+                                                             level1, level2,
+                                                             true);
+  }
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return dsi1->GetDatasetPtr()->GetNucleotideCountDistance(
+      attributeIndex, dsi1->GetAttribute(attributeIndex),
+      dsi2->GetAttribute(attributeIndex), true);
+  }
+};
+
+/// Kimura transition/transversion metric: diffKM.
+struct KMMetric {
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    if(dsi1->GetAttribute(attributeIndex) == dsi2->GetAttribute(attributeIndex)) {
+      return 0.0;
+    }
+    AttributeMutationType mutationType =
+      dsi1->GetDatasetPtr()->GetAttributeMutationType(attributeIndex);
+    if(mutationType == TRANSITION_MUTATION) {
+      return 1.0;
+    }
+    if(mutationType == TRANSVERSION_MUTATION) {
+      return 2.0;
+    }
+    return 0.0;
+  }
+  /// diffKM has no missing value rule: a missing value is another genotype
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return (*this)(attributeIndex, dsi1, dsi2);
+  }
+};
+
+/// "Manhattan" metric for continuous attributes: diffManhattan.
+struct ManhattanMetric {
+  double operator()(unsigned int numericIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    NumericLevel value1 = dsi1->numerics[numericIndex];
+    NumericLevel value2 = dsi2->numerics[numericIndex];
+    if((value1 == MISSING_NUMERIC_VALUE) || (value2 == MISSING_NUMERIC_VALUE)) {
+      return CheckMissingNumeric(numericIndex, dsi1, dsi2).second;
+    }
+    std::pair<double, double> minMax =
+      dsi1->GetDatasetPtr()->GetMinMaxForNumeric(numericIndex);
+    return fabs(value1 - value2) / (minMax.second - minMax.first);
+  }
+  double Present(unsigned int numericIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    std::pair<double, double> minMax =
+      dsi1->GetDatasetPtr()->GetMinMaxForNumeric(numericIndex);
+    return fabs(dsi1->numerics[numericIndex] - dsi2->numerics[numericIndex]) /
+      (minMax.second - minMax.first);
+  }
+};
+
+/// Euclidean metric for continuous attributes: diffEuclidean.
+struct EuclideanMetric {
+  double operator()(unsigned int numericIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    NumericLevel value1 = dsi1->numerics[numericIndex];
+    NumericLevel value2 = dsi2->numerics[numericIndex];
+    if((value1 == MISSING_NUMERIC_VALUE) || (value2 == MISSING_NUMERIC_VALUE)) {
+      return CheckMissingNumeric(numericIndex, dsi1, dsi2).second;
+    }
+    return hypot(value1, value2);
+  }
+  double Present(unsigned int numericIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return hypot(dsi1->numerics[numericIndex], dsi2->numerics[numericIndex]);
+  }
+};
+
+/// Any diff function, called through its pointer.
+class PointerMetric {
+public:
+  typedef double (*DiffFunction)(unsigned int attributeIndex,
+                                 DatasetInstance* dsi1,
+                                 DatasetInstance* dsi2);
+  PointerMetric(DiffFunction diffFunction) : diff(diffFunction) { }
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    return diff(attributeIndex, dsi1, dsi2);
+  }
+  /// an unknown diff function keeps its own missing value checks
+  double Present(unsigned int attributeIndex, DatasetInstance* dsi1,
+                 DatasetInstance* dsi2) const {
+    return diff(attributeIndex, dsi1, dsi2);
+  }
+private:
+  DiffFunction diff;
+};
+
+/// A metric policy for values known not to be missing: Metric::Present.
+template<class Metric>
+class PresentValues {
+public:
+  PresentValues(const Metric& valueMetric) : metric(valueMetric) { }
+  double operator()(unsigned int attributeIndex, DatasetInstance* dsi1,
+                    DatasetInstance* dsi2) const {
+    return metric.Present(attributeIndex, dsi1, dsi2);
+  }
+private:
+  Metric metric;
+};
+
+#endif	/* DISTANCEMETRICPOLICIES_H */
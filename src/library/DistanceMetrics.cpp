@@ -6,13 +6,15 @@
  */
 
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <map>
 #include <utility>
-#include <cmath>
+#include <algorithm>
 
 #include "Dataset.h"
 #include "DistanceMetrics.h"
+#include "DistanceMetricPolicies.h"
 #include "DatasetInstance.h"
 #include "Statistics.h"
 
@@ -23,11 +25,11 @@ pair<bool, double> CheckMissing(unsigned int attributeIndex,
                                 DatasetInstance* dsi2) {
   int numMissing = 0;
   pair<double, double> hasMissing = make_pair(false, false);
-  if(dsi1->attributes[attributeIndex] == MISSING_ATTRIBUTE_VALUE) {
+  if(dsi1->GetAttribute(attributeIndex) == MISSING_ATTRIBUTE_VALUE) {
     hasMissing.first = true;
     ++numMissing;
   }
-  if(dsi2->attributes[attributeIndex] == MISSING_ATTRIBUTE_VALUE) {
+  if(dsi2->GetAttribute(attributeIndex) == MISSING_ATTRIBUTE_VALUE) {
     hasMissing.second = true;
     ++numMissing;
   }
@@ -135,118 +137,66 @@ double norm(double x, double minX, double maxX) {
 double diffAMM(unsigned int attributeIndex,
                DatasetInstance* dsi1,
                DatasetInstance* dsi2) {
-  double distance = 0.0;
-  pair<bool, double> checkMissing = CheckMissing(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-    distance = (double)
-            abs((int) dsi1->attributes[attributeIndex] -
-                (int) dsi2->attributes[attributeIndex]) * 0.5;
-  }
-  return distance;
+  return AMMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffGMM(unsigned int attributeIndex,
                DatasetInstance* dsi1,
                DatasetInstance* dsi2) {
-  double distance = 0.0;
-  pair<bool, double> checkMissing = CheckMissing(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-    distance = (dsi1->attributes[attributeIndex] !=
-                dsi2->attributes[attributeIndex]) ? 1.0 : 0.0;
-  }
-  return distance;
+  return GMMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffNCA(unsigned int attributeIndex,
                DatasetInstance* dsi1,
                DatasetInstance* dsi2) {
-  double distance = 0.0;
-  // TODO: need special missing value checks for NCA metrics
-  pair<bool, double> checkMissing = CheckMissing(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-  	pair<char, char> alleles =
-  			dsi1->GetDatasetPtr()->GetAttributeAlleles(attributeIndex);
-  	string a1 = " ";
-  	a1[0] = alleles.first;
-  	string a2 = " ";
-  	a2[0] = alleles.second;
-  	map<AttributeLevel, string> genotypeMap;
-  	genotypeMap[0] = a1 + a1;
-  	genotypeMap[1] = a1 + a2;
-  	genotypeMap[2] = a2 + a2;
-  	AttributeLevel attrLevel1 = dsi1->attributes[attributeIndex];
-  	AttributeLevel attrLevel2 = dsi2->attributes[attributeIndex];
-  	string genotype1 = genotypeMap[attrLevel1];
-  	string genotype2 = genotypeMap[attrLevel2];
-  	map<char, unsigned int> nca1;
-  	nca1['A'] = 0; nca1['T'] = 0; nca1['C'] = 0; nca1['G'] = 0;
-  	++nca1[genotype1[0]];
-  	++nca1[genotype1[1]];
-  	map<char, unsigned int> nca2;
-  	nca2['A'] = 0; nca2['T'] = 0; nca2['C'] = 0; nca2['G'] = 0;
-  	++nca2[genotype2[0]];
-  	++nca2[genotype2[1]];
-  	map<char, unsigned int>::const_iterator nca1It = nca1.begin();
-  	map<char, unsigned int>::const_iterator nca2It = nca2.begin();
-  	for(; nca1It != nca1.end(); ++nca1It, ++nca2It) {
-  		double nucleotideCount1 = (double) nca1It->second;
-  		double nucleotideCount2 = (double) nca2It->second;
-  		distance += abs(nucleotideCount1 - nucleotideCount2);
-  	}
-  }
-  return distance;
+  return NCAMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffNCA6(unsigned int attributeIndex,
                 DatasetInstance* dsi1,
                 DatasetInstance* dsi2) {
+  return NCA6Metric()(attributeIndex, dsi1, dsi2);
+}
+
+/// Copies of a nucleotide in a genotype with 0, 1 or 2 copies of allele 2.
+static int NucleotideCount(char nucleotide, pair<char, char> alleles,
+                           AttributeLevel level) {
+  int count = 0;
+  if(((level == 2) ? alleles.second : alleles.first) == nucleotide) {
+    ++count;
+  }
+  if(((level == 0) ? alleles.first : alleles.second) == nucleotide) {
+    ++count;
+  }
+  return count;
+}
+
+double diffNucleotideCounts(pair<char, char> alleles,
+                            AttributeLevel level1,
+                            AttributeLevel level2,
+                            bool withSums) {
+  // A, C, G, T, then any other allele letters
+  char nucleotides[6] = { 'A', 'C', 'G', 'T', 0, 0 };
+  unsigned int numNucleotides = 4;
+  if(find(nucleotides, nucleotides + numNucleotides, alleles.first) ==
+     nucleotides + numNucleotides) {
+    nucleotides[numNucleotides++] = alleles.first;
+  }
+  if(find(nucleotides, nucleotides + numNucleotides, alleles.second) ==
+     nucleotides + numNucleotides) {
+    nucleotides[numNucleotides++] = alleles.second;
+  }
+  int counts1[6];
+  int counts2[6];
   double distance = 0.0;
-  // TODO: need special missing value checks for NCA metrics
-  pair<bool, double> checkMissing = CheckMissing(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-  	pair<char, char> alleles =
-  			dsi1->GetDatasetPtr()->GetAttributeAlleles(attributeIndex);
-  	string a1 = " ";
-  	a1[0] = alleles.first;
-  	string a2 = " ";
-  	a2[0] = alleles.second;
-  	map<AttributeLevel, string> genotypeMap;
-  	genotypeMap[0] = a1 + a1;
-  	genotypeMap[1] = a1 + a2;
-  	genotypeMap[2] = a2 + a2;
-  	AttributeLevel attrLevel1 = dsi1->attributes[attributeIndex];
-  	AttributeLevel attrLevel2 = dsi2->attributes[attributeIndex];
-  	string genotype1 = genotypeMap[attrLevel1];
-  	string genotype2 = genotypeMap[attrLevel2];
-  	map<char, unsigned int> nca1;
-  	nca1['A'] = 0; nca1['T'] = 0; nca1['C'] = 0; nca1['G'] = 0;
-  	nca1['X'] = 0; nca1['Y'] = 0;
-  	++nca1[genotype1[0]];
-  	++nca1[genotype1[1]];
-  	nca1['X'] = nca1['A'] + nca1['G'];
-  	nca1['Y'] = nca1['C'] + nca1['T'];
-  	map<char, unsigned int> nca2;
-  	nca2['A'] = 0; nca2['T'] = 0; nca2['C'] = 0; nca2['G'] = 0;
-  	nca2['X'] = 0; nca2['Y'] = 0;
-  	++nca2[genotype2[0]];
-  	++nca2[genotype2[1]];
-  	nca2['X'] = nca2['A'] + nca2['G'];
-  	nca2['Y'] = nca2['C'] + nca2['T'];
-  	map<char, unsigned int>::const_iterator nca1It = nca1.begin();
-  	map<char, unsigned int>::const_iterator nca2It = nca2.begin();
-  	for(; nca1It != nca1.end(); ++nca1It, ++nca2It) {
-  		double nucleotideCount1 = (double) nca1It->second;
-  		double nucleotideCount2 = (double) nca2It->second;
-  		distance += abs(nucleotideCount1 - nucleotideCount2);
-  	}
+  for(unsigned int n = 0; n < numNucleotides; ++n) {
+    counts1[n] = NucleotideCount(nucleotides[n], alleles, level1);
+    counts2[n] = NucleotideCount(nucleotides[n], alleles, level2);
+    distance += abs(counts1[n] - counts2[n]);
+  }
+  if(withSums) {
+    distance += abs((counts1[0] + counts1[2]) - (counts2[0] + counts2[2]));
+    distance += abs((counts1[1] + counts1[3]) - (counts2[1] + counts2[3]));
   }
   return distance;
 }
@@ -254,62 +204,19 @@ double diffNCA6(unsigned int attributeIndex,
 double diffKM(unsigned int attributeIndex,
                DatasetInstance* dsi1,
                DatasetInstance* dsi2) {
-  double distance = 0.0;
-
-	AttributeLevel dsi1Al =  dsi1->GetAttribute(attributeIndex);
-	AttributeLevel dsi2Al =  dsi2->GetAttribute(attributeIndex);
-	if(dsi1Al != dsi2Al) {
-		if(dsi1->GetDatasetPtr()->GetAttributeMutationType(attributeIndex) ==
-				TRANSITION_MUTATION) {
-			distance = 1.0;
-		}
-		if(dsi1->GetDatasetPtr()->GetAttributeMutationType(attributeIndex) ==
-				TRANSVERSION_MUTATION) {
-			distance = 2.0;
-		}
-	}
-
-  return distance;
+  return KMMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffManhattan(unsigned int attributeIndex,
                      DatasetInstance* dsi1,
                      DatasetInstance* dsi2) {
-
-  //  double wekaNormDiff = fabs(norm(dsi1->numerics[attributeIndex],
-  //                                  minMax.first, minMax.second) -
-  //                             norm(dsi2->numerics[attributeIndex],
-  //                                  minMax.first, minMax.second));
-  // the above code is equivalent; why???
-  double distance = 0.0;
-  pair<bool, double> checkMissing =
-          CheckMissingNumeric(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-    pair<double, double> minMax =
-            dsi1->GetDatasetPtr()->GetMinMaxForNumeric(attributeIndex);
-    distance =
-            fabs(dsi1->numerics[attributeIndex] -
-                 dsi2->numerics[attributeIndex]) /
-            (minMax.second - minMax.first);
-  }
-  return distance;
+  return ManhattanMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffEuclidean(unsigned int attributeIndex,
                      DatasetInstance* dsi1,
                      DatasetInstance* dsi2) {
-  double distance = 0.0;
-  pair<bool, double> checkMissing =
-          CheckMissingNumeric(attributeIndex, dsi1, dsi2);
-  if(checkMissing.first) {
-    distance = checkMissing.second;
-  } else {
-    distance =
-    		hypot(dsi1->numerics[attributeIndex], dsi2->numerics[attributeIndex]);
-  }
-  return distance;
+  return EuclideanMetric()(attributeIndex, dsi1, dsi2);
 }
 
 double diffPredictedValueTau(DatasetInstance* dsi1, DatasetInstance* dsi2) {
@@ -13,6 +13,10 @@
 #ifndef DISTANCEMETRICS_H
 #define	DISTANCEMETRICS_H
 
+#include <utility>
+
+#include "Insilico.h"
+
 /// Forward reference to a DatasetInstance class.
 class DatasetInstance;
 
@@ -85,6 +89,21 @@ double diffNCA(unsigned int attributeIndex,
 double diffNCA6(unsigned int attributeIndex,
                 DatasetInstance* dsi1,
                 DatasetInstance* dsi2);
+/***************************************************************************//**
+ * Nucleotide count distance between two genotypes of a SNP: NCA, or NCA6
+ * with the purine (A + G) and pyrimidine (C + T) sums added. Counts A, C,
+ * G and T, and the SNP's alleles if they are other letters. diffNCA and
+ * diffNCA6 look these up in the data set's per-SNP tables.
+ * \param [in] alleles the SNP's allele 1 and allele 2
+ * \param [in] level1 genotype 1: 0, 1 or 2 copies of allele 2
+ * \param [in] level2 genotype 2: 0, 1 or 2 copies of allele 2
+ * \param [in] withSums add the purine and pyrimidine sums (NCA6)?
+ * \return diff(erence) considering nucleotide counts
+ ****************************************************************************/
+double diffNucleotideCounts(std::pair<char, char> alleles,
+                            AttributeLevel level1,
+                            AttributeLevel level2,
+                            bool withSums);
 /***************************************************************************//**
  * Kimura distance - considers transition/transversion mutation types
  * \param [in] attributeIndex index into the vector of attributes
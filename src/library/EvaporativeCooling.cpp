@@ -178,20 +178,27 @@ EvaporativeCooling::EvaporativeCooling(Dataset* ds, po::variables_map& vm,
 		}
 	}
 	interactionAlgorithm = NULL;
+	// EC removes attributes and runs ReliefF again on the same instances, so
+	// ReliefF keeps its distances and subtracts the removed attributes
+	ReliefF* reliefF = NULL;
 	switch(itAlgorithmType) {
 	case EC_IT_ALG_RF:
     if(ds->HasContinuousPhenotypes()) {
       cout << Timestamp() << "Constructing Regression ReliefF..." << endl;
-      interactionAlgorithm = new RReliefF(ds, vm);
+      reliefF = new RReliefF(ds, vm);
     } else {
       cout << Timestamp() << "Constructing Standard ReliefF..." << endl;
-      interactionAlgorithm = new ReliefF(ds, vm, anaType);
+      reliefF = new ReliefF(ds, vm, anaType);
     }
 		break;
 	case EC_IT_ALG_RFSEQ:
-		interactionAlgorithm = new ReliefFSeq(ds, vm);
+		reliefF = new ReliefFSeq(ds, vm);
 		break;
 	}
+	if (reliefF) {
+		reliefF->SetKeepDistances(true);
+		interactionAlgorithm = reliefF;
+	}
 
 	outFilesPrefix = paramsMap["out-files-prefix"].as<string>();
 
@@ -348,14 +355,20 @@ EvaporativeCooling::EvaporativeCooling(Dataset* ds, ConfigMap& configMap,
 		}
 	}
 	interactionAlgorithm = NULL;
+	// keep ReliefF's distances across EC iterations
+	ReliefF* reliefF = NULL;
 	switch(meAlgorithmType) {
 	case EC_IT_ALG_RF:
-		interactionAlgorithm = new ReliefF(ds, configMap, anaType);
+		reliefF = new ReliefF(ds, configMap, anaType);
 		break;
 	case EC_IT_ALG_RFSEQ:
-		interactionAlgorithm = new ReliefFSeq(ds, configMap);
+		reliefF = new ReliefFSeq(ds, configMap);
 		break;
 	}
+	if (reliefF) {
+		reliefF->SetKeepDistances(true);
+		interactionAlgorithm = reliefF;
+	}
 
 	if (GetConfigValue(configMap, "out-files-prefix", configValue)) {
 		outFilesPrefix = configValue;
@@ -0,0 +1,195 @@
+/*
+ * GenotypeBitPlanes.cpp
+ *
+ * Bit-sliced genotype mismatch, allele mismatch and mutation type distances
+ */
+
+#include <iostream>
+#include <vector>
+#include <climits>
+
+#include "GenotypeBitPlanes.h"
+#include "DatasetInstance.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// distance contributed by a missing value: RELIEF-D, see CheckMissing
+static const double MISSING_GENOTYPE_DISTANCE = 2.0 / 3.0;
+
+GenotypeBitPlanes::GenotypeBitPlanes() {
+  built = false;
+  numInstances = 0;
+  numAttributes = 0;
+  wordsPerInstance = 0;
+}
+
+bool GenotypeBitPlanes::Build(const vector<DatasetInstance*>& instances,
+                              const vector<unsigned int>& attributeIndices) {
+  Clear();
+  numInstances = instances.size();
+  numAttributes = attributeIndices.size();
+  wordsPerInstance =
+    (numAttributes + BITS_PER_PLANE_WORD - 1) / BITS_PER_PLANE_WORD;
+  // unused bits stay zero in all planes: no mismatch, not missing
+  planes.assign(numInstances * wordsPerInstance * PLANES_PER_WORD, 0);
+  transitionMask.assign(wordsPerInstance, 0);
+  transversionMask.assign(wordsPerInstance, 0);
+
+  bool badLevel = false;
+#pragma omp parallel for
+  for(int instanceIndex = 0; instanceIndex < (int) numInstances;
+      ++instanceIndex) {
+    DatasetInstance* dsi = instances[instanceIndex];
+    BitPlaneWord* row =
+      &planes[instanceIndex * wordsPerInstance * PLANES_PER_WORD];
+    for(unsigned int i = 0; i < numAttributes; ++i) {
+      AttributeLevel level = dsi->GetAttribute(attributeIndices[i]);
+      BitPlaneWord* words = row + (i / BITS_PER_PLANE_WORD) * PLANES_PER_WORD;
+      BitPlaneWord bit = ((BitPlaneWord) 1) << (i % BITS_PER_PLANE_WORD);
+      switch(level) {
+        case 0:
+          break;
+        case 1:
+          words[0] |= bit;
+          break;
+        case 2:
+          words[1] |= bit;
+          break;
+        case MISSING_ATTRIBUTE_VALUE:
+          words[2] |= bit;
+          break;
+        default:
+          badLevel = true;
+      }
+    }
+  }
+  if(badLevel) {
+    cerr << "ERROR: GenotypeBitPlanes::Build: attribute levels must be "
+            << "0, 1, 2 or missing" << endl;
+    Clear();
+    return false;
+  }
+  built = true;
+
+  return true;
+}
+
+void GenotypeBitPlanes::Clear() {
+  vector<BitPlaneWord>().swap(planes);
+  vector<BitPlaneWord>().swap(transitionMask);
+  vector<BitPlaneWord>().swap(transversionMask);
+  built = false;
+  numInstances = 0;
+  numAttributes = 0;
+  wordsPerInstance = 0;
+}
+
+bool GenotypeBitPlanes::SetMutationTypes(
+  const vector<AttributeMutationType>& mutationTypes) {
+  if(!built || (mutationTypes.size() != numAttributes)) {
+    cerr << "ERROR: GenotypeBitPlanes::SetMutationTypes: need one mutation "
+            << "type per attribute of the built bit planes" << endl;
+    return false;
+  }
+  transitionMask.assign(wordsPerInstance, 0);
+  transversionMask.assign(wordsPerInstance, 0);
+  for(unsigned int i = 0; i < numAttributes; ++i) {
+    BitPlaneWord bit = ((BitPlaneWord) 1) << (i % BITS_PER_PLANE_WORD);
+    if(mutationTypes[i] == TRANSITION_MUTATION) {
+      transitionMask[i / BITS_PER_PLANE_WORD] |= bit;
+    }
+    if(mutationTypes[i] == TRANSVERSION_MUTATION) {
+      transversionMask[i / BITS_PER_PLANE_WORD] |= bit;
+    }
+  }
+
+  return true;
+}
+
+double GenotypeBitPlanes::DistanceGM(unsigned int instanceIndex1,
+                                     unsigned int instanceIndex2) const {
+  return DistanceFromCounts(CountsGM(instanceIndex1, instanceIndex2));
+}
+
+double GenotypeBitPlanes::DistanceAM(unsigned int instanceIndex1,
+                                     unsigned int instanceIndex2) const {
+  return DistanceFromCounts(CountsAM(instanceIndex1, instanceIndex2));
+}
+
+GenotypeBitPlanes::DistanceCounts
+GenotypeBitPlanes::CountsGM(unsigned int instanceIndex1,
+                            unsigned int instanceIndex2) const {
+  const BitPlaneWord* row1 = Row(instanceIndex1);
+  const BitPlaneWord* row2 = Row(instanceIndex2);
+  unsigned int mismatches = 0;
+  unsigned int missing = 0;
+  for(size_t w = 0; w < wordsPerInstance * PLANES_PER_WORD;
+      w += PLANES_PER_WORD) {
+    BitPlaneWord eitherMissing = row1[w + 2] | row2[w + 2];
+    BitPlaneWord differ = (row1[w] ^ row2[w]) | (row1[w + 1] ^ row2[w + 1]);
+    mismatches += PopCount(differ & ~eitherMissing);
+    missing += PopCount(eitherMissing);
+  }
+
+  DistanceCounts counts;
+  counts.halfSteps = 2 * mismatches;
+  counts.missing = missing;
+  return counts;
+}
+
+GenotypeBitPlanes::DistanceCounts
+GenotypeBitPlanes::CountsAM(unsigned int instanceIndex1,
+                            unsigned int instanceIndex2) const {
+  const BitPlaneWord* row1 = Row(instanceIndex1);
+  const BitPlaneWord* row2 = Row(instanceIndex2);
+  // |level1 - level2| in half steps: one for any mismatch, one more for 0 vs 2
+  unsigned int halfSteps = 0;
+  unsigned int missing = 0;
+  for(size_t w = 0; w < wordsPerInstance * PLANES_PER_WORD;
+      w += PLANES_PER_WORD) {
+    BitPlaneWord eitherMissing = row1[w + 2] | row2[w + 2];
+    BitPlaneWord present = ~eitherMissing;
+    BitPlaneWord differ = (row1[w] ^ row2[w]) | (row1[w + 1] ^ row2[w + 1]);
+    BitPlaneWord levelZero1 = ~(row1[w] | row1[w + 1]);
+    BitPlaneWord levelZero2 = ~(row2[w] | row2[w + 1]);
+    BitPlaneWord opposite = (row1[w + 1] & levelZero2) |
+      (row2[w + 1] & levelZero1);
+    halfSteps += PopCount(differ & present) + PopCount(opposite & present);
+    missing += PopCount(eitherMissing);
+  }
+
+  DistanceCounts counts;
+  counts.halfSteps = halfSteps;
+  counts.missing = missing;
+  return counts;
+}
+
+GenotypeBitPlanes::MutationCounts
+GenotypeBitPlanes::CountsMutations(unsigned int instanceIndex1,
+                                   unsigned int instanceIndex2) const {
+  const BitPlaneWord* row1 = Row(instanceIndex1);
+  const BitPlaneWord* row2 = Row(instanceIndex2);
+  MutationCounts counts;
+  counts.mismatches = 0;
+  counts.transitions = 0;
+  counts.transversions = 0;
+  for(size_t word = 0; word < wordsPerInstance; ++word) {
+    const BitPlaneWord* words1 = row1 + word * PLANES_PER_WORD;
+    const BitPlaneWord* words2 = row2 + word * PLANES_PER_WORD;
+    // missing is a third plane bit, so it differs like a fourth genotype
+    BitPlaneWord differ = (words1[0] ^ words2[0]) | (words1[1] ^ words2[1]) |
+      (words1[2] ^ words2[2]);
+    counts.mismatches += PopCount(differ);
+    counts.transitions += PopCount(differ & transitionMask[word]);
+    counts.transversions += PopCount(differ & transversionMask[word]);
+  }
+
+  return counts;
+}
+
+double GenotypeBitPlanes::DistanceFromCounts(const DistanceCounts& counts) {
+  // a whole number of GM mismatches is exact in half steps
+  return (counts.halfSteps * 0.5) +
+    (counts.missing * MISSING_GENOTYPE_DISTANCE);
+}
@@ -0,0 +1,185 @@
+/**
+ * \class GenotypeBitPlanes
+ *
+ * \brief Instance-major genotype bit planes for fast GM, AM and KM distances.
+ *
+ * Holds the selected discrete attributes of every instance as three bit
+ * planes, 64 attributes per word: the low and high bits of the attribute
+ * level (0 = 00, 1 = 01, 2 = 10) and a missing value flag. The genotype
+ * mismatch count between two instances is then XOR and popcount over the
+ * planes. The words of the three planes are interleaved so one pair distance
+ * reads two contiguous rows.
+ *
+ * Missing values follow the RELIEF-D convention of the distance metrics: a
+ * missing value in either instance contributes 2/3 to the distance.
+ *
+ * For the Kimura and Jukes-Cantor distances, per-attribute transition and
+ * transversion masks in the same word layout turn the mismatch count into
+ * transition and transversion counts with one AND each.
+ *
+ * \sa DistanceMetrics, Dataset
+ */
+
+#ifndef GENOTYPEBITPLANES_H
+#define	GENOTYPEBITPLANES_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "Insilico.h"
+
+class DatasetInstance;
+
+class GenotypeBitPlanes
+{
+public:
+  /// one word of a bit plane: one bit per attribute
+  typedef uint64_t BitPlaneWord;
+  /// attributes per bit plane word
+  static const unsigned int BITS_PER_PLANE_WORD = 64;
+
+  /// the integer counts a GM or AM distance is made of
+  struct DistanceCounts {
+    /// half steps between present genotypes: two per GM mismatch
+    unsigned int halfSteps;
+    /// attributes missing in either instance
+    unsigned int missing;
+  };
+
+  /// the mismatch counts a Kimura or Jukes-Cantor distance is made of
+  struct MutationCounts {
+    /// attributes with different genotypes, missing counted as a genotype
+    unsigned int mismatches;
+    /// mismatches at transition attributes
+    unsigned int transitions;
+    /// mismatches at transversion attributes
+    unsigned int transversions;
+  };
+
+  GenotypeBitPlanes();
+  /*************************************************************************//**
+   * Build the bit planes from instances' discrete attributes.
+   * \param [in] instances instances in data set order; rows are their indices
+   * \param [in] attributeIndices attributes to include, in distance order
+   * \return success
+   ****************************************************************************/
+  bool Build(const std::vector<DatasetInstance*>& instances,
+             const std::vector<unsigned int>& attributeIndices);
+  /// Release the bit planes.
+  void Clear();
+  /*************************************************************************//**
+   * Set the mutation type of every attribute for CountsMutations. Build
+   * resets all attributes to unknown.
+   * \param [in] mutationTypes mutation types in bit plane order
+   * \return success
+   ****************************************************************************/
+  bool SetMutationTypes(const std::vector<AttributeMutationType>& mutationTypes);
+  /// Have the bit planes been built?
+  bool IsBuilt() const { return built; }
+  /// Number of instances (rows).
+  unsigned int NumInstances() const { return numInstances; }
+  /// Number of attributes in each row.
+  unsigned int NumAttributes() const { return numAttributes; }
+  /// Number of words of BITS_PER_PLANE_WORD attributes in each row.
+  std::size_t NumWords() const { return wordsPerInstance; }
+  /*************************************************************************//**
+   * GM mismatches of two instances in one word of attributes: bit b stands
+   * for attribute (word * BITS_PER_PLANE_WORD + b) in bit plane order.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \param [in] word word index
+   * \param [out] missing attributes missing in either instance
+   * \return attributes present in both instances with different genotypes
+   ****************************************************************************/
+  BitPlaneWord MismatchWord(unsigned int instanceIndex1,
+                            unsigned int instanceIndex2, std::size_t word,
+                            BitPlaneWord& missing) const {
+    const BitPlaneWord* words1 = Row(instanceIndex1) + word * PLANES_PER_WORD;
+    const BitPlaneWord* words2 = Row(instanceIndex2) + word * PLANES_PER_WORD;
+    missing = words1[2] | words2[2];
+    return ((words1[0] ^ words2[0]) | (words1[1] ^ words2[1])) & ~missing;
+  }
+  /*************************************************************************//**
+   * Genotype mismatch (GM) distance between two instances.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return sum over attributes of 0 (same), 1 (different) or 2/3 (missing)
+   ****************************************************************************/
+  double DistanceGM(unsigned int instanceIndex1,
+                    unsigned int instanceIndex2) const;
+  /*************************************************************************//**
+   * Allele mismatch (AM) distance between two instances.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return sum over attributes of 0, 0.5, 1.0 or 2/3 (missing)
+   ****************************************************************************/
+  double DistanceAM(unsigned int instanceIndex1,
+                    unsigned int instanceIndex2) const;
+  /*************************************************************************//**
+   * The counts behind the GM distance between two instances. Counts add and
+   * subtract exactly over sets of attributes.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return half steps (two per mismatch) and missing counts
+   ****************************************************************************/
+  DistanceCounts CountsGM(unsigned int instanceIndex1,
+                          unsigned int instanceIndex2) const;
+  /*************************************************************************//**
+   * The counts behind the AM distance between two instances.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return half steps and missing counts
+   ****************************************************************************/
+  DistanceCounts CountsAM(unsigned int instanceIndex1,
+                          unsigned int instanceIndex2) const;
+  /*************************************************************************//**
+   * Genotype mismatches between two instances, in total and at transition
+   * and transversion attributes. A missing value differs from any genotype
+   * but another missing value, as in diffKM.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return mismatch counts
+   ****************************************************************************/
+  MutationCounts CountsMutations(unsigned int instanceIndex1,
+                                 unsigned int instanceIndex2) const;
+  /*************************************************************************//**
+   * The distance made of counts, exactly as DistanceGM and DistanceAM
+   * compute it.
+   * \param [in] counts half steps and missing counts
+   * \return distance
+   ****************************************************************************/
+  static double DistanceFromCounts(const DistanceCounts& counts);
+private:
+  /// bit planes per word position: low level bit, high level bit, missing
+  static const unsigned int PLANES_PER_WORD = 3;
+
+  /// Count the set bits in a word.
+  static unsigned int PopCount(BitPlaneWord word) {
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    unsigned int count = 0;
+    for(; word; ++count) {
+      word &= word - 1;
+    }
+    return count;
+#endif
+  }
+  /// Start of an instance's interleaved planes.
+  const BitPlaneWord* Row(unsigned int instanceIndex) const {
+    return &planes[instanceIndex * wordsPerInstance * PLANES_PER_WORD];
+  }
+
+  bool built;
+  unsigned int numInstances;
+  unsigned int numAttributes;
+  std::size_t wordsPerInstance;
+  /// rows of interleaved (low, high, missing) words, one row per instance
+  std::vector<BitPlaneWord> planes;
+  /// transition and transversion attributes, one word per word position
+  std::vector<BitPlaneWord> transitionMask;
+  std::vector<BitPlaneWord> transversionMask;
+};
+
+#endif	/* GENOTYPEBITPLANES_H */
@@ -32,8 +32,8 @@ typedef double NumericLevel;
 /// type of instance class labels
 typedef short ClassLevel;
 
-/// distance pair type: distance, instance ID
-typedef std::pair<double, std::string> DistancePair;
+/// distance pair type: distance, instance index
+typedef std::pair<double, unsigned int> DistancePair;
 /// vector of distance pairs represents distances to nearest neighbors
 typedef std::vector<DistancePair> DistancePairs;
 /// distance pairs iterator
@@ -0,0 +1,339 @@
+/*
+ * NeighborCache.cpp
+ *
+ * On-disk cache of nearest neighbor searches between runs
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <omp.h>
+
+#include "NeighborCache.h"
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "Insilico.h"
+
+using namespace std;
+
+static const char NEIGHBOR_CACHE_MAGIC[8] = {
+  'E', 'C', 'N', 'B', 'R', 'C', 'C', 'H'
+};
+/// FNV-1a 64-bit offset basis and prime
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+/// Add bytes to an FNV-1a hash.
+static void HashBytes(uint64_t& hash, const void* bytes, size_t numBytes) {
+  const unsigned char* byte = static_cast<const unsigned char*>(bytes);
+  for(size_t i = 0; i < numBytes; ++i) {
+    hash = (hash ^ byte[i]) * FNV_PRIME;
+  }
+}
+
+/// Add a value's bytes to an FNV-1a hash.
+template<class T>
+static void HashValue(uint64_t& hash, const T& value) {
+  HashBytes(hash, &value, sizeof(value));
+}
+
+/// Add a string and its length to an FNV-1a hash.
+static void HashString(uint64_t& hash, const string& value) {
+  HashValue(hash, (uint64_t) value.size());
+  HashBytes(hash, value.data(), value.size());
+}
+
+/// Add unsigned ints and their number to an FNV-1a hash.
+static void HashIndices(uint64_t& hash, const vector<unsigned int>& indices) {
+  HashValue(hash, (uint64_t) indices.size());
+  if(indices.size()) {
+    HashBytes(hash, &indices[0], indices.size() * sizeof(unsigned int));
+  }
+}
+
+/// the cached neighbor lists of one query
+struct CachedNeighbors
+{
+  DistancePairs hits;
+  map<ClassLevel, DistancePairs> misses;
+};
+
+NeighborCache::NeighborCache(Dataset* ds) {
+  dataset = ds;
+  directory = "";
+}
+
+bool NeighborCache::SetDirectory(string newDirectory) {
+  if(newDirectory != "") {
+    struct stat directoryStatus;
+    if((stat(newDirectory.c_str(), &directoryStatus) == -1) ||
+       !S_ISDIR(directoryStatus.st_mode)) {
+      cerr << "ERROR: Neighbor cache directory does not exist: "
+              << newDirectory << endl;
+      return false;
+    }
+    cout << Timestamp() << "Caching nearest neighbors in [" << newDirectory
+            << "]" << endl;
+  }
+  directory = newDirectory;
+
+  return true;
+}
+
+bool NeighborCache::Load(const vector<unsigned int>& instanceIndices,
+                         const vector<unsigned int>& queryIndices,
+                         unsigned int k, string search) {
+  if(!IsEnabled()) {
+    return false;
+  }
+  uint64_t key = ComputeKey(instanceIndices, queryIndices, k, search);
+  string filename = KeyFilename(key);
+  int fileDescriptor = open(filename.c_str(), O_RDONLY);
+  if(fileDescriptor == -1) {
+    if(errno != ENOENT) {
+      cout << Timestamp() << "WARNING: Could not open neighbor cache file ["
+              << filename << "]" << endl;
+    }
+    cout << Timestamp() << "Nearest neighbors not in the cache" << endl;
+    return false;
+  }
+  struct stat fileStatus;
+  if((fstat(fileDescriptor, &fileStatus) == -1) ||
+     ((size_t) fileStatus.st_size < sizeof(NeighborCacheFileHeader))) {
+    cout << Timestamp() << "WARNING: Ignoring short neighbor cache file ["
+            << filename << "]" << endl;
+    close(fileDescriptor);
+    return false;
+  }
+  size_t fileBytes = fileStatus.st_size;
+  void* mappedFile = mmap(0, fileBytes, PROT_READ, MAP_SHARED, fileDescriptor,
+                          0);
+  close(fileDescriptor);
+  if(mappedFile == MAP_FAILED) {
+    cout << Timestamp() << "WARNING: Could not map neighbor cache file ["
+            << filename << "]" << endl;
+    return false;
+  }
+
+  const char* fileStart = static_cast<const char*>(mappedFile);
+  NeighborCacheFileHeader header;
+  memcpy(&header, fileStart, sizeof(header));
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  bool valid =
+    !memcmp(header.magic, NEIGHBOR_CACHE_MAGIC, sizeof(header.magic)) &&
+    (header.byteOrder == NEIGHBOR_CACHE_BYTE_ORDER) &&
+    (header.version == NEIGHBOR_CACHE_VERSION) && (header.key == key) &&
+    (header.k == k) && (header.byClass == (byClass ? 1U : 0U)) &&
+    (header.numInstances == instanceIndices.size()) &&
+    (header.numQueries == queryIndices.size()) &&
+    (header.numRecords == (fileBytes - sizeof(header)) /
+     sizeof(NeighborCacheRecord)) &&
+    (!((fileBytes - sizeof(header)) % sizeof(NeighborCacheRecord)));
+
+  // the records are query by query, in query order; queries without
+  // neighbors have no records
+  vector<CachedNeighbors> neighbors(valid ? queryIndices.size() : 0);
+  const NeighborCacheRecord* records =
+    reinterpret_cast<const NeighborCacheRecord*>(fileStart + sizeof(header));
+  unsigned int numInstances = dataset->NumInstances();
+  unsigned int queryPosition = 0;
+  for(uint64_t i = 0; valid && (i < header.numRecords); ++i) {
+    const NeighborCacheRecord& record = records[i];
+    while((queryPosition < queryIndices.size()) &&
+          (queryIndices[queryPosition] != record.queryIndex)) {
+      ++queryPosition;
+    }
+    if((queryPosition == queryIndices.size()) ||
+       (record.neighborIndex >= numInstances) ||
+       (record.isMiss && !byClass)) {
+      valid = false;
+      break;
+    }
+    DistancePair neighbor(0.0, record.neighborIndex);
+    if(record.isMiss) {
+      neighbors[queryPosition].misses[record.missClass].push_back(neighbor);
+    } else {
+      neighbors[queryPosition].hits.push_back(neighbor);
+    }
+  }
+  munmap(mappedFile, fileBytes);
+  if(!valid) {
+    cout << Timestamp() << "WARNING: Ignoring neighbor cache file ["
+            << filename << "] that does not match the data" << endl;
+    return false;
+  }
+
+  for(unsigned int i = 0; i < queryIndices.size(); ++i) {
+    DatasetInstance* dsi = dataset->GetInstance(queryIndices[i]);
+    if(byClass) {
+      dsi->SetNearestNeighbors(neighbors[i].hits, neighbors[i].misses);
+    } else {
+      dsi->SetNearestNeighbors(neighbors[i].hits);
+    }
+  }
+  cout << Timestamp() << "Loaded nearest neighbors of " << queryIndices.size()
+          << " instances from the cache [" << filename << "]" << endl;
+
+  return true;
+}
+
+bool NeighborCache::Save(const vector<unsigned int>& instanceIndices,
+                         const vector<unsigned int>& queryIndices,
+                         unsigned int k, string search) {
+  if(!IsEnabled()) {
+    return false;
+  }
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  vector<NeighborCacheRecord> records;
+  records.reserve((size_t) queryIndices.size() * k * (byClass ? 2 : 1));
+  for(unsigned int i = 0; i < queryIndices.size(); ++i) {
+    DatasetInstance* dsi = dataset->GetInstance(queryIndices[i]);
+    NeighborCacheRecord record;
+    record.queryIndex = queryIndices[i];
+    record.isMiss = 0;
+    record.missClass = 0;
+    const vector<unsigned int>& hits = byClass ? dsi->GetNearestHits() :
+      dsi->GetNearestNeighbors();
+    for(unsigned int j = 0; j < hits.size(); ++j) {
+      record.neighborIndex = hits[j];
+      records.push_back(record);
+    }
+    if(!byClass) {
+      continue;
+    }
+    record.isMiss = 1;
+    const map<ClassLevel, vector<unsigned int> >& misses =
+      dsi->GetNearestMisses();
+    map<ClassLevel, vector<unsigned int> >::const_iterator missIt;
+    for(missIt = misses.begin(); missIt != misses.end(); ++missIt) {
+      record.missClass = missIt->first;
+      for(unsigned int j = 0; j < missIt->second.size(); ++j) {
+        record.neighborIndex = missIt->second[j];
+        records.push_back(record);
+      }
+    }
+  }
+
+  NeighborCacheFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NEIGHBOR_CACHE_MAGIC, sizeof(header.magic));
+  header.byteOrder = NEIGHBOR_CACHE_BYTE_ORDER;
+  header.version = NEIGHBOR_CACHE_VERSION;
+  header.key = ComputeKey(instanceIndices, queryIndices, k, search);
+  header.k = k;
+  header.byClass = byClass ? 1 : 0;
+  header.numInstances = instanceIndices.size();
+  header.numQueries = queryIndices.size();
+  header.numRecords = records.size();
+
+  // written aside and renamed, so readers see the whole file or none
+  string filename = KeyFilename(header.key);
+  ostringstream tempFilename;
+  tempFilename << filename << ".tmp" << getpid();
+  ofstream outFile(tempFilename.str().c_str(), ios::out | ios::binary);
+  if(!outFile.is_open()) {
+    cout << Timestamp() << "WARNING: Could not open neighbor cache file ["
+            << tempFilename.str() << "]" << endl;
+    return false;
+  }
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if(records.size()) {
+    outFile.write(reinterpret_cast<const char*>(&records[0]),
+                  records.size() * sizeof(NeighborCacheRecord));
+  }
+  outFile.close();
+  if(outFile.fail() ||
+     rename(tempFilename.str().c_str(), filename.c_str())) {
+    cout << Timestamp() << "WARNING: Could not write neighbor cache file ["
+            << filename << "]" << endl;
+    remove(tempFilename.str().c_str());
+    return false;
+  }
+  cout << Timestamp() << "Saved nearest neighbors of " << queryIndices.size()
+          << " instances to the cache [" << filename << "]" << endl;
+
+  return true;
+}
+
+uint64_t NeighborCache::ComputeKey(const vector<unsigned int>& instanceIndices,
+                                   const vector<unsigned int>& queryIndices,
+                                   unsigned int k, string search) {
+  uint64_t key = FNV_OFFSET_BASIS;
+  HashValue(key, NEIGHBOR_CACHE_VERSION);
+  pair<string, string> metrics = dataset->GetDistanceMetrics();
+  HashString(key, metrics.first);
+  HashString(key, metrics.second);
+  HashString(key, search);
+  HashValue(key, k);
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  HashValue(key, byClass);
+  HashIndices(key, instanceIndices);
+  HashIndices(key, queryIndices);
+  const vector<string>& instanceIds = dataset->MaskGetInstanceIds();
+  HashValue(key, (uint64_t) instanceIds.size());
+  for(unsigned int i = 0; i < instanceIds.size(); ++i) {
+    HashString(key, instanceIds[i]);
+  }
+
+  vector<unsigned int> attributeIndices =
+    dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
+  vector<unsigned int> numericIndices =
+    dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
+  HashIndices(key, attributeIndices);
+  HashIndices(key, numericIndices);
+  // mutation metrics depend on the alleles, range-scaled numerics on ranges
+  if(dataset->IsMutationMetric()) {
+    for(unsigned int a = 0; a < attributeIndices.size(); ++a) {
+      HashValue(key, dataset->GetAttributeAlleles(attributeIndices[a]));
+    }
+  }
+  for(unsigned int n = 0; n < numericIndices.size(); ++n) {
+    HashValue(key, dataset->GetMinMaxForNumeric(numericIndices[n]));
+  }
+
+  // each instance's phenotype and values, hashed in parallel, then in order
+  int numInstances = instanceIndices.size();
+  vector<uint64_t> instanceKeys(numInstances);
+#pragma omp parallel for schedule(dynamic, 64)
+  for(int i = 0; i < numInstances; ++i) {
+    DatasetInstance* dsi = dataset->GetInstance(instanceIndices[i]);
+    uint64_t instanceKey = FNV_OFFSET_BASIS;
+    if(byClass) {
+      HashValue(instanceKey, dsi->GetClass());
+    } else {
+      HashValue(instanceKey, dsi->GetPredictedValueTau());
+    }
+    for(unsigned int a = 0; a < attributeIndices.size(); ++a) {
+      HashValue(instanceKey, dsi->GetAttribute(attributeIndices[a]));
+    }
+    for(unsigned int n = 0; n < numericIndices.size(); ++n) {
+      HashValue(instanceKey, dsi->GetNumeric(numericIndices[n]));
+    }
+    instanceKeys[i] = instanceKey;
+  }
+  for(int i = 0; i < numInstances; ++i) {
+    HashValue(key, instanceKeys[i]);
+  }
+
+  return key;
+}
+
+string NeighborCache::KeyFilename(uint64_t key) const {
+  ostringstream filename;
+  filename << directory << "/neighbors-" << hex << setw(16) << setfill('0')
+          << key << ".ecnn";
+  return filename.str();
+}
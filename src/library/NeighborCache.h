@@ -0,0 +1,128 @@
+/**
+ * \class NeighborCache
+ *
+ * \brief On-disk cache of nearest neighbor searches between runs.
+ *
+ * Runs on the same data with different EC or Random Jungle settings search
+ * the same nearest neighbors before their first scores. NeighborCache saves
+ * each search's neighbor lists in a cache directory, one file per search,
+ * named by a 64-bit FNV-1a hash of everything the neighbors depend on: the
+ * active instances, their IDs and phenotypes, the active genotypes and
+ * numerics with the numeric ranges, the distance metrics, the query
+ * instances, k and the neighbor search. A later search with the same key
+ * maps the file and sets the neighbors from it instead of computing any
+ * distances.
+ *
+ * A cache file is a NeighborCacheFileHeader followed by one
+ * NeighborCacheRecord per neighbor, query by query: its hits, or neighbors
+ * for continuous phenotypes, then its misses class by class, nearest first.
+ * Files are written to a temporary name and renamed, so concurrent runs never
+ * see a partial file. A file that does not match its key in every field of
+ * the header, or whose records do not fit the data set, is a miss.
+ *
+ * \sa ReliefF, PairwiseDistances, ApproximateNeighbors
+ */
+
+#ifndef NEIGHBORCACHE_H
+#define	NEIGHBORCACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class Dataset;
+
+/// start of a neighbor cache file
+struct NeighborCacheFileHeader
+{
+  /// "ECNBRCCH"
+  char magic[8];
+  /// NEIGHBOR_CACHE_BYTE_ORDER as written; anything else is foreign
+  uint32_t byteOrder;
+  /// NEIGHBOR_CACHE_VERSION
+  uint32_t version;
+  /// content hash the file is named by
+  uint64_t key;
+  /// k nearest neighbors
+  uint32_t k;
+  /// 1: hits and misses; 0: neighbors of continuous phenotypes
+  uint32_t byClass;
+  /// number of candidate and query instances
+  uint32_t numInstances;
+  uint32_t numQueries;
+  /// records, starting right after the header
+  uint64_t numRecords;
+};
+
+/// one neighbor of one query instance
+struct NeighborCacheRecord
+{
+  /// data set indices of the query and the neighbor
+  uint32_t queryIndex;
+  uint32_t neighborIndex;
+  /// 1: a miss of class missClass; 0: a hit or neighbor
+  int32_t isMiss;
+  int32_t missClass;
+};
+
+const static uint32_t NEIGHBOR_CACHE_BYTE_ORDER = 0x01020304;
+const static uint32_t NEIGHBOR_CACHE_VERSION = 1;
+
+class NeighborCache
+{
+public:
+  /*************************************************************************//**
+   * Construct a disabled cache for a data set.
+   * \param [in] ds data set whose neighbors are cached
+   ****************************************************************************/
+  NeighborCache(Dataset* ds);
+  /*************************************************************************//**
+   * Cache neighbors in a directory, which must exist; "" disables the cache.
+   * \param [in] newDirectory cache directory
+   * \return success
+   ****************************************************************************/
+  bool SetDirectory(std::string newDirectory);
+  bool IsEnabled() const { return directory != ""; }
+  /*************************************************************************//**
+   * Set the query instances' neighbors from a cached search with the same
+   * key, if there is one.
+   * \param [in] instanceIndices data set indices of the candidate instances
+   * \param [in] queryIndices data set indices of the query instances
+   * \param [in] k number of nearest neighbors
+   * \param [in] search name and settings of the neighbor search
+   * \return true if the neighbors were set from the cache
+   ****************************************************************************/
+  bool Load(const std::vector<unsigned int>& instanceIndices,
+            const std::vector<unsigned int>& queryIndices, unsigned int k,
+            std::string search);
+  /*************************************************************************//**
+   * Save the query instances' current neighbors under the search's key.
+   * \param [in] instanceIndices data set indices of the candidate instances
+   * \param [in] queryIndices data set indices of the query instances
+   * \param [in] k number of nearest neighbors
+   * \param [in] search name and settings of the neighbor search
+   * \return success
+   ****************************************************************************/
+  bool Save(const std::vector<unsigned int>& instanceIndices,
+            const std::vector<unsigned int>& queryIndices, unsigned int k,
+            std::string search);
+private:
+  /*************************************************************************//**
+   * Content hash of everything a search's neighbors depend on.
+   * \param [in] instanceIndices data set indices of the candidate instances
+   * \param [in] queryIndices data set indices of the query instances
+   * \param [in] k number of nearest neighbors
+   * \param [in] search name and settings of the neighbor search
+   * \return 64-bit key
+   ****************************************************************************/
+  uint64_t ComputeKey(const std::vector<unsigned int>& instanceIndices,
+                      const std::vector<unsigned int>& queryIndices,
+                      unsigned int k, std::string search);
+  /// Cache file of a key.
+  std::string KeyFilename(uint64_t key) const;
+
+  Dataset* dataset;
+  std::string directory;
+};
+
+#endif	/* NEIGHBORCACHE_H */
@@ -0,0 +1,80 @@
+/**
+ * \file NeighborSelections.h
+ *
+ * \brief Bounded per-instance, per-class nearest neighbor selections.
+ *
+ * The nearest neighbor searches of PairwiseDistances and
+ * ApproximateNeighbors offer (distance, instance index) candidates to one
+ * NeighborSelections per query instance: the nearest hits, and the nearest
+ * misses of each other class, or just the nearest neighbors for continuous
+ * phenotypes. Candidates offered in the same order give the same neighbors.
+ */
+
+#ifndef NEIGHBORSELECTIONS_H
+#define	NEIGHBORSELECTIONS_H
+
+#include <map>
+#include <utility>
+
+#include "BestN.h"
+#include "Insilico.h"
+#include "DatasetInstance.h"
+
+/// orders neighbor candidates by distance only, like best_n in DatasetInstance
+class DistancePairLess
+{
+public:
+  bool operator()(const DistancePair& a, const DistancePair& b) const {
+    return a.first < b.first;
+  }
+};
+
+typedef insilico::best_n_selector<DistancePair, DistancePairLess>
+  NeighborSelector;
+
+/// the nearest neighbors found so far for one instance
+struct NeighborSelections
+{
+  NeighborSelections(unsigned int k) : hits(k) {}
+  /// same class, or all instances for continuous phenotypes
+  NeighborSelector hits;
+  /// each other class
+  std::map<ClassLevel, NeighborSelector> misses;
+};
+
+/// Offer a neighbor candidate to an instance's selections.
+inline void OfferNeighbor(NeighborSelections& selections, unsigned int k,
+                          bool byClass, ClassLevel thisClass,
+                          ClassLevel otherClass,
+                          const DistancePair& candidate) {
+  if(!byClass || (otherClass == thisClass)) {
+    selections.hits.push(candidate);
+    return;
+  }
+  std::map<ClassLevel, NeighborSelector>::iterator missPos =
+    selections.misses.find(otherClass);
+  if(missPos == selections.misses.end()) {
+    missPos = selections.misses.insert(
+      std::make_pair(otherClass, NeighborSelector(k))).first;
+  }
+  missPos->second.push(candidate);
+}
+
+/// Set an instance's nearest neighbors from its selections.
+inline void SetInstanceNeighbors(DatasetInstance* dsi,
+                                 const NeighborSelections& selections,
+                                 bool byClass) {
+  if(byClass) {
+    std::map<ClassLevel, DistancePairs> nearestMisses;
+    std::map<ClassLevel, NeighborSelector>::const_iterator missIt =
+      selections.misses.begin();
+    for(; missIt != selections.misses.end(); ++missIt) {
+      nearestMisses[missIt->first] = missIt->second.values();
+    }
+    dsi->SetNearestNeighbors(selections.hits.values(), nearestMisses);
+  } else {
+    dsi->SetNearestNeighbors(selections.hits.values());
+  }
+}
+
+#endif	/* NEIGHBORSELECTIONS_H */
@@ -0,0 +1,338 @@
+/*
+ * NumericsMatrix.cpp
+ *
+ * Contiguous numerics matrix with vectorized Manhattan distance kernels
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <climits>
+
+#include "NumericsMatrix.h"
+#include "DatasetInstance.h"
+#include "Insilico.h"
+
+// the AVX2 and AVX-512 kernels need per-function target attributes and
+// runtime CPU checks
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 5) \
+  && (defined(__x86_64__) || defined(__i386__))
+#define NUMERICS_MATRIX_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+/// row alignment in bytes: one AVX-512 register
+static const size_t NUMERICS_ALIGNMENT = 64;
+
+/// distance contributed by one numeric, including the Weka missing value
+/// rules: a missing value's penalty is 1.0, so two missing values give 1.0
+/// and one gives the other value's penalty
+static inline double ManhattanTerm(double value1, double value2,
+                                   double penalty1, double penalty2,
+                                   double invRange) {
+  if(value1 == MISSING_NUMERIC_VALUE) {
+    return penalty2;
+  }
+  if(value2 == MISSING_NUMERIC_VALUE) {
+    return penalty1;
+  }
+  return fabs(value1 - value2) * invRange;
+}
+
+/// add the accumulator lanes in the order every kernel shares
+static inline double ReduceLanes(double* laneSums) {
+  for(unsigned int width = NumericsMatrix::NUMERIC_LANES / 2; width > 0;
+      width /= 2) {
+    for(unsigned int lane = 0; lane < width; ++lane) {
+      laneSums[lane] += laneSums[lane + width];
+    }
+  }
+  return laneSums[0];
+}
+
+static double ManhattanScalar(const double* row1, const double* row2,
+                              const double* penalties1,
+                              const double* penalties2,
+                              const double* invRanges,
+                              const char* blockMissing1,
+                              const char* blockMissing2, size_t length) {
+  double laneSums[NumericsMatrix::NUMERIC_LANES] = {0};
+  for(size_t j = 0, block = 0; j < length;
+      j += NumericsMatrix::NUMERIC_LANES, ++block) {
+    if(blockMissing1[block] | blockMissing2[block]) {
+      for(unsigned int lane = 0; lane < NumericsMatrix::NUMERIC_LANES; ++lane) {
+        size_t k = j + lane;
+        laneSums[lane] += ManhattanTerm(row1[k], row2[k], penalties1[k],
+                                        penalties2[k], invRanges[k]);
+      }
+    } else {
+      for(unsigned int lane = 0; lane < NumericsMatrix::NUMERIC_LANES; ++lane) {
+        size_t k = j + lane;
+        laneSums[lane] += fabs(row1[k] - row2[k]) * invRanges[k];
+      }
+    }
+  }
+  return ReduceLanes(laneSums);
+}
+
+#ifdef NUMERICS_MATRIX_X86_KERNELS
+
+__attribute__((target("avx2")))
+static inline __m256d ManhattanTermsAVX2(const double* row1,
+                                         const double* row2,
+                                         const double* penalties1,
+                                         const double* penalties2,
+                                         const double* invRanges,
+                                         bool anyMissing) {
+  __m256d value1 = _mm256_load_pd(row1);
+  __m256d value2 = _mm256_load_pd(row2);
+  __m256d absDiff = _mm256_andnot_pd(_mm256_set1_pd(-0.0),
+                                     _mm256_sub_pd(value1, value2));
+  __m256d terms = _mm256_mul_pd(absDiff, _mm256_load_pd(invRanges));
+  if(!anyMissing) {
+    return terms;
+  }
+  __m256d missingValue = _mm256_set1_pd(MISSING_NUMERIC_VALUE);
+  __m256d missing1 = _mm256_cmp_pd(value1, missingValue, _CMP_EQ_OQ);
+  __m256d missing2 = _mm256_cmp_pd(value2, missingValue, _CMP_EQ_OQ);
+  terms = _mm256_blendv_pd(terms, _mm256_load_pd(penalties1), missing2);
+  return _mm256_blendv_pd(terms, _mm256_load_pd(penalties2), missing1);
+}
+
+__attribute__((target("avx2")))
+static double ManhattanAVX2(const double* row1, const double* row2,
+                            const double* penalties1, const double* penalties2,
+                            const double* invRanges,
+                            const char* blockMissing1,
+                            const char* blockMissing2, size_t length) {
+  // four registers of four lanes each
+  __m256d laneSums[4];
+  for(unsigned int r = 0; r < 4; ++r) {
+    laneSums[r] = _mm256_setzero_pd();
+  }
+  for(size_t j = 0, block = 0; j < length;
+      j += NumericsMatrix::NUMERIC_LANES, ++block) {
+    bool anyMissing = blockMissing1[block] | blockMissing2[block];
+    for(unsigned int r = 0; r < 4; ++r) {
+      size_t k = j + (r * 4);
+      laneSums[r] = _mm256_add_pd(laneSums[r],
+        ManhattanTermsAVX2(row1 + k, row2 + k, penalties1 + k, penalties2 + k,
+                           invRanges + k, anyMissing));
+    }
+  }
+  double lanes[NumericsMatrix::NUMERIC_LANES];
+  for(unsigned int r = 0; r < 4; ++r) {
+    _mm256_storeu_pd(lanes + (r * 4), laneSums[r]);
+  }
+  return ReduceLanes(lanes);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d ManhattanTermsAVX512(const double* row1,
+                                           const double* row2,
+                                           const double* penalties1,
+                                           const double* penalties2,
+                                           const double* invRanges,
+                                           bool anyMissing) {
+  __m512d value1 = _mm512_load_pd(row1);
+  __m512d value2 = _mm512_load_pd(row2);
+  __m512d terms = _mm512_mul_pd(_mm512_abs_pd(_mm512_sub_pd(value1, value2)),
+                                _mm512_load_pd(invRanges));
+  if(!anyMissing) {
+    return terms;
+  }
+  __m512d missingValue = _mm512_set1_pd(MISSING_NUMERIC_VALUE);
+  __mmask8 missing1 = _mm512_cmp_pd_mask(value1, missingValue, _CMP_EQ_OQ);
+  __mmask8 missing2 = _mm512_cmp_pd_mask(value2, missingValue, _CMP_EQ_OQ);
+  terms = _mm512_mask_blend_pd(missing2, terms, _mm512_load_pd(penalties1));
+  return _mm512_mask_blend_pd(missing1, terms, _mm512_load_pd(penalties2));
+}
+
+__attribute__((target("avx512f")))
+static double ManhattanAVX512(const double* row1, const double* row2,
+                              const double* penalties1,
+                              const double* penalties2,
+                              const double* invRanges,
+                              const char* blockMissing1,
+                              const char* blockMissing2, size_t length) {
+  // two registers of eight lanes each
+  __m512d laneSums[2];
+  for(unsigned int r = 0; r < 2; ++r) {
+    laneSums[r] = _mm512_setzero_pd();
+  }
+  for(size_t j = 0, block = 0; j < length;
+      j += NumericsMatrix::NUMERIC_LANES, ++block) {
+    bool anyMissing = blockMissing1[block] | blockMissing2[block];
+    for(unsigned int r = 0; r < 2; ++r) {
+      size_t k = j + (r * 8);
+      laneSums[r] = _mm512_add_pd(laneSums[r],
+        ManhattanTermsAVX512(row1 + k, row2 + k, penalties1 + k,
+                             penalties2 + k, invRanges + k, anyMissing));
+    }
+  }
+  double lanes[NumericsMatrix::NUMERIC_LANES];
+  for(unsigned int r = 0; r < 2; ++r) {
+    _mm512_storeu_pd(lanes + (r * 8), laneSums[r]);
+  }
+  return ReduceLanes(lanes);
+}
+
+#endif
+
+NumericsMatrix::NumericsMatrix() {
+  built = false;
+  numInstances = 0;
+  numNumerics = 0;
+  blocksPerRow = 0;
+  rowStride = 0;
+  alignOffset = 0;
+  kernel = BestKernel();
+}
+
+bool NumericsMatrix::Build(const vector<DatasetInstance*>& instances,
+                           const vector<unsigned int>& numericIndices,
+                           const vector<pair<double, double> >& numericsMinMax) {
+  Clear();
+  for(unsigned int i = 0; i < numericIndices.size(); ++i) {
+    if(numericIndices[i] >= numericsMinMax.size()) {
+      cerr << "ERROR: NumericsMatrix::Build: no min/max for numeric index "
+              << numericIndices[i] << endl;
+      return false;
+    }
+  }
+  numInstances = instances.size();
+  numNumerics = numericIndices.size();
+  blocksPerRow = (numNumerics + NUMERIC_LANES - 1) / NUMERIC_LANES;
+  rowStride = blocksPerRow * NUMERIC_LANES;
+  // padding columns stay zero: no distance and no missing values
+  size_t alignDoubles = NUMERICS_ALIGNMENT / sizeof(double);
+  storage.assign(((NUM_PARAMETER_ROWS + (2 * (size_t) numInstances)) *
+                  rowStride) + alignDoubles, 0.0);
+  size_t misalignment =
+    (size_t) &storage[0] % NUMERICS_ALIGNMENT / sizeof(double);
+  alignOffset = misalignment ? (alignDoubles - misalignment) : 0;
+
+  double* invRanges = StorageRow(INV_RANGE_ROW);
+  vector<double> minimums(numNumerics);
+  vector<double> normScales(numNumerics);
+  for(unsigned int i = 0; i < numNumerics; ++i) {
+    pair<double, double> minMax = numericsMinMax[numericIndices[i]];
+    double range = minMax.second - minMax.first;
+    invRanges[i] = 1.0 / range;
+    minimums[i] = minMax.first;
+    // norm() maps every value of a constant numeric to zero
+    normScales[i] = (minMax.first == minMax.second) ? 0.0 : invRanges[i];
+  }
+
+  blockHasMissing.assign((size_t) numInstances * blocksPerRow, 0);
+#pragma omp parallel for
+  for(int instanceIndex = 0; instanceIndex < (int) numInstances;
+      ++instanceIndex) {
+    DatasetInstance* dsi = instances[instanceIndex];
+    double* row = StorageRow(NUM_PARAMETER_ROWS + instanceIndex);
+    double* penalties = StorageRow(PenaltyRow(instanceIndex));
+    char* blockMissing = &blockHasMissing[instanceIndex * blocksPerRow];
+    for(unsigned int i = 0; i < numNumerics; ++i) {
+      row[i] = dsi->numerics[numericIndices[i]];
+      if(row[i] == MISSING_NUMERIC_VALUE) {
+        penalties[i] = 1.0;
+        blockMissing[i / NUMERIC_LANES] = 1;
+      } else {
+        // CheckMissingNumeric against a missing value in the other instance
+        double normed = (row[i] - minimums[i]) * normScales[i];
+        penalties[i] = (normed < 0.5) ? (1.0 - normed) : normed;
+      }
+    }
+  }
+  built = true;
+
+  return true;
+}
+
+void NumericsMatrix::Clear() {
+  vector<double>().swap(storage);
+  vector<char>().swap(blockHasMissing);
+  built = false;
+  numInstances = 0;
+  numNumerics = 0;
+  blocksPerRow = 0;
+  rowStride = 0;
+  alignOffset = 0;
+}
+
+double NumericsMatrix::DistanceManhattan(unsigned int instanceIndex1,
+                                         unsigned int instanceIndex2) const {
+  const double* row1 = StorageRow(NUM_PARAMETER_ROWS + instanceIndex1);
+  const double* row2 = StorageRow(NUM_PARAMETER_ROWS + instanceIndex2);
+  const double* penalties1 = StorageRow(PenaltyRow(instanceIndex1));
+  const double* penalties2 = StorageRow(PenaltyRow(instanceIndex2));
+  const double* invRanges = StorageRow(INV_RANGE_ROW);
+  const char* blockMissing1 = &blockHasMissing[instanceIndex1 * blocksPerRow];
+  const char* blockMissing2 = &blockHasMissing[instanceIndex2 * blocksPerRow];
+  switch(kernel) {
+#ifdef NUMERICS_MATRIX_X86_KERNELS
+    case AVX512_KERNEL:
+      return ManhattanAVX512(row1, row2, penalties1, penalties2, invRanges,
+                             blockMissing1, blockMissing2, rowStride);
+    case AVX2_KERNEL:
+      return ManhattanAVX2(row1, row2, penalties1, penalties2, invRanges,
+                           blockMissing1, blockMissing2, rowStride);
+#endif
+    default:
+      return ManhattanScalar(row1, row2, penalties1, penalties2, invRanges,
+                             blockMissing1, blockMissing2, rowStride);
+  }
+}
+
+bool NumericsMatrix::SetKernel(KernelType newKernel) {
+  if(!IsKernelSupported(newKernel)) {
+    cerr << "ERROR: NumericsMatrix::SetKernel: " << KernelName(newKernel)
+            << " is not supported on this system" << endl;
+    return false;
+  }
+  kernel = newKernel;
+
+  return true;
+}
+
+NumericsMatrix::KernelType NumericsMatrix::BestKernel() {
+  if(IsKernelSupported(AVX512_KERNEL)) {
+    return AVX512_KERNEL;
+  }
+  if(IsKernelSupported(AVX2_KERNEL)) {
+    return AVX2_KERNEL;
+  }
+  return SCALAR_KERNEL;
+}
+
+bool NumericsMatrix::IsKernelSupported(KernelType kernelType) {
+  switch(kernelType) {
+    case SCALAR_KERNEL:
+      return true;
+#ifdef NUMERICS_MATRIX_X86_KERNELS
+    case AVX2_KERNEL:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+    case AVX512_KERNEL:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return false;
+  }
+}
+
+string NumericsMatrix::KernelName(KernelType kernelType) {
+  switch(kernelType) {
+    case SCALAR_KERNEL:
+      return "scalar";
+    case AVX2_KERNEL:
+      return "AVX2";
+    case AVX512_KERNEL:
+      return "AVX-512";
+  }
+  return "unknown";
+}
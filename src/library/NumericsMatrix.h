@@ -0,0 +1,123 @@
+/**
+ * \class NumericsMatrix
+ *
+ * \brief Contiguous instance-major numerics for fast Manhattan distances.
+ *
+ * Holds the selected numeric attributes of every instance as one row of
+ * doubles per instance, aligned and zero padded to whole blocks of
+ * NUMERIC_LANES values. Each column also keeps the reciprocal of its range,
+ * so a pair distance is one pass over two rows. Every value's Weka penalty
+ * against a missing value is precomputed in a second row per instance, and
+ * every block of a row records whether it holds a missing value: blocks
+ * where neither row has one skip the missing value blends.
+ *
+ * The pass runs on the widest kernel the CPU supports: AVX-512, AVX2 or
+ * scalar. Every kernel sums column j into accumulator lane j % NUMERIC_LANES
+ * and adds the lanes in the same fixed order, so the distances do not depend
+ * on the kernel. They match diffManhattan summed over the attributes up to
+ * floating point rounding.
+ *
+ * \sa DistanceMetrics, Dataset
+ */
+
+#ifndef NUMERICSMATRIX_H
+#define	NUMERICSMATRIX_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <cstddef>
+
+class DatasetInstance;
+
+class NumericsMatrix
+{
+public:
+  /// instruction sets of the distance kernels
+  enum KernelType {
+    SCALAR_KERNEL,
+    AVX2_KERNEL,
+    AVX512_KERNEL
+  };
+
+  NumericsMatrix();
+  /*************************************************************************//**
+   * Copy the instances' numeric attributes into the matrix.
+   * \param [in] instances instances in data set order; rows are their indices
+   * \param [in] numericIndices numerics to include, in distance order
+   * \param [in] numericsMinMax (min, max) of every numeric, by numeric index
+   * \return success
+   ****************************************************************************/
+  bool Build(const std::vector<DatasetInstance*>& instances,
+             const std::vector<unsigned int>& numericIndices,
+             const std::vector<std::pair<double, double> >& numericsMinMax);
+  /// Release the matrix.
+  void Clear();
+  /// Has the matrix been built?
+  bool IsBuilt() const { return built; }
+  /// Number of instances (rows).
+  unsigned int NumInstances() const { return numInstances; }
+  /// Number of numerics in each row.
+  unsigned int NumNumerics() const { return numNumerics; }
+  /*************************************************************************//**
+   * Manhattan distance between two instances: diffManhattan summed over the
+   * numerics, including the Weka missing value rules of CheckMissingNumeric.
+   * \param [in] instanceIndex1 instance index 1
+   * \param [in] instanceIndex2 instance index 2
+   * \return distance
+   ****************************************************************************/
+  double DistanceManhattan(unsigned int instanceIndex1,
+                           unsigned int instanceIndex2) const;
+  /// Kernel used for distances.
+  KernelType GetKernel() const { return kernel; }
+  /*************************************************************************//**
+   * Use a specific kernel, e.g. to benchmark the kernels against each other.
+   * \param [in] newKernel kernel instruction set
+   * \return false if the CPU or compiler does not support the kernel
+   ****************************************************************************/
+  bool SetKernel(KernelType newKernel);
+  /// Widest kernel supported by this CPU and compiler.
+  static KernelType BestKernel();
+  /// Is the kernel supported by this CPU and compiler?
+  static bool IsKernelSupported(KernelType kernelType);
+  /// Name of a kernel for messages.
+  static std::string KernelName(KernelType kernelType);
+
+  /// columns per block: the row padding and the number of accumulator lanes
+  static const unsigned int NUMERIC_LANES = 16;
+private:
+  /// column parameter rows stored ahead of the instance rows
+  enum ParameterRow {
+    INV_RANGE_ROW,
+    NUM_PARAMETER_ROWS
+  };
+  /// Storage row of an instance's missing value penalties.
+  std::size_t PenaltyRow(unsigned int instanceIndex) const {
+    return NUM_PARAMETER_ROWS + numInstances + instanceIndex;
+  }
+  /// Start of a parameter or instance row in the aligned storage.
+  const double* StorageRow(std::size_t row) const {
+    return &storage[alignOffset + (row * rowStride)];
+  }
+  double* StorageRow(std::size_t row) {
+    return &storage[alignOffset + (row * rowStride)];
+  }
+
+  bool built;
+  unsigned int numInstances;
+  unsigned int numNumerics;
+  /// blocks of NUMERIC_LANES numerics per row
+  std::size_t blocksPerRow;
+  /// doubles per row: numNumerics rounded up to whole blocks
+  std::size_t rowStride;
+  /// first aligned element of storage
+  std::size_t alignOffset;
+  /// parameter rows, one row of values per instance, then one row of
+  /// missing value penalties per instance: 1.0 for a missing value
+  std::vector<double> storage;
+  /// does the block of the instance row hold any missing values?
+  std::vector<char> blockHasMissing;
+  KernelType kernel;
+};
+
+#endif	/* NUMERICSMATRIX_H */
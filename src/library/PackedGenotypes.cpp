@@ -0,0 +1,134 @@
+/*
+ * PackedGenotypes.cpp
+ *
+ * SNP-major, 2-bit packed genotype matrix with a missing value plane
+ */
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "PackedGenotypes.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// round a number of words up to a whole number of aligned blocks
+static size_t PadWordsToAlignment(size_t numWords) {
+  size_t wordsPerBlock = PACKED_COLUMN_ALIGNMENT / sizeof(PackedWord);
+  return ((numWords + wordsPerBlock - 1) / wordsPerBlock) * wordsPerBlock;
+}
+
+PackedGenotypes::PackedGenotypes() {
+  numAttributes = 0;
+  numInstances = 0;
+  wordsPerAttribute = 0;
+  missingWordsPerAttribute = 0;
+  genotypeWords = 0;
+  missingWords = 0;
+}
+
+PackedGenotypes::~PackedGenotypes() {
+  Clear();
+}
+
+bool PackedGenotypes::Allocate(unsigned int numAttributesIn,
+                               unsigned int numInstancesIn) {
+  Clear();
+  size_t genotypeWordsNeeded =
+    (numInstancesIn + GENOTYPES_PER_WORD - 1) / GENOTYPES_PER_WORD;
+  size_t missingWordsNeeded =
+    (numInstancesIn + MISSING_FLAGS_PER_WORD - 1) / MISSING_FLAGS_PER_WORD;
+  wordsPerAttribute = PadWordsToAlignment(genotypeWordsNeeded);
+  missingWordsPerAttribute = PadWordsToAlignment(missingWordsNeeded);
+  size_t genotypeBytes =
+    wordsPerAttribute * numAttributesIn * sizeof(PackedWord);
+  size_t missingBytes =
+    missingWordsPerAttribute * numAttributesIn * sizeof(PackedWord);
+  void* genotypeMemory = 0;
+  void* missingMemory = 0;
+  if(posix_memalign(&genotypeMemory, PACKED_COLUMN_ALIGNMENT,
+                    genotypeBytes ? genotypeBytes : PACKED_COLUMN_ALIGNMENT)) {
+    cerr << "ERROR: PackedGenotypes::Allocate could not allocate "
+            << genotypeBytes << " bytes for genotypes" << endl;
+    return false;
+  }
+  if(posix_memalign(&missingMemory, PACKED_COLUMN_ALIGNMENT,
+                    missingBytes ? missingBytes : PACKED_COLUMN_ALIGNMENT)) {
+    cerr << "ERROR: PackedGenotypes::Allocate could not allocate "
+            << missingBytes << " bytes for missing values" << endl;
+    free(genotypeMemory);
+    return false;
+  }
+  genotypeWords = static_cast<PackedWord*>(genotypeMemory);
+  missingWords = static_cast<PackedWord*>(missingMemory);
+  numAttributes = numAttributesIn;
+  numInstances = numInstancesIn;
+
+  // everything starts out missing; padding bits stay zero in both planes
+  memset(genotypeWords, 0, genotypeBytes);
+  memset(missingWords, 0, missingBytes);
+  for(unsigned int attributeIndex = 0; attributeIndex < numAttributes;
+      ++attributeIndex) {
+    PackedWord* missingColumn =
+      missingWords + (attributeIndex * missingWordsPerAttribute);
+    for(unsigned int instanceIndex = 0; instanceIndex < numInstances;
+        instanceIndex += MISSING_FLAGS_PER_WORD) {
+      unsigned int flagsInWord = numInstances - instanceIndex;
+      missingColumn[instanceIndex / MISSING_FLAGS_PER_WORD] =
+        (flagsInWord >= MISSING_FLAGS_PER_WORD) ?
+          ~((PackedWord) 0) : ((((PackedWord) 1) << flagsInWord) - 1);
+    }
+  }
+
+  return true;
+}
+
+void PackedGenotypes::Clear() {
+  if(genotypeWords) {
+    free(genotypeWords);
+  }
+  if(missingWords) {
+    free(missingWords);
+  }
+  genotypeWords = 0;
+  missingWords = 0;
+  numAttributes = 0;
+  numInstances = 0;
+  wordsPerAttribute = 0;
+  missingWordsPerAttribute = 0;
+}
+
+size_t PackedGenotypes::NumBytes() const {
+  return (wordsPerAttribute + missingWordsPerAttribute) * numAttributes *
+    sizeof(PackedWord);
+}
+
+void PackedGenotypes::Set(unsigned int attributeIndex,
+                          unsigned int instanceIndex, AttributeLevel level) {
+  PackedWord* genotypeWord = genotypeWords +
+    (attributeIndex * wordsPerAttribute) + (instanceIndex / GENOTYPES_PER_WORD);
+  PackedWord* missingWord = missingWords +
+    (attributeIndex * missingWordsPerAttribute) +
+    (instanceIndex / MISSING_FLAGS_PER_WORD);
+  unsigned int genotypeShift = 2 * (instanceIndex % GENOTYPES_PER_WORD);
+  PackedWord missingBit =
+    ((PackedWord) 1) << (instanceIndex % MISSING_FLAGS_PER_WORD);
+  *genotypeWord &= ~(((PackedWord) 3) << genotypeShift);
+  if(level == MISSING_ATTRIBUTE_VALUE) {
+    *missingWord |= missingBit;
+  } else {
+    *genotypeWord |= ((PackedWord) (level & 3)) << genotypeShift;
+    *missingWord &= ~missingBit;
+  }
+}
+
+void PackedGenotypes::GetAttributeValues(unsigned int attributeIndex,
+  const vector<unsigned int>& instanceIndices,
+  vector<AttributeLevel>& attributeValues) const {
+  attributeValues.resize(instanceIndices.size());
+  for(unsigned int i = 0; i < instanceIndices.size(); ++i) {
+    attributeValues[i] = Get(attributeIndex, instanceIndices[i]);
+  }
+}
@@ -0,0 +1,122 @@
+/**
+ * \class PackedGenotypes
+ *
+ * \brief SNP-major, 2-bit packed genotype matrix.
+ *
+ * Holds the discrete (SNP) attribute levels 0/1/2 of every instance in two
+ * bits each, one attribute (column) after the other, with a separate one bit
+ * per genotype missing value plane. Each column starts on a cache line
+ * boundary so per-attribute scans read contiguous, aligned memory. Missing
+ * genotypes are stored as level 0 in the genotype plane and flagged in the
+ * missing plane.
+ *
+ * \sa Dataset
+ */
+
+#ifndef PACKEDGENOTYPES_H
+#define	PACKEDGENOTYPES_H
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <climits>
+
+#include "Insilico.h"
+
+/// packed genotype storage word
+typedef uint64_t PackedWord;
+
+/// genotypes per packed genotype word
+const unsigned int GENOTYPES_PER_WORD = 32;
+/// missing flags per packed missing value word
+const unsigned int MISSING_FLAGS_PER_WORD = 64;
+/// columns are padded and aligned to this many bytes
+const unsigned int PACKED_COLUMN_ALIGNMENT = 64;
+
+class PackedGenotypes
+{
+public:
+  PackedGenotypes();
+  ~PackedGenotypes();
+  /*************************************************************************//**
+   * Allocate an aligned matrix of all-missing genotypes.
+   * \param [in] numAttributes number of attributes (columns)
+   * \param [in] numInstances number of instances (rows)
+   * \return success
+   ****************************************************************************/
+  bool Allocate(unsigned int numAttributes, unsigned int numInstances);
+  /// Release the matrix memory.
+  void Clear();
+  /// Has the matrix been allocated?
+  bool IsAllocated() const { return genotypeWords != 0; }
+  /// Number of attributes (columns) in the matrix.
+  unsigned int NumAttributes() const { return numAttributes; }
+  /// Number of instances (rows) in the matrix.
+  unsigned int NumInstances() const { return numInstances; }
+  /// Number of genotype plane words in each attribute column.
+  std::size_t WordsPerAttribute() const { return wordsPerAttribute; }
+  /// Number of missing value plane words in each attribute column.
+  std::size_t MissingWordsPerAttribute() const { return missingWordsPerAttribute; }
+  /// Total bytes allocated for both planes.
+  std::size_t NumBytes() const;
+  /*************************************************************************//**
+   * Get the attribute level of an instance. No bounds checking.
+   * \param [in] attributeIndex attribute (column) index
+   * \param [in] instanceIndex instance (row) index
+   * \return attribute level or MISSING_ATTRIBUTE_VALUE
+   ****************************************************************************/
+  AttributeLevel Get(unsigned int attributeIndex,
+                     unsigned int instanceIndex) const {
+    const PackedWord* missingColumn =
+      missingWords + (attributeIndex * missingWordsPerAttribute);
+    if((missingColumn[instanceIndex / MISSING_FLAGS_PER_WORD] >>
+        (instanceIndex % MISSING_FLAGS_PER_WORD)) & 1) {
+      return MISSING_ATTRIBUTE_VALUE;
+    }
+    const PackedWord* genotypeColumn =
+      genotypeWords + (attributeIndex * wordsPerAttribute);
+    return (AttributeLevel)
+      ((genotypeColumn[instanceIndex / GENOTYPES_PER_WORD] >>
+        (2 * (instanceIndex % GENOTYPES_PER_WORD))) & 3);
+  }
+  /*************************************************************************//**
+   * Set the attribute level of an instance. No bounds checking.
+   * \param [in] attributeIndex attribute (column) index
+   * \param [in] instanceIndex instance (row) index
+   * \param [in] level attribute level 0/1/2 or MISSING_ATTRIBUTE_VALUE
+   ****************************************************************************/
+  void Set(unsigned int attributeIndex, unsigned int instanceIndex,
+           AttributeLevel level);
+  /*************************************************************************//**
+   * Copy an attribute's values for the listed instances.
+   * \param [in] attributeIndex attribute (column) index
+   * \param [in] instanceIndices instance (row) indices to copy in order
+   * \param [out] attributeValues attribute levels
+   ****************************************************************************/
+  void GetAttributeValues(unsigned int attributeIndex,
+                          const std::vector<unsigned int>& instanceIndices,
+                          std::vector<AttributeLevel>& attributeValues) const;
+  /// Genotype plane words of an attribute column.
+  const PackedWord* GetGenotypeWords(unsigned int attributeIndex) const {
+    return genotypeWords + (attributeIndex * wordsPerAttribute);
+  }
+  /// Missing value plane words of an attribute column.
+  const PackedWord* GetMissingWords(unsigned int attributeIndex) const {
+    return missingWords + (attributeIndex * missingWordsPerAttribute);
+  }
+private:
+  /// not copyable
+  PackedGenotypes(const PackedGenotypes&);
+  PackedGenotypes& operator=(const PackedGenotypes&);
+
+  unsigned int numAttributes;
+  unsigned int numInstances;
+  std::size_t wordsPerAttribute;
+  std::size_t missingWordsPerAttribute;
+  /// 2-bit attribute levels, column-major
+  PackedWord* genotypeWords;
+  /// 1-bit missing value flags, column-major
+  PackedWord* missingWords;
+};
+
+#endif	/* PACKEDGENOTYPES_H */
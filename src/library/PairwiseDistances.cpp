@@ -0,0 +1,634 @@
+/*
+ * PairwiseDistances.cpp
+ *
+ * Cache-blocked, load-balanced all-pairs instance distances
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <climits>
+#include <unistd.h>
+#include <omp.h>
+
+#include "PairwiseDistances.h"
+#include "DistanceMatrix.h"
+#include "Dataset.h"
+#include "DatasetInstance.h"
+#include "NeighborSelections.h"
+#include "Insilico.h"
+
+using namespace std;
+
+/// L2 cache size assumed when the system does not report one
+static const size_t DEFAULT_L2_CACHE_BYTES = 256 * 1024;
+/// block size limits: small blocks waste the cache, large blocks balance badly
+static const unsigned int MIN_BLOCK_SIZE = 8;
+static const unsigned int MAX_BLOCK_SIZE = 512;
+/// blocks per thread to aim for, so late blocks even out the threads' work
+static const unsigned int BLOCKS_PER_THREAD = 4;
+/// most memory for one band of rows in the nearest neighbor search
+static const size_t MAX_BAND_BYTES = 64 * 1024 * 1024;
+/// most memory for the distances kept between nearest neighbor updates
+static const size_t MAX_KEPT_DISTANCES_BYTES = 1024 * 1024 * 1024;
+
+PairwiseDistances::PairwiseDistances(Dataset* ds) {
+  dataset = ds;
+  blockSize = 0;
+  blockSizeFixed = false;
+  keptAsCounts = false;
+  keptVersion = 0;
+}
+
+bool PairwiseDistances::ComputeDistanceMatrix(
+  const vector<unsigned int>& instanceIndices, DistanceMatrix& distanceMatrix) {
+  unsigned int numInstances = instanceIndices.size();
+  if(distanceMatrix.Size() != numInstances) {
+    cerr << "ERROR: PairwiseDistances: distance matrix of "
+            << distanceMatrix.Size() << " instances for " << numInstances
+            << " instances" << endl;
+    return false;
+  }
+  if(!PrepareBlocks(numInstances)) {
+    return false;
+  }
+
+  vector<pair<unsigned int, unsigned int> > blocks;
+  UpperTriangleBlocks(numInstances, blocks);
+  cout << Timestamp() << "Computing " << numInstances << " x "
+          << numInstances << " distances in " << blocks.size()
+          << " blocks of " << blockSize << " x " << blockSize << endl;
+
+  unsigned int blocksDone = 0;
+  unsigned int progressStep = (blocks.size() / 10) ? (blocks.size() / 10) : 1;
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int blockIndex = 0; blockIndex < (int) blocks.size(); ++blockIndex) {
+    unsigned int rowStart = blocks[blockIndex].first * blockSize;
+    unsigned int rowEnd = rowStart + blockSize;
+    if(rowEnd > numInstances) {
+      rowEnd = numInstances;
+    }
+    unsigned int colStart = blocks[blockIndex].second * blockSize;
+    unsigned int colEnd = colStart + blockSize;
+    if(colEnd > numInstances) {
+      colEnd = numInstances;
+    }
+    bool diagonal = (rowStart == colStart);
+    for(unsigned int i = rowStart; i < rowEnd; ++i) {
+      unsigned int dsi1Index = instanceIndices[i];
+      for(unsigned int j = diagonal ? (i + 1) : colStart; j < colEnd; ++j) {
+        distanceMatrix.Set(i, j,
+                           dataset->ComputeInstanceToInstanceDistance(
+                             dsi1Index, instanceIndices[j]));
+      }
+    }
+#pragma omp critical(PairwiseDistancesProgress)
+    {
+      ++blocksDone;
+      if((blocksDone % progressStep) == 0) {
+        cout << Timestamp() << blocksDone << "/" << blocks.size()
+                << " blocks" << endl;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool PairwiseDistances::ComputeNearestNeighbors(
+  const vector<unsigned int>& instanceIndices, unsigned int k) {
+  unsigned int numInstances = instanceIndices.size();
+  if(!PrepareBlocks(numInstances)) {
+    return false;
+  }
+  // one band of rows holds its distances to every instance
+  unsigned int bandSize = blockSize;
+  while((bandSize > 1) &&
+        ((size_t) bandSize * numInstances * sizeof(double) > MAX_BAND_BYTES)) {
+    bandSize /= 2;
+  }
+
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  vector<ClassLevel> classes(numInstances, 0);
+  if(byClass) {
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      classes[i] = dataset->GetInstance(instanceIndices[i])->GetClass();
+    }
+  }
+  vector<NeighborSelections> selections(numInstances, NeighborSelections(k));
+  vector<double> band((size_t) bandSize * numInstances);
+  cout << Timestamp() << "Finding " << k << " nearest neighbors of "
+          << numInstances << " instances in bands of " << bandSize
+          << " rows, blocks of " << blockSize << " x " << blockSize << endl;
+
+  unsigned int progressStep = (numInstances / 10) ? (numInstances / 10) : 1;
+  for(unsigned int bandStart = 0; bandStart < numInstances;
+      bandStart += bandSize) {
+    unsigned int bandEnd = bandStart + bandSize;
+    if(bandEnd > numInstances) {
+      bandEnd = numInstances;
+    }
+
+    // distances from the band's rows to every later instance, a block of
+    // columns at a time
+    unsigned int numColBlocks =
+      (numInstances - bandStart + blockSize - 1) / blockSize;
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int colBlock = 0; colBlock < (int) numColBlocks; ++colBlock) {
+      unsigned int colStart = bandStart + (colBlock * blockSize);
+      unsigned int colEnd = colStart + blockSize;
+      if(colEnd > numInstances) {
+        colEnd = numInstances;
+      }
+      for(unsigned int i = bandStart; i < bandEnd; ++i) {
+        double* bandRow = &band[(size_t) (i - bandStart) * numInstances];
+        unsigned int dsi1Index = instanceIndices[i];
+        for(unsigned int j = (colStart > i) ? colStart : (i + 1); j < colEnd;
+            ++j) {
+          bandRow[j] =
+            dataset->ComputeInstanceToInstanceDistance(dsi1Index,
+                                                       instanceIndices[j]);
+        }
+      }
+    }
+
+    // offer the band's distances to every instance from the band on, in
+    // full matrix row order: lower instances first, then higher ones
+#pragma omp parallel for schedule(dynamic, 16)
+    for(int target = bandStart; target < (int) numInstances; ++target) {
+      NeighborSelections& targetSelections = selections[target];
+      unsigned int lowerEnd = ((unsigned int) target < bandEnd) ?
+        target : bandEnd;
+      for(unsigned int i = bandStart; i < lowerEnd; ++i) {
+        OfferNeighbor(targetSelections, k, byClass, classes[target], classes[i],
+                      make_pair(band[(size_t) (i - bandStart) * numInstances +
+                                     target], instanceIndices[i]));
+      }
+      if((unsigned int) target < bandEnd) {
+        const double* bandRow =
+          &band[(size_t) (target - bandStart) * numInstances];
+        for(unsigned int j = target + 1; j < numInstances; ++j) {
+          OfferNeighbor(targetSelections, k, byClass, classes[target],
+                        classes[j], make_pair(bandRow[j], instanceIndices[j]));
+        }
+      }
+    }
+
+    if((bandEnd / progressStep) != (bandStart / progressStep)) {
+      cout << Timestamp() << bandEnd << "/" << numInstances << endl;
+    }
+  }
+
+#pragma omp parallel for
+  for(int i = 0; i < (int) numInstances; ++i) {
+    SetInstanceNeighbors(dataset->GetInstance(instanceIndices[i]),
+                         selections[i], byClass);
+  }
+
+  return true;
+}
+
+bool PairwiseDistances::ComputeNearestNeighbors(
+  const vector<unsigned int>& instanceIndices,
+  const vector<unsigned int>& queryIndices, unsigned int k) {
+  unsigned int numInstances = instanceIndices.size();
+  unsigned int numQueries = queryIndices.size();
+  if(!PrepareBlocks(numInstances)) {
+    return false;
+  }
+
+  // each query's position among the instances, to skip itself and to order
+  // its distances the way the full matrix does
+  map<unsigned int, unsigned int> instancePositions;
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    instancePositions[instanceIndices[i]] = i;
+  }
+  vector<unsigned int> queryPositions(numQueries);
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    map<unsigned int, unsigned int>::const_iterator positionIt =
+      instancePositions.find(queryIndices[q]);
+    if(positionIt == instancePositions.end()) {
+      cerr << "ERROR: PairwiseDistances: query instance " << queryIndices[q]
+              << " is not one of the instances" << endl;
+      return false;
+    }
+    queryPositions[q] = positionIt->second;
+  }
+
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  vector<ClassLevel> classes(numInstances, 0);
+  if(byClass) {
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      classes[i] = dataset->GetInstance(instanceIndices[i])->GetClass();
+    }
+  }
+  vector<NeighborSelections> selections(numQueries, NeighborSelections(k));
+
+  // groups of query rows, small enough to keep every thread busy; each group
+  // walks the columns a block at a time so the block is reused by every row
+  unsigned int groupSize = blockSize;
+  size_t minGroups = BLOCKS_PER_THREAD * omp_get_max_threads();
+  while((groupSize > 1) &&
+        (((numQueries + groupSize - 1) / groupSize) < minGroups)) {
+    groupSize /= 2;
+  }
+  unsigned int numGroups = (numQueries + groupSize - 1) / groupSize;
+  cout << Timestamp() << "Finding " << k << " nearest neighbors of "
+          << numQueries << " of " << numInstances << " instances in "
+          << numGroups << " groups of " << groupSize << " rows, blocks of "
+          << blockSize << " columns" << endl;
+
+  unsigned int groupsDone = 0;
+  unsigned int progressStep = (numGroups / 10) ? (numGroups / 10) : 1;
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int group = 0; group < (int) numGroups; ++group) {
+    unsigned int queryStart = group * groupSize;
+    unsigned int queryEnd = queryStart + groupSize;
+    if(queryEnd > numQueries) {
+      queryEnd = numQueries;
+    }
+    for(unsigned int colStart = 0; colStart < numInstances;
+        colStart += blockSize) {
+      unsigned int colEnd = colStart + blockSize;
+      if(colEnd > numInstances) {
+        colEnd = numInstances;
+      }
+      for(unsigned int q = queryStart; q < queryEnd; ++q) {
+        unsigned int position = queryPositions[q];
+        for(unsigned int j = colStart; j < colEnd; ++j) {
+          if(j == position) {
+            continue;
+          }
+          // lower position first, as the matrix's upper triangle computes it
+          double distance = (j < position) ?
+            dataset->ComputeInstanceToInstanceDistance(instanceIndices[j],
+                                                       queryIndices[q]) :
+            dataset->ComputeInstanceToInstanceDistance(queryIndices[q],
+                                                       instanceIndices[j]);
+          OfferNeighbor(selections[q], k, byClass, classes[position],
+                        classes[j], make_pair(distance, instanceIndices[j]));
+        }
+      }
+    }
+#pragma omp critical(PairwiseDistancesProgress)
+    {
+      ++groupsDone;
+      if((groupsDone % progressStep) == 0) {
+        cout << Timestamp() << groupsDone << "/" << numGroups << " groups"
+                << endl;
+      }
+    }
+  }
+
+#pragma omp parallel for
+  for(int q = 0; q < (int) numQueries; ++q) {
+    SetInstanceNeighbors(dataset->GetInstance(queryIndices[q]), selections[q],
+                         byClass);
+  }
+
+  return true;
+}
+
+bool PairwiseDistances::SelectNearestNeighbors(
+  const DistanceMatrix& distanceMatrix, const vector<unsigned int>& matrixRows,
+  const vector<unsigned int>& instanceIndices,
+  const vector<unsigned int>& queryIndices, unsigned int k) {
+  unsigned int numInstances = instanceIndices.size();
+  unsigned int numQueries = queryIndices.size();
+  vector<unsigned int> rows(numInstances);
+  for(unsigned int i = 0; i < numInstances; ++i) {
+    if((instanceIndices[i] >= matrixRows.size()) ||
+       (matrixRows[instanceIndices[i]] >= distanceMatrix.Size())) {
+      cerr << "ERROR: PairwiseDistances: instance " << instanceIndices[i]
+              << " is not in the distance matrix" << endl;
+      return false;
+    }
+    rows[i] = matrixRows[instanceIndices[i]];
+  }
+  for(unsigned int q = 0; q < numQueries; ++q) {
+    if((queryIndices[q] >= matrixRows.size()) ||
+       (matrixRows[queryIndices[q]] >= distanceMatrix.Size())) {
+      cerr << "ERROR: PairwiseDistances: query instance " << queryIndices[q]
+              << " is not in the distance matrix" << endl;
+      return false;
+    }
+  }
+
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  vector<ClassLevel> classes(numInstances, 0);
+  if(byClass) {
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      classes[i] = dataset->GetInstance(instanceIndices[i])->GetClass();
+    }
+  }
+  cout << Timestamp() << "Selecting " << k << " nearest neighbors of "
+          << numQueries << " of " << numInstances
+          << " instances from a distance matrix" << endl;
+
+#pragma omp parallel for schedule(dynamic, 16)
+  for(int q = 0; q < (int) numQueries; ++q) {
+    DatasetInstance* queryInstance = dataset->GetInstance(queryIndices[q]);
+    ClassLevel queryClass = byClass ? queryInstance->GetClass() : 0;
+    unsigned int queryRow = matrixRows[queryIndices[q]];
+    NeighborSelections selections(k);
+    for(unsigned int j = 0; j < numInstances; ++j) {
+      if(instanceIndices[j] == queryIndices[q]) {
+        continue;
+      }
+      OfferNeighbor(selections, k, byClass, queryClass, classes[j],
+                    make_pair(distanceMatrix.Get(queryRow, rows[j]),
+                              instanceIndices[j]));
+    }
+    SetInstanceNeighbors(queryInstance, selections, byClass);
+  }
+
+  return true;
+}
+
+bool PairwiseDistances::UpdateNearestNeighbors(
+  const vector<unsigned int>& instanceIndices, unsigned int k) {
+  size_t numInstances = instanceIndices.size();
+  size_t numPairs = (numInstances * (numInstances - 1)) / 2;
+  if(!CanKeepDistances(numInstances)) {
+    ClearDistances();
+    return ComputeNearestNeighbors(instanceIndices, k);
+  }
+
+  // what the distances sum over now
+  vector<unsigned int> attributes;
+  if(dataset->HasGenotypes()) {
+    attributes = dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
+    sort(attributes.begin(), attributes.end());
+  }
+  vector<unsigned int> numerics;
+  if(dataset->HasNumerics()) {
+    numerics = dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
+    sort(numerics.begin(), numerics.end());
+  }
+
+  // the kept distances can be updated if attributes were only removed
+  size_t numKept = keptAsCounts ? keptCounts.size() : keptDistances.size();
+  bool canUpdate = (numKept == numPairs) &&
+    (keptInstances == instanceIndices) &&
+    (keptVersion == dataset->GetDistanceVersion()) &&
+    includes(keptAttributes.begin(), keptAttributes.end(),
+             attributes.begin(), attributes.end()) &&
+    includes(keptNumerics.begin(), keptNumerics.end(),
+             numerics.begin(), numerics.end());
+  if(canUpdate) {
+    vector<unsigned int> removedAttributes;
+    set_difference(keptAttributes.begin(), keptAttributes.end(),
+                   attributes.begin(), attributes.end(),
+                   back_inserter(removedAttributes));
+    vector<unsigned int> removedNumerics;
+    set_difference(keptNumerics.begin(), keptNumerics.end(),
+                   numerics.begin(), numerics.end(),
+                   back_inserter(removedNumerics));
+    if(removedAttributes.size() || removedNumerics.size()) {
+      cout << Timestamp() << "Subtracting " << removedAttributes.size()
+              << " attributes and " << removedNumerics.size()
+              << " numerics from the kept distances" << endl;
+      if(!blockSizeFixed) {
+        blockSize = ChooseBlockSize(numInstances, true, true);
+      }
+      if(!dataset->PrepareDistanceContribution(removedAttributes,
+                                               removedNumerics)) {
+        return false;
+      }
+      UpdateKeptDistances(true);
+      // release the removed columns' bit planes and matrix
+      dataset->PrepareDistanceContribution(vector<unsigned int>(),
+                                           vector<unsigned int>());
+    }
+  } else {
+    if(!PrepareBlocks(numInstances)) {
+      return false;
+    }
+    keptInstances = instanceIndices;
+    keptAsCounts = dataset->HasDistanceCounts();
+    if(keptAsCounts) {
+      vector<double>().swap(keptDistances);
+      keptCounts.resize(numPairs);
+    } else {
+      vector<GenotypeBitPlanes::DistanceCounts>().swap(keptCounts);
+      keptDistances.assign(numPairs, 0.0);
+    }
+    cout << Timestamp() << "Computing " << numPairs
+            << " instance pair distances to keep" << endl;
+    UpdateKeptDistances(false);
+  }
+  keptAttributes = attributes;
+  keptNumerics = numerics;
+  keptVersion = dataset->GetDistanceVersion();
+
+  bool byClass = !dataset->HasContinuousPhenotypes();
+  vector<ClassLevel> classes(numInstances, 0);
+  if(byClass) {
+    for(unsigned int i = 0; i < numInstances; ++i) {
+      classes[i] = dataset->GetInstance(instanceIndices[i])->GetClass();
+    }
+  }
+  cout << Timestamp() << "Finding " << k << " nearest neighbors of "
+          << numInstances << " instances from the kept distances" << endl;
+
+  // each instance's candidates in full matrix row order
+#pragma omp parallel for schedule(dynamic, 16)
+  for(int i = 0; i < (int) numInstances; ++i) {
+    NeighborSelections selections(k);
+    for(unsigned int j = 0; j < (unsigned int) i; ++j) {
+      OfferNeighbor(selections, k, byClass, classes[i], classes[j],
+                    make_pair(KeptDistance(KeptIndex(j, i)),
+                              instanceIndices[j]));
+    }
+    size_t rowStart = KeptIndex(i, i + 1);
+    for(unsigned int j = i + 1; j < numInstances; ++j) {
+      OfferNeighbor(selections, k, byClass, classes[i], classes[j],
+                    make_pair(KeptDistance(rowStart + (j - i - 1)),
+                              instanceIndices[j]));
+    }
+    SetInstanceNeighbors(dataset->GetInstance(instanceIndices[i]), selections,
+                         byClass);
+  }
+
+  return true;
+}
+
+bool PairwiseDistances::CanKeepDistances(unsigned int numInstances) {
+  size_t numPairs = ((size_t) numInstances * (numInstances - 1)) / 2;
+  if((numPairs * sizeof(double)) > MAX_KEPT_DISTANCES_BYTES) {
+    return false;
+  }
+  // keep distances where updates reproduce a new computation: exactly for
+  // GM and AM genotype counts, up to rounding for numerics, which rarely tie;
+  // rounding would break the many ties of the other genotype metrics
+  // differently, and KM mutation types follow the attribute mask, so those
+  // are computed again each time
+  return dataset->IsDistanceAdditive() &&
+    (!dataset->HasGenotypes() ||
+     (!dataset->HasNumerics() && dataset->PrepareGenotypeBitPlanes() &&
+      dataset->HasDistanceCounts()));
+}
+
+void PairwiseDistances::ClearDistances() {
+  vector<double>().swap(keptDistances);
+  vector<GenotypeBitPlanes::DistanceCounts>().swap(keptCounts);
+  keptAsCounts = false;
+  keptInstances.clear();
+  keptAttributes.clear();
+  keptNumerics.clear();
+  keptVersion = 0;
+}
+
+void PairwiseDistances::SetBlockSize(unsigned int newBlockSize) {
+  blockSize = newBlockSize;
+  blockSizeFixed = (newBlockSize != 0);
+}
+
+bool PairwiseDistances::PrepareBlocks(unsigned int numInstances) {
+  bool useBitPlanes = dataset->PrepareGenotypeBitPlanes();
+  bool useNumericsMatrix = dataset->PrepareNumericsMatrix();
+  dataset->PrepareMissingBitmaps();
+  if(dataset->HasGenotypes() && !useBitPlanes) {
+    // NCA and NCA6 look up per-SNP tables
+    dataset->PrepareNucleotideCountTables();
+  }
+  if(!blockSizeFixed) {
+    blockSize = ChooseBlockSize(numInstances, useBitPlanes, useNumericsMatrix);
+  }
+  if(blockSize == 0) {
+    cerr << "ERROR: PairwiseDistances: block size must be positive" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+unsigned int PairwiseDistances::ChooseBlockSize(unsigned int numInstances,
+                                                bool useBitPlanes,
+                                                bool useNumericsMatrix) {
+  // bytes read per instance by one distance
+  size_t bytesPerInstance = 0;
+  if(dataset->HasGenotypes()) {
+    size_t numAttributes =
+      dataset->MaskGetAttributeIndices(DISCRETE_TYPE).size();
+    if(useBitPlanes) {
+      // three 64-bit planes per 64 attributes
+      bytesPerInstance += ((numAttributes + 63) / 64) * 3 * 8;
+    } else {
+      bytesPerInstance += numAttributes * sizeof(AttributeLevel);
+    }
+  }
+  if(dataset->HasNumerics()) {
+    size_t numNumerics =
+      dataset->MaskGetAttributeIndices(NUMERIC_TYPE).size();
+    bytesPerInstance += numNumerics * sizeof(NumericLevel);
+    if(!useNumericsMatrix) {
+      // per attribute min/max lookups
+      bytesPerInstance += numNumerics * sizeof(NumericLevel) * 2;
+    }
+  }
+  if(bytesPerInstance == 0) {
+    bytesPerInstance = 1;
+  }
+
+  // a row block and a column block share the cache
+  size_t cacheBlockSize = L2CacheBytes() / (2 * bytesPerInstance);
+  unsigned int newBlockSize = MAX_BLOCK_SIZE;
+  if(cacheBlockSize < newBlockSize) {
+    newBlockSize = cacheBlockSize;
+  }
+  // enough blocks to keep every thread busy to the end
+  size_t minBlocks = BLOCKS_PER_THREAD * omp_get_max_threads();
+  while(newBlockSize > MIN_BLOCK_SIZE) {
+    size_t numBlocks = (numInstances + newBlockSize - 1) / newBlockSize;
+    if((numBlocks * (numBlocks + 1) / 2) >= minBlocks) {
+      break;
+    }
+    newBlockSize /= 2;
+  }
+  if(newBlockSize < MIN_BLOCK_SIZE) {
+    newBlockSize = MIN_BLOCK_SIZE;
+  }
+
+  return newBlockSize;
+}
+
+size_t PairwiseDistances::L2CacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  long cacheBytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  if(cacheBytes > 0) {
+    return cacheBytes;
+  }
+#endif
+  return DEFAULT_L2_CACHE_BYTES;
+}
+
+void PairwiseDistances::UpperTriangleBlocks(
+  unsigned int numInstances, vector<pair<unsigned int, unsigned int> >& blocks) {
+  // full off-diagonal blocks first, then the half-sized diagonal blocks
+  unsigned int numBlocks = (numInstances + blockSize - 1) / blockSize;
+  blocks.clear();
+  blocks.reserve(numBlocks * (numBlocks + 1) / 2);
+  for(unsigned int rowBlock = 0; rowBlock < numBlocks; ++rowBlock) {
+    for(unsigned int colBlock = rowBlock + 1; colBlock < numBlocks;
+        ++colBlock) {
+      blocks.push_back(make_pair(rowBlock, colBlock));
+    }
+  }
+  for(unsigned int block = 0; block < numBlocks; ++block) {
+    blocks.push_back(make_pair(block, block));
+  }
+}
+
+void PairwiseDistances::UpdateKeptDistances(bool subtract) {
+  unsigned int numInstances = keptInstances.size();
+  if(numInstances < 2) {
+    return;
+  }
+  vector<pair<unsigned int, unsigned int> > blocks;
+  UpperTriangleBlocks(numInstances, blocks);
+#pragma omp parallel for schedule(dynamic, 1)
+  for(int blockIndex = 0; blockIndex < (int) blocks.size(); ++blockIndex) {
+    unsigned int rowStart = blocks[blockIndex].first * blockSize;
+    unsigned int rowEnd = rowStart + blockSize;
+    if(rowEnd > numInstances) {
+      rowEnd = numInstances;
+    }
+    unsigned int colStart = blocks[blockIndex].second * blockSize;
+    unsigned int colEnd = colStart + blockSize;
+    if(colEnd > numInstances) {
+      colEnd = numInstances;
+    }
+    bool diagonal = (rowStart == colStart);
+    for(unsigned int i = rowStart; i < rowEnd; ++i) {
+      unsigned int dsi1Index = keptInstances[i];
+      unsigned int jStart = diagonal ? (i + 1) : colStart;
+      size_t kept = KeptIndex(i, jStart);
+      for(unsigned int j = jStart; j < colEnd; ++j, ++kept) {
+        unsigned int dsi2Index = keptInstances[j];
+        if(keptAsCounts) {
+          GenotypeBitPlanes::DistanceCounts& counts = keptCounts[kept];
+          if(subtract) {
+            GenotypeBitPlanes::DistanceCounts removed =
+              dataset->ComputeDistanceContributionCounts(dsi1Index, dsi2Index);
+            counts.halfSteps -= removed.halfSteps;
+            counts.missing -= removed.missing;
+          } else {
+            counts = dataset->ComputeDistanceCounts(dsi1Index, dsi2Index);
+          }
+        } else {
+          if(subtract) {
+            keptDistances[kept] -=
+              dataset->ComputeDistanceContribution(dsi1Index, dsi2Index);
+          } else {
+            keptDistances[kept] =
+              dataset->ComputeInstanceToInstanceDistance(dsi1Index, dsi2Index);
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,199 @@
+/**
+ * \class PairwiseDistances
+ *
+ * \brief Cache-blocked, load-balanced all-pairs instance distances.
+ *
+ * Computes the instance-to-instance distances of a Dataset for a list of
+ * instances. The upper triangle of the distance matrix is tiled into
+ * blocks of B x B instance pairs, with B chosen so the distance data of two
+ * blocks of instances fits in the L2 cache. Every instance loaded for a block
+ * is reused against the B instances of the other block. Blocks are handed
+ * to threads largest first, so the half-sized diagonal blocks fill in at
+ * the end and no thread is left with a long row of pairs.
+ *
+ * ComputeNearestNeighbors feeds the distances straight into bounded
+ * per-instance, per-class nearest neighbor selections instead of a matrix.
+ * It works through bands of rows, keeping only one band of distances, so
+ * memory is O(n * k) plus the band. Each instance sees its candidates in
+ * the same order as a full matrix row, so the neighbors are exactly those
+ * best_n picks from the matrix. When only m of n instances are sampled, the
+ * query form computes just their m rows of distances. SelectNearestNeighbors
+ * makes the same selection from a given DistanceMatrix instead.
+ *
+ * UpdateNearestNeighbors keeps the packed pair distances between calls, for
+ * rankers that remove attributes and search again. Distances are sums over
+ * attributes, so removing attributes only subtracts their contributions
+ * from the kept distances. GM and AM genotype distances are kept as their
+ * integer counts, so the updates are exact; numeric distances are doubles
+ * and match a new computation up to rounding. ReliefF and friends use these;
+ * Dataset::CalculateDistanceMatrix uses ComputeDistanceMatrix, into a packed
+ * DistanceMatrix.
+ *
+ * \sa Dataset, ReliefF
+ */
+
+#ifndef PAIRWISEDISTANCES_H
+#define	PAIRWISEDISTANCES_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+#include "GenotypeBitPlanes.h"
+
+class Dataset;
+class DistanceMatrix;
+
+class PairwiseDistances
+{
+public:
+  /*************************************************************************//**
+   * Construct a distance engine for a data set.
+   * \param [in] ds data set whose distance metrics and masks are used
+   ****************************************************************************/
+  PairwiseDistances(Dataset* ds);
+  /*************************************************************************//**
+   * Compute the distances between all pairs of instances into a packed
+   * upper triangular matrix.
+   * \param [in] instanceIndices data set indices of the m instances
+   * \param [out] distanceMatrix matrix allocated for m instances
+   * \return success
+   ****************************************************************************/
+  bool ComputeDistanceMatrix(const std::vector<unsigned int>& instanceIndices,
+                             DistanceMatrix& distanceMatrix);
+  /*************************************************************************//**
+   * Find the k nearest neighbors of every instance without storing the
+   * distance matrix, and set them in the instances: nearest hits and misses
+   * of each other class, or nearest neighbors for continuous phenotypes.
+   * \param [in] instanceIndices data set indices of the m instances
+   * \param [in] k number of nearest neighbors
+   * \return success
+   ****************************************************************************/
+  bool ComputeNearestNeighbors(const std::vector<unsigned int>& instanceIndices,
+                               unsigned int k);
+  /*************************************************************************//**
+   * Find the k nearest neighbors of only some query instances, e.g. the m
+   * instances sampled by ReliefF, and set them in those instances. Computes
+   * m x n distances instead of all n x n; the neighbors are the same as from
+   * the full search.
+   * \param [in] instanceIndices data set indices of the n candidate instances
+   * \param [in] queryIndices data set indices of the m query instances, each
+   *                          one of the candidates, without repeats
+   * \param [in] k number of nearest neighbors
+   * \return success
+   ****************************************************************************/
+  bool ComputeNearestNeighbors(const std::vector<unsigned int>& instanceIndices,
+                               const std::vector<unsigned int>& queryIndices,
+                               unsigned int k);
+  /*************************************************************************//**
+   * Find the k nearest neighbors of query instances from given distances,
+   * e.g. a matrix from another tool, instead of computing any, and set them
+   * in those instances. Candidates are offered in the same order as
+   * ComputeNearestNeighbors, so the same distances give the same neighbors.
+   * \param [in] distanceMatrix distances between the matrix's instances
+   * \param [in] matrixRows matrix row of each data set instance index; every
+   *                        candidate instance must have one
+   * \param [in] instanceIndices data set indices of the n candidate instances
+   * \param [in] queryIndices data set indices of the m query instances, each
+   *                          one of the candidates, without repeats
+   * \param [in] k number of nearest neighbors
+   * \return success
+   ****************************************************************************/
+  bool SelectNearestNeighbors(const DistanceMatrix& distanceMatrix,
+                              const std::vector<unsigned int>& matrixRows,
+                              const std::vector<unsigned int>& instanceIndices,
+                              const std::vector<unsigned int>& queryIndices,
+                              unsigned int k);
+  /*************************************************************************//**
+   * Find the k nearest neighbors of every instance like
+   * ComputeNearestNeighbors, but keep the pair distances between calls. When
+   * the instances, metrics and data are unchanged and attributes have only
+   * been removed from the masks, as in EC and TuRF iterations, the removed
+   * attributes' contributions are subtracted from the kept distances instead
+   * of computing them again. Distances are kept for GM and AM genotypes or
+   * for numerics alone; otherwise, or if the packed distances would take
+   * more than 1 GB, this is ComputeNearestNeighbors.
+   * \param [in] instanceIndices data set indices of the m instances
+   * \param [in] k number of nearest neighbors
+   * \return success
+   ****************************************************************************/
+  bool UpdateNearestNeighbors(const std::vector<unsigned int>& instanceIndices,
+                              unsigned int k);
+  /*************************************************************************//**
+   * Would UpdateNearestNeighbors keep the distances of these instances with
+   * the data set's current metrics?
+   * \param [in] numInstances number of instances
+   * \return true if the distances can be kept
+   ****************************************************************************/
+  bool CanKeepDistances(unsigned int numInstances);
+  /*************************************************************************//**
+   * Prepare the data set's fast distance paths and choose the block size;
+   * other searches call this before ComputeInstanceToInstanceDistance.
+   * \param [in] numInstances number of instances in the matrix
+   * \return success
+   ****************************************************************************/
+  bool PrepareBlocks(unsigned int numInstances);
+  /// Release the kept distances.
+  void ClearDistances();
+  /// Instances per block side; 0 chooses it from the L2 cache size.
+  void SetBlockSize(unsigned int newBlockSize);
+  /// Instances per block side, as set or as chosen by the last computation.
+  unsigned int GetBlockSize() const { return blockSize; }
+private:
+  /*************************************************************************//**
+   * Choose a block size for the data set's current masks and metrics.
+   * \param [in] numInstances number of instances in the matrix
+   * \param [in] useBitPlanes are the genotype bit planes in use?
+   * \param [in] useNumericsMatrix is the numerics matrix in use?
+   * \return instances per block side
+   ****************************************************************************/
+  unsigned int ChooseBlockSize(unsigned int numInstances, bool useBitPlanes,
+                               bool useNumericsMatrix);
+  /// Size of the L2 cache in bytes, or a typical size if unknown.
+  static std::size_t L2CacheBytes();
+  /*************************************************************************//**
+   * The upper triangle of blocks of a matrix: full off-diagonal blocks first,
+   * then the half-sized diagonal blocks.
+   * \param [in] numInstances number of instances in the matrix
+   * \param [out] blocks (row block, column block) pairs
+   ****************************************************************************/
+  void UpperTriangleBlocks(unsigned int numInstances,
+                           std::vector<std::pair<unsigned int,
+                                                 unsigned int> >& blocks);
+  /*************************************************************************//**
+   * Compute or update the kept distances in blocks, in parallel.
+   * \param [in] subtract subtract the prepared distance contributions
+   *                      instead of computing the distances
+   ****************************************************************************/
+  void UpdateKeptDistances(bool subtract);
+  /// Kept distance at a packed upper triangle position.
+  double KeptDistance(std::size_t index) const {
+    return keptAsCounts ?
+      GenotypeBitPlanes::DistanceFromCounts(keptCounts[index]) :
+      keptDistances[index];
+  }
+  /// Position of pair (i, j), i < j, in the packed upper triangle.
+  std::size_t KeptIndex(std::size_t i, std::size_t j) const {
+    return (i * (2 * keptInstances.size() - i - 1)) / 2 + (j - i - 1);
+  }
+
+  Dataset* dataset;
+  unsigned int blockSize;
+  /// was the block size set by the caller?
+  bool blockSizeFixed;
+  /// packed upper triangle of the kept pair distances, row by row
+  std::vector<double> keptDistances;
+  /// or of their genotype counts, which update exactly
+  std::vector<GenotypeBitPlanes::DistanceCounts> keptCounts;
+  /// are the kept distances counts?
+  bool keptAsCounts;
+  /// data set indices of the instances of the kept distances
+  std::vector<unsigned int> keptInstances;
+  /// sorted attribute and numeric indices the kept distances sum over
+  std::vector<unsigned int> keptAttributes;
+  std::vector<unsigned int> keptNumerics;
+  /// data set distance version of the kept distances
+  unsigned long keptVersion;
+};
+
+#endif	/* PAIRWISEDISTANCES_H */
@@ -11,6 +11,9 @@
 
 #include <time.h>
 #include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <boost/lexical_cast.hpp>
 
@@ -24,6 +27,33 @@ using namespace std;
 using namespace boost;
 using namespace insilico;
 
+/// PLINK .bed magic number and major mode bytes precede the genotype data
+static const unsigned int BED_HEADER_BYTES = 3;
+
+/// PLINK .bed two-bit genotype code to attribute level:
+/// 00=allele1/allele1, 01=missing, 10=allele1/allele2, 11=allele2/allele2
+static const AttributeLevel bedCodeToAttributeLevel[4] = {
+  2, MISSING_ATTRIBUTE_VALUE, 1, 0
+};
+
+/// attribute levels of the four genotypes packed into each possible .bed byte,
+/// lowest order bit pair first
+static AttributeLevel bedByteToAttributeLevels[256][4];
+static bool bedByteTableInitialized = false;
+
+static void InitBedByteTable() {
+  if(bedByteTableInitialized) {
+    return;
+  }
+  for(unsigned int byteValue = 0; byteValue < 256; ++byteValue) {
+    for(unsigned int genotypeIdx = 0; genotypeIdx < 4; ++genotypeIdx) {
+      bedByteToAttributeLevels[byteValue][genotypeIdx] =
+        bedCodeToAttributeLevel[(byteValue >> (2 * genotypeIdx)) & 3];
+    }
+  }
+  bedByteTableInitialized = true;
+}
+
 /*****************************************************************************
  * Method: (constructor)
  *
@@ -36,10 +66,13 @@ PlinkBinaryDataset::PlinkBinaryDataset() : Dataset::Dataset() {
   numInstancesRead = 0;
   numAttributesRead = 0;
   numClassesRead = 0;
+  numBedInstances = 0;
+  numBedAttributes = 0;
   filenameBase = "";
   missingAttributeValuesToCheck.push_back("00");
   missingClassValuesToCheck.push_back("0");
   missingClassValuesToCheck.push_back("-9");
+  InitBedByteTable();
 }
 
 // -----------------------------------------------------------------------------
@@ -57,7 +90,7 @@ bool PlinkBinaryDataset::LoadSnps(string filename) {
 
   // ---------------------------------------------------------------------------
   // read bim file
-  // sets numAttributesRead
+  // sets numBedAttributes, numAttributesRead and bedAttributeColumns
   if(!ReadBimFile(filenameBase + ".bim")) {
     return false;
   }
@@ -65,7 +98,7 @@ bool PlinkBinaryDataset::LoadSnps(string filename) {
   // ---------------------------------------------------------------------------
   // read fam file:
   // sets classIndexes
-  // sets numInstancesRead
+  // sets numBedInstances, numInstancesRead and bedInstanceRows
   // sets numClassesRead
   // sets instances vector to new DatasetInstance pointers with class set
   if(!ReadFamFile(filenameBase + ".fam")) {
@@ -119,132 +152,53 @@ bool PlinkBinaryDataset::LoadSnps(string filename) {
   // read SNP or subject data
   if(majorMode == "00000000") {
     cout << Timestamp() << "Reading instance data in instance-major mode" << endl;
-    cerr << Timestamp() << "ERROR: Plink instance-major mode is currently unsupported" << endl;
-    exit(1);
-    //    while(instanceIndex < numInstancesRead) {
-    //      ++instanceIndex;
-    //    }
+
+    unsigned int bytesNeededForInstanceRow = 0;
+    if((numBedAttributes % 4) == 0) {
+      bytesNeededForInstanceRow = (numBedAttributes / 4);
+    }
+    else {
+      bytesNeededForInstanceRow = (numBedAttributes / 4) + 1;
+    }
+    cout << Timestamp() << "Reading " << bytesNeededForInstanceRow
+            << " bytes for each instance row" << endl;
+    if(!ReadBedInstanceMajorStream(bedDataStream, bytesNeededForInstanceRow)) {
+      return false;
+    }
   } else {
     if(majorMode == "00000001") {
       cout << Timestamp() << "Reading instance data in attribute-major mode" << endl;
 
       unsigned int bytesNeededForAttributeColumn = 0;
-      if((numInstancesRead % 4) == 0) {
-        bytesNeededForAttributeColumn = (numInstancesRead / 4);
+      if((numBedInstances % 4) == 0) {
+        bytesNeededForAttributeColumn = (numBedInstances / 4);
       }
       else {
-        bytesNeededForAttributeColumn = (numInstancesRead / 4) + 1;
+        bytesNeededForAttributeColumn = (numBedInstances / 4) + 1;
       }
       cout << Timestamp() << "Reading " << bytesNeededForAttributeColumn
               << " bytes for each SNP column" << endl;
-      char* attributeBuffer = new char[bytesNeededForAttributeColumn];
-      unsigned int instanceIndex = 0;
-      unsigned int byteIndex = 0;
-      unsigned int alleleIndex = 7;
-      unsigned int attributesRead = 0;
-      unsigned int attributeColumn = 0;
-      unsigned int attributesToRead = numInstancesRead * numAttributesRead;
-      unsigned int tenPercentAttributes = (unsigned int) attributesToRead * 0.1;
-      unsigned int onePercentAttributes = (unsigned int) attributesToRead * 0.01;
-      string genotypeByte = "";
-
-			cout << Timestamp();
-      while(attributesRead < attributesToRead) {
-
-        // after reading all snps for attribute index for all instances
-        // preparse for the next snp column
-        if(instanceIndex % numInstancesRead == 0) {
-          byteIndex = 0;
-          alleleIndex = 7;
-          instanceIndex = 0;
-          if(attributesRead) {
-            ++attributeColumn;
-          }
-          // read the number of bytes needed for a column into a character buffer
-          bedDataStream.read(attributeBuffer, bytesNeededForAttributeColumn);
-        }
 
-        // convert the current byte into a bit string
-        genotypeByte = get_bits(attributeBuffer[byteIndex]);
-
-        // lookup the alleles for this attribute's genotypes
-        // ASSERT: all alleles are single characters representing only 0/1/2
-        char bit1 = genotypeByte[alleleIndex--];
-        char bit2 = genotypeByte[alleleIndex--];
-        string binGenotype = "  ";
-        binGenotype[0] = bit1;
-        binGenotype[1] = bit2;
-        pair<char, char> alleles = attributeAlleles[attributeColumn];
-//        cout << attributeColumn << "\t" << alleles.first
-//                << "\t" << alleles.second << endl;
-        AttributeLevel attributeLevel = MISSING_ATTRIBUTE_VALUE;
-        string stringGenotype = "  ";
-        if(binGenotype == "00") {
-          stringGenotype[0] = alleles.first;
-          stringGenotype[1] = alleles.first;
-          ++attributeAlleleCounts[attributeColumn][alleles.first];
-          ++attributeAlleleCounts[attributeColumn][alleles.first];
-          attributeLevel = 2;
-        }
-        if(binGenotype == "01") {
-          stringGenotype[0] = alleles.first;
-          stringGenotype[1] = alleles.second;
-          ++attributeAlleleCounts[attributeColumn][alleles.first];
-          ++attributeAlleleCounts[attributeColumn][alleles.second];
-          attributeLevel = 1;
-        }
-        if(binGenotype == "11") {
-          stringGenotype[0] = alleles.second;
-          stringGenotype[1] = alleles.second;
-          ++attributeAlleleCounts[attributeColumn][alleles.second];
-          ++attributeAlleleCounts[attributeColumn][alleles.second];
-          attributeLevel = 0;
-        }
-        if(binGenotype == "10") {
-          attributeLevel = MISSING_ATTRIBUTE_VALUE;
-        }
-        if(attributeLevel != MISSING_ATTRIBUTE_VALUE) {
-          ++genotypeCounts[attributeColumn][stringGenotype];
-        }
-
-//        cout 
-//								<< "instance: " << instanceIndex << "," 
-//								<< "attribute: " << attributeColumn << ": "
-//                << "byte: " << byteIndex << " " 
-//								<< "genotype byte: " << genotypeByte << ", "
-//                << "binary genotype: " << binGenotype 
-//								<< " -> " << "attribute level: " << attributeLevel 
-//								<< endl;
-
-        // finally, we can set the attribute value
-				instances[instanceIndex]->attributes[attributeColumn] = attributeLevel;
-				attributeLevelsSeen[attributeColumn].insert(stringGenotype);
-        ++attributesRead;
-        ++instanceIndex;
-
-        // four genotypes per byte, ie, 2 bits per genotype
-        if(instanceIndex % 4 == 0) {
-          ++byteIndex;
-          alleleIndex = 7;
-        }
+      // make sure there is a full column for every SNP before decoding
+      bedDataStream.seekg(0, ios::end);
+      streamoff bedFileSize = bedDataStream.tellg();
+      streamoff bedFileSizeNeeded = BED_HEADER_BYTES +
+        ((streamoff) bytesNeededForAttributeColumn * numBedAttributes);
+      bedDataStream.seekg(BED_HEADER_BYTES, ios::beg);
+      if(bedFileSize < bedFileSizeNeeded) {
+        cerr << "ERROR: " << bedFilename << " is truncated: expected "
+                << bedFileSizeNeeded << " bytes, found " << bedFileSize << endl;
+        return false;
+      }
 
-        // happy lights
-        // express as a percentage rather than huge numbers
-        float percentDone = ((float) attributesRead / attributesToRead) * 100.0;
-        if((attributesRead % onePercentAttributes) == 0) {
-          cout << "." << flush;
+      if(!ReadBedSnpMajorMapped(bedFilename, bytesNeededForAttributeColumn)) {
+        cout << Timestamp() << "Memory-mapped read not available, "
+                << "reading SNP columns sequentially" << endl;
+        if(!ReadBedSnpMajorStream(bedDataStream,
+                                  bytesNeededForAttributeColumn)) {
+          return false;
         }
-        if((attributesRead % tenPercentAttributes) == 0) {
-          cout << (int) percentDone << "%" << endl;
-					cout << Timestamp();
-        }
-
-      } // !done
-      cout << Timestamp() << "100% decoded data set" << endl;
-
-      // release dynamically-allocated memory
-      delete [] attributeBuffer;
-
+      }
     }// majorMode == ?
     else {
       cerr << "ERROR: Major mode " << majorMode << " is not recognized" << endl;
@@ -258,8 +212,8 @@ bool PlinkBinaryDataset::LoadSnps(string filename) {
   /// Only remove missing phenotypes if no alt pheno file - 1/23/12
   vector<DatasetInstance*> newInstances;
   vector<DatasetInstance*> delInstances;
-  map<string, unsigned int> keepIds;
-  map<string, unsigned int>::iterator it = instancesMask.begin();
+  DatasetMask keepIds;
+  DatasetMask::const_iterator it = instancesMask.begin();
   for(; it != instancesMask.end(); ++it) {
     string instanceID = it->first;
     DatasetInstance* dsi = instances[it->second];
@@ -289,7 +243,7 @@ bool PlinkBinaryDataset::LoadSnps(string filename) {
     }
   	/// Passed all tests, so add this instance to the data set
   	if(keepInstance) {
-  		keepIds[instanceID] = newInstances.size();
+  		keepIds.Set(instanceID, newInstances.size());
   		newInstances.push_back(dsi);
   	}
   }
@@ -375,6 +329,10 @@ bool PlinkBinaryDataset::ReadBimFile(string bimFilename) {
   string line;
   // pair < map<string, unsigned int>::iterator, bool> retAlleleInsert;
   unsigned int attrIdx = 0;
+  unsigned int numIncludedSeen = 0;
+  unsigned int numExcludedSeen = 0;
+  numBedAttributes = 0;
+  bedAttributeColumns.clear();
   while(getline(bimDataStream, line)) {
     ++bimLineNumber;
     string trimmedLine = trim(line);
@@ -393,8 +351,21 @@ bool PlinkBinaryDataset::ReadBimFile(string bimFilename) {
               << endl;
       return false;
     }
+    // every bim line is a column in the bed file, loaded or not
+    unsigned int bedColumn = numBedAttributes;
+    ++numBedAttributes;
+    if(attributeNamesToInclude.count(tokens[1])) {
+      ++numIncludedSeen;
+    }
+    if(attributeNamesToExclude.count(tokens[1])) {
+      ++numExcludedSeen;
+    }
+    if(!IsLoadableAttributeName(tokens[1])) {
+      continue;
+    }
+    bedAttributeColumns.push_back(bedColumn);
     attributeNames.push_back(tokens[1]);
-    attributesMask[tokens[1]] = attrIdx;
+    attributesMask.Set(tokens[1], attrIdx);
     ++attrIdx;
     string genotypeAllele1 = tokens[4];
     string genotypeAllele2 = tokens[5];
@@ -430,8 +401,24 @@ bool PlinkBinaryDataset::ReadBimFile(string bimFilename) {
     //    alleleValuesByInt.push_back(map2);
   }
   bimDataStream.close();
-  numAttributesRead = bimLineNumber;
+  numAttributesRead = attrIdx;
   classColumn = numAttributesRead;
+  // the include/exclude lists have been applied; no masking after loading
+  attributesFilteredOnLoad = true;
+  if(numIncludedSeen < attributeNamesToInclude.size()) {
+    cout << Timestamp() << "WARNING: "
+            << (attributeNamesToInclude.size() - numIncludedSeen)
+            << " attributes in the include list are not in the bim file" << endl;
+  }
+  if(numExcludedSeen < attributeNamesToExclude.size()) {
+    cout << Timestamp() << "WARNING: "
+            << (attributeNamesToExclude.size() - numExcludedSeen)
+            << " attributes in the exclude list are not in the bim file" << endl;
+  }
+  if(numAttributesRead < numBedAttributes) {
+    cout << Timestamp() << "Loading " << numAttributesRead << " of "
+            << numBedAttributes << " attributes in the bed file" << endl;
+  }
   cout << Timestamp() << "There are " << numAttributesRead
           << " attributes in the dataset" << endl;
 
@@ -480,6 +467,8 @@ bool PlinkBinaryDataset::ReadFamFile(string famFilename) {
   string line;
   int famLineNumber = 0;
   numInstancesRead = 0;
+  numBedInstances = 0;
+  bedInstanceRows.clear();
   double minPheno = 0.0, maxPheno = 0.0;
   unsigned int instanceIndex = 0;
   while(getline(famDataStream, line)) {
@@ -492,7 +481,9 @@ bool PlinkBinaryDataset::ReadFamFile(string famFilename) {
     if(trimmedLine.size() == 0) {
       continue;
     }
-    ++numInstancesRead;
+    // every fam line is a row in the bed file, loaded or not
+    unsigned int bedRow = numBedInstances;
+    ++numBedInstances;
 
     vector<string> tokens;
     split(tokens, trimmedLine);
@@ -526,6 +517,19 @@ bool PlinkBinaryDataset::ReadFamFile(string famFilename) {
     	}
     }
 
+		/// Skip instances not in instanceIdsToLoad or marked as missing
+		/// phenotype before any genotypes are decoded for them
+		if(!IsLoadableInstanceID(ID)) {
+			cout << Timestamp() << "Instance ID " << ID
+					<< " filtered out by numeric or alt pheno file" << endl;
+			continue;
+		}
+		if(!hasAlternatePhenotypes && (thisClassString == "-9")) {
+			cout << Timestamp() << "Instance ID " << ID
+					<< " filtered out by missing value" << endl;
+			continue;
+		}
+
 		/// Create a new instance for this individual
     DatasetInstance* newInst = new DatasetInstance(this);
 		if(hasContinuousPhenotypes) {
@@ -533,27 +537,292 @@ bool PlinkBinaryDataset::ReadFamFile(string famFilename) {
 		} else {
 			newInst->SetClass(discreteClassLevel);
     	if(thisClassString != "-9") {
-    		classIndexes[discreteClassLevel].push_back(famLineNumber - 1);
+    		classIndexes[discreteClassLevel].push_back(instanceIndex);
     	}
 		}
 		instances.push_back(newInst);
 		instanceIds.push_back(ID);
-		instancesMask[ID] = instanceIndex;
+		instancesMask.Set(ID, instanceIndex);
+		bedInstanceRows.push_back(bedRow);
 
 		++instanceIndex;
   }
   famDataStream.close();
+  numInstancesRead = instanceIndex;
 
   if(hasContinuousPhenotypes) {
     continuousPhenotypeMinMax = make_pair(minPheno, maxPheno);
   }
 
-  cout << Timestamp() << numInstancesRead << " individuals read from the "
+  cout << Timestamp() << numBedInstances << " individuals read from the "
   		<< "fam file." << endl;
+  if(numInstancesRead < numBedInstances) {
+    cout << Timestamp() << "Loading " << numInstancesRead << " of "
+            << numBedInstances << " individuals in the bed file" << endl;
+  }
+
+  return true;
+}
+
+bool PlinkBinaryDataset::ReadBedSnpMajorStream(ifstream& bedDataStream,
+                                               unsigned int bytesPerColumn) {
+  unsigned char* attributeBuffer = new unsigned char[bytesPerColumn];
+  // counts of each two-bit genotype code for the current SNP column
+  unsigned int bedCodeCounts[4];
+  unsigned int tenPercentAttributes = numAttributesRead / 10;
+  unsigned int onePercentAttributes = numAttributesRead / 100;
+  if(tenPercentAttributes == 0) {
+    tenPercentAttributes = 1;
+  }
+  if(onePercentAttributes == 0) {
+    onePercentAttributes = 1;
+  }
+
+  cout << Timestamp();
+  unsigned int nextBedColumn = 0;
+  for(unsigned int attributeColumn = 0; attributeColumn < numAttributesRead;
+      ++attributeColumn) {
+    // seek past columns of attributes that are not loaded
+    unsigned int bedColumn = bedAttributeColumns[attributeColumn];
+    if(bedColumn != nextBedColumn) {
+      bedDataStream.seekg(BED_HEADER_BYTES +
+                          ((streamoff) bedColumn * bytesPerColumn), ios::beg);
+    }
+    nextBedColumn = bedColumn + 1;
+    // read the number of bytes needed for a column into a byte buffer
+    bedDataStream.read(reinterpret_cast<char*>(attributeBuffer),
+                       bytesPerColumn);
+    if(!bedDataStream) {
+      cout << endl;
+      cerr << "ERROR: plink bed file is truncated at SNP column "
+              << bedColumn << endl;
+      delete [] attributeBuffer;
+      return false;
+    }
+    bedCodeCounts[0] = bedCodeCounts[1] = 0;
+    bedCodeCounts[2] = bedCodeCounts[3] = 0;
+    DecodeBedAttributeColumn(attributeBuffer, attributeColumn, bedCodeCounts);
+    SetBedAttributeStats(attributeColumn, bedCodeCounts);
+
+    // happy lights
+    // express as a percentage rather than huge numbers
+    unsigned int attributesRead = attributeColumn + 1;
+    float percentDone = ((float) attributesRead / numAttributesRead) * 100.0;
+    if((attributesRead % onePercentAttributes) == 0) {
+      cout << "." << flush;
+    }
+    if((attributesRead % tenPercentAttributes) == 0) {
+      cout << (int) percentDone << "%" << endl;
+      cout << Timestamp();
+    }
+  }
+  cout << "100% decoded data set" << endl;
+
+  // release dynamically-allocated memory
+  delete [] attributeBuffer;
+
+  return true;
+}
+
+bool PlinkBinaryDataset::ReadBedSnpMajorMapped(string bedFilename,
+                                               unsigned int bytesPerColumn) {
+  int bedFileDescriptor = open(bedFilename.c_str(), O_RDONLY);
+  if(bedFileDescriptor == -1) {
+    return false;
+  }
+  size_t mappedSize = BED_HEADER_BYTES +
+    ((size_t) bytesPerColumn * numBedAttributes);
+  void* mappedFile = mmap(0, mappedSize, PROT_READ, MAP_PRIVATE,
+                          bedFileDescriptor, 0);
+  if(mappedFile == MAP_FAILED) {
+    close(bedFileDescriptor);
+    return false;
+  }
+  // only the pages of loaded columns are touched when loading a subset
+  if(numAttributesRead == numBedAttributes) {
+    madvise(mappedFile, mappedSize, MADV_WILLNEED);
+  }
+
+  cout << Timestamp() << "Decoding memory-mapped SNP columns in parallel"
+          << endl;
+  const unsigned char* columnData =
+    static_cast<const unsigned char*>(mappedFile) + BED_HEADER_BYTES;
+  // per-SNP genotype code counts, four per SNP, merged after decoding
+  vector<unsigned int> bedCodeCounts(numAttributesRead * 4, 0);
+  // static schedule gives each thread a contiguous block of SNPs, so threads
+  // write to disjoint ranges of each instance's attribute vector
+  #pragma omp parallel for schedule(static)
+  for(unsigned int attributeColumn = 0; attributeColumn < numAttributesRead;
+      ++attributeColumn) {
+    size_t bedColumn = bedAttributeColumns[attributeColumn];
+    DecodeBedAttributeColumn(columnData + (bedColumn * bytesPerColumn),
+                             attributeColumn,
+                             &bedCodeCounts[attributeColumn * 4]);
+  }
+  munmap(mappedFile, mappedSize);
+  close(bedFileDescriptor);
+
+  // allele and genotype statistics are maps, so merge them serially
+  for(unsigned int attributeColumn = 0; attributeColumn < numAttributesRead;
+      ++attributeColumn) {
+    SetBedAttributeStats(attributeColumn, &bedCodeCounts[attributeColumn * 4]);
+  }
+  cout << Timestamp() << "100% decoded data set" << endl;
 
   return true;
 }
 
+bool PlinkBinaryDataset::ReadBedInstanceMajorStream(ifstream& bedDataStream,
+                                                    unsigned int bytesPerRow) {
+  unsigned char* instanceBuffer = new unsigned char[bytesPerRow];
+  // per-SNP genotype code counts, four per SNP, accumulated over all rows
+  vector<unsigned int> bedCodeCounts(numAttributesRead * 4, 0);
+  unsigned int tenPercentInstances = numInstancesRead / 10;
+  if(tenPercentInstances == 0) {
+    tenPercentInstances = 1;
+  }
+
+  // rows are read once, in file order
+  unsigned int nextBedRow = 0;
+  for(unsigned int instanceIndex = 0; instanceIndex < numInstancesRead;
+      ++instanceIndex) {
+    // seek past rows of instances that are not loaded
+    unsigned int bedRow = bedInstanceRows[instanceIndex];
+    if(bedRow != nextBedRow) {
+      bedDataStream.seekg(BED_HEADER_BYTES +
+                          ((streamoff) bedRow * bytesPerRow), ios::beg);
+    }
+    nextBedRow = bedRow + 1;
+    bedDataStream.read(reinterpret_cast<char*>(instanceBuffer), bytesPerRow);
+    if(!bedDataStream) {
+      cerr << "ERROR: plink bed file is truncated at instance row "
+              << bedRow << endl;
+      delete [] instanceBuffer;
+      return false;
+    }
+    vector<AttributeLevel>& instanceAttributes =
+      instances[instanceIndex]->attributes;
+    if(numAttributesRead < numBedAttributes) {
+      // pick out the two-bit fields of the loaded attributes only
+      for(unsigned int attributeIndex = 0; attributeIndex < numAttributesRead;
+          ++attributeIndex) {
+        unsigned int bedColumn = bedAttributeColumns[attributeIndex];
+        unsigned int bedCode =
+          (instanceBuffer[bedColumn >> 2] >> (2 * (bedColumn & 3))) & 3;
+        instanceAttributes[attributeIndex] = bedCodeToAttributeLevel[bedCode];
+        ++bedCodeCounts[(attributeIndex * 4) + bedCode];
+      }
+      continue;
+    }
+    unsigned int attributeIndex = 0;
+    unsigned int byteIndex = 0;
+    while(attributeIndex < numAttributesRead) {
+      unsigned char genotypeByte = instanceBuffer[byteIndex++];
+      const AttributeLevel* levels = bedByteToAttributeLevels[genotypeByte];
+      // the last byte of a row is padded when attributes % 4 != 0
+      unsigned int genotypesInByte = numAttributesRead - attributeIndex;
+      if(genotypesInByte > 4) {
+        genotypesInByte = 4;
+      }
+      for(unsigned int genotypeIdx = 0; genotypeIdx < genotypesInByte;
+          ++genotypeIdx) {
+        instanceAttributes[attributeIndex] = levels[genotypeIdx];
+        ++bedCodeCounts[(attributeIndex * 4) +
+                        ((genotypeByte >> (2 * genotypeIdx)) & 3)];
+        ++attributeIndex;
+      }
+    }
+
+    // happy lights
+    if(((instanceIndex + 1) % tenPercentInstances) == 0) {
+      cout << Timestamp() << (instanceIndex + 1) << "/" << numInstancesRead
+              << " instances decoded" << endl;
+    }
+  }
+  delete [] instanceBuffer;
+
+  for(unsigned int attributeIndex = 0; attributeIndex < numAttributesRead;
+      ++attributeIndex) {
+    SetBedAttributeStats(attributeIndex, &bedCodeCounts[attributeIndex * 4]);
+  }
+  cout << Timestamp() << "100% decoded data set" << endl;
+
+  return true;
+}
+
+void PlinkBinaryDataset::DecodeBedAttributeColumn(
+  const unsigned char* columnBytes, unsigned int attributeIndex,
+  unsigned int* codeCounts) {
+  if(numInstancesRead < numBedInstances) {
+    // pick out the two-bit fields of the loaded instances only
+    for(unsigned int instanceIndex = 0; instanceIndex < numInstancesRead;
+        ++instanceIndex) {
+      unsigned int bedRow = bedInstanceRows[instanceIndex];
+      unsigned int bedCode =
+        (columnBytes[bedRow >> 2] >> (2 * (bedRow & 3))) & 3;
+      instances[instanceIndex]->attributes[attributeIndex] =
+        bedCodeToAttributeLevel[bedCode];
+      ++codeCounts[bedCode];
+    }
+    return;
+  }
+  unsigned int instanceIndex = 0;
+  unsigned int byteIndex = 0;
+  while(instanceIndex < numInstancesRead) {
+    unsigned char genotypeByte = columnBytes[byteIndex++];
+    const AttributeLevel* levels = bedByteToAttributeLevels[genotypeByte];
+    // the last byte of a column is padded when instances % 4 != 0
+    unsigned int genotypesInByte = numInstancesRead - instanceIndex;
+    if(genotypesInByte > 4) {
+      genotypesInByte = 4;
+    }
+    for(unsigned int genotypeIdx = 0; genotypeIdx < genotypesInByte;
+        ++genotypeIdx) {
+      instances[instanceIndex++]->attributes[attributeIndex] =
+        levels[genotypeIdx];
+      ++codeCounts[(genotypeByte >> (2 * genotypeIdx)) & 3];
+    }
+  }
+}
+
+void PlinkBinaryDataset::SetBedAttributeStats(unsigned int attributeIndex,
+                                              const unsigned int* codeCounts) {
+  char allele1 = attributeAlleles[attributeIndex].first;
+  char allele2 = attributeAlleles[attributeIndex].second;
+  unsigned int homozygous1Count = codeCounts[0];
+  unsigned int missingCount = codeCounts[1];
+  unsigned int heterozygousCount = codeCounts[2];
+  unsigned int homozygous2Count = codeCounts[3];
+
+  attributeAlleleCounts[attributeIndex][allele1] +=
+    (2 * homozygous1Count) + heterozygousCount;
+  attributeAlleleCounts[attributeIndex][allele2] +=
+    heterozygousCount + (2 * homozygous2Count);
+
+  string genotype = "  ";
+  if(homozygous1Count) {
+    genotype[0] = allele1;
+    genotype[1] = allele1;
+    genotypeCounts[attributeIndex][genotype] += homozygous1Count;
+    attributeLevelsSeen[attributeIndex].insert(genotype);
+  }
+  if(heterozygousCount) {
+    genotype[0] = allele1;
+    genotype[1] = allele2;
+    genotypeCounts[attributeIndex][genotype] += heterozygousCount;
+    attributeLevelsSeen[attributeIndex].insert(genotype);
+  }
+  if(homozygous2Count) {
+    genotype[0] = allele2;
+    genotype[1] = allele2;
+    genotypeCounts[attributeIndex][genotype] += homozygous2Count;
+    attributeLevelsSeen[attributeIndex].insert(genotype);
+  }
+  if(missingCount) {
+    attributeLevelsSeen[attributeIndex].insert("  ");
+  }
+}
+
 pair<char, double> PlinkBinaryDataset::GetAttributeMAF(unsigned int attributeIndex) {
   pair<char, double> returnPair = make_pair(' ', 0.0);
   if(attributeIndex < NumAttributes()) {
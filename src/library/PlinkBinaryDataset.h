@@ -16,6 +16,8 @@
 #ifndef PLINKBINARYDATASET_H
 #define	PLINKBINARYDATASET_H
 
+#include <fstream>
+
 #include "Dataset.h"
 #include "Insilico.h"
 
@@ -38,12 +40,65 @@ private:
    ****************************************************************************/
   bool ReadFamFile(std::string famFilename);
   bool LoadSnps(std::string filename);
+  /*************************************************************************//**
+   * Read SNP-major .bed genotypes one column at a time from a stream
+   * positioned after the header.
+   * \param [in] bedDataStream open .bed file stream
+   * \param [in] bytesPerColumn bytes in each packed SNP column
+   * \return success
+   ****************************************************************************/
+  bool ReadBedSnpMajorStream(std::ifstream& bedDataStream,
+                             unsigned int bytesPerColumn);
+  /*************************************************************************//**
+   * Memory-map a SNP-major .bed file and decode blocks of SNP columns in
+   * parallel, then merge the per-SNP statistics.
+   * \param [in] bedFilename PLINK bed filename
+   * \param [in] bytesPerColumn bytes in each packed SNP column
+   * \return false if the file could not be mapped
+   ****************************************************************************/
+  bool ReadBedSnpMajorMapped(std::string bedFilename,
+                             unsigned int bytesPerColumn);
+  /*************************************************************************//**
+   * Read instance-major .bed genotypes one row at a time from a stream
+   * positioned after the header, accumulating per-SNP statistics as the
+   * rows stream past.
+   * \param [in] bedDataStream open .bed file stream
+   * \param [in] bytesPerRow bytes in each packed instance row
+   * \return success
+   ****************************************************************************/
+  bool ReadBedInstanceMajorStream(std::ifstream& bedDataStream,
+                                  unsigned int bytesPerRow);
+  /*************************************************************************//**
+   * Decode one SNP-major column of packed .bed genotypes into the instances'
+   * attribute vectors using the byte lookup table.
+   * \param [in] columnBytes packed genotypes, four per byte
+   * \param [in] attributeIndex attribute (SNP) index of the column
+   * \param [in,out] codeCounts counts of the four two-bit genotype codes
+   ****************************************************************************/
+  void DecodeBedAttributeColumn(const unsigned char* columnBytes,
+                                unsigned int attributeIndex,
+                                unsigned int* codeCounts);
+  /*************************************************************************//**
+   * Add a SNP's genotype code counts to the allele, genotype and levels seen
+   * statistics.
+   * \param [in] attributeIndex attribute (SNP) index
+   * \param [in] codeCounts counts of the four two-bit genotype codes
+   ****************************************************************************/
+  void SetBedAttributeStats(unsigned int attributeIndex,
+                            const unsigned int* codeCounts);
   std::pair<char, double> GetAttributeMAF(unsigned int attributeIndex);
   AttributeMutationType GetAttributeMutationType(unsigned int attributeIndex);
 
   unsigned int numInstancesRead;
   unsigned int numAttributesRead;
   unsigned int numClassesRead;
+  /// number of instances (rows) and attributes (columns) in the bed file
+  unsigned int numBedInstances;
+  unsigned int numBedAttributes;
+  /// bed file row of each loaded instance
+  std::vector<unsigned int> bedInstanceRows;
+  /// bed file column of each loaded attribute
+  std::vector<unsigned int> bedAttributeColumns;
 
   std::vector<int> instanceIndicesToKeep;
   std::vector<int> missingPhenoLines;
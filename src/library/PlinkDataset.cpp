@@ -82,7 +82,7 @@ bool PlinkDataset::LoadSnps(string filename) {
       }
     }
     attributeNames.push_back(tokens[1]);
-    attributesMask[tokens[1]] = attrIdx;
+    attributesMask.Set(tokens[1], attrIdx);
     ++attrIdx;
   }
   mapDataStream.close();
@@ -233,7 +233,7 @@ bool PlinkDataset::LoadSnps(string filename) {
     }
     instances.push_back(newInst);
     instanceIds.push_back(ID);
-    instancesMask[ID] = instanceIndex;
+    instancesMask.Set(ID, instanceIndex);
 
     // the remaining columns in the line are gentoypes for the instance/subject
     // as allele duets separated by spaces
@@ -55,7 +55,7 @@ bool PlinkRawDataset::LoadSnps(string filename) {
     } else {
     	if(classIndex > 5) {
 				attributeNames.push_back(*it);
-				attributesMask[*it] = numAttributes;
+				attributesMask.Set(*it, numAttributes);
 				++numAttributes;
     	}
     }
@@ -197,7 +197,7 @@ bool PlinkRawDataset::LoadSnps(string filename) {
 			newInst->LoadInstanceFromVector(attributeVector);
 			instances.push_back(newInst);
 			instanceIds.push_back(ID);
-			instancesMask[ID] = instanceIndex;
+			instancesMask.Set(ID, instanceIndex);
 		} else {
 			cerr << "ERROR: loading PLINK RAW data set. "
 							<< "Could not create dataset instance for line number "
@@ -12,10 +12,23 @@
 #include "RReliefF.h"
 #include "Dataset.h"
 #include "DistanceMetrics.h"
+#include "DistanceMetricPolicies.h"
 #include "Insilico.h"
 
 using namespace std;
 
+/// a sampled instance with its nearest neighbors, gathered before updates
+struct InfluencedNeighbors {
+	/// the sampled instance R_i
+	DatasetInstance* instance;
+	/// k nearest neighbors I_j
+	vector<DatasetInstance*> neighbors;
+	/// influence factor d_ij of each neighbor
+	vector<double> influences;
+	/// predicted value difference of each neighbor
+	vector<double> diffPredicted;
+};
+
 RReliefF::RReliefF(Dataset* ds) :
 		ReliefF::ReliefF(ds, REGRESSION_ANALYSIS) {
 	cout << Timestamp() << "RReliefF initialization" << endl;
@@ -51,8 +64,14 @@ RReliefF::~RReliefF() {
 
 bool RReliefF::ComputeAttributeScores() {
 
-	// precompute all instance-to-instance distances and get nearest neighbors
-	PreComputeDistances();
+	// draw the samples first, then get the nearest neighbors of just those
+	vector<unsigned int> sampleIndices;
+	if (!SampleInstances(sampleIndices)) {
+		return false;
+	}
+	if (!PreComputeDistances(sampleIndices)) {
+		return false;
+	}
 
 	// results are stored in scores
 	W.resize(dataset->NumVariables(), 0.0);
@@ -76,22 +95,13 @@ bool RReliefF::ComputeAttributeScores() {
 	vector<double> ndcda;
 	ndcda.resize(dataset->NumVariables(), 0.0);
 
-	// pointer to the instance being sampled
-	DatasetInstance* R_i = NULL;
+	// gather every sample's nearest neighbors, their influence factors and
+	// phenotype differences, and sum the phenotype differences, in order
 	cout << Timestamp() << "Running RRelief-F algorithm: ";
-	vector<string> instanceIds = dataset->GetInstanceIds();
-	for (int i = 0; i < (int) m; i++) {
+	vector<InfluencedNeighbors> samples(m);
+	for (unsigned int i = 0; i < m; i++) {
 
-		if (randomlySelect) {
-			// randomly sample an instance (without replacement?)
-			R_i = dataset->GetRandomInstance();
-		} else {
-			// deterministic/indexed instance sampling, ie, every instance against
-			// every other instance
-			unsigned int instanceIndex;
-			dataset->GetInstanceIndexForID(instanceIds[i], instanceIndex);
-			R_i = dataset->GetInstance(instanceIndex);
-		}
+		DatasetInstance* R_i = dataset->GetInstance(sampleIndices[i]);
 		if (!R_i) {
 			cerr
 					<< "ERROR: Random or indexed instance count not be found for index: ["
@@ -117,52 +127,60 @@ bool RReliefF::ComputeAttributeScores() {
 			return false;
 		}
 
-		// update: using pseudocode notation
+		InfluencedNeighbors& sample = samples[i];
+		sample.instance = R_i;
 		for (unsigned int j = 0; j < k; ++j) {
 			// get the jth nearest neighbor
 			DatasetInstance* I_j = dataset->GetInstance(nNearestNeighbors[j]);
 			double diffPredicted = diffPredictedValueTau(R_i, I_j);
 			double d_ij = R_i->GetInfluenceFactorD(j);
 			ndc += (diffPredicted * d_ij);
-			unsigned int scoresIndex = 0;
-			// attributes
-			vector<unsigned int> attributeIndicies =
-					dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
-			for (unsigned int attrIdx = 0; attrIdx < attributeIndicies.size();
-					++attrIdx) {
-				unsigned int A = attributeIndicies[attrIdx];
-				double attrScore = snpDiff(A, R_i, I_j) * d_ij;
-				nda[scoresIndex] += attrScore;
-				ndcda[scoresIndex] += (diffPredicted * attrScore);
-//        cout << "(i, j) = (" << i << "," << j << ") =>"
-//                << " diff predicted: " << diffPredicted
-//                << ", d_ij: " << d_ij
-//                << ", ndc: " << ndc
-//                << ", A: " << A
-//                << ", snpDiff: " << snpDiff(A, R_i, I_j)
-//                << ", nda[A}: " << nda[scoresIndex]
-//                << " ndcda[A]: " << ndcda[scoresIndex]
-//                << endl;
-				++scoresIndex;
-			}
-			// numerics
-			vector<unsigned int> numericIndices = dataset->MaskGetAttributeIndices(
-					NUMERIC_TYPE);
-			for (unsigned int numIdx = 0; numIdx < numericIndices.size(); ++numIdx) {
-				unsigned int N = numericIndices[numIdx];
-				double numScore = numDiff(N, R_i, I_j) * d_ij;
-				nda[scoresIndex] += numScore;
-				ndcda[scoresIndex] += (diffPredicted * numScore);
-				++scoresIndex;
-			}
-//      cout << "******************************" << endl;
+			sample.neighbors.push_back(I_j);
+			sample.influences.push_back(d_ij);
+			sample.diffPredicted.push_back(diffPredicted);
 		}
+	}
 
-//    cout << "--------------------------------------------------" << endl;
-
-		// happy lights
-		if (i && ((i % 100) == 0)) {
-			cout << Timestamp() << i << "/" << m << endl;
+	// update: using pseudocode notation, attributes then numerics, with one
+	// template instance per metric so the diff is inlined
+	vector<unsigned int> attributeIndices =
+			dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
+	vector<unsigned int> numericIndices =
+			dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
+	unsigned int numAttributes = attributeIndices.size();
+	if (numAttributes) {
+		if (snpDiff == diffGMM) {
+			UpdateNeighborScores(GMMetric(), samples, attributeIndices, 0, nda,
+					ndcda, DISCRETE_TYPE);
+		} else if (snpDiff == diffAMM) {
+			UpdateNeighborScores(AMMetric(), samples, attributeIndices, 0, nda,
+					ndcda, DISCRETE_TYPE);
+		} else if (snpDiff == diffNCA) {
+			dataset->PrepareNucleotideCountTables();
+			UpdateNeighborScores(NCAMetric(), samples, attributeIndices, 0, nda,
+					ndcda, DISCRETE_TYPE);
+		} else if (snpDiff == diffNCA6) {
+			dataset->PrepareNucleotideCountTables();
+			UpdateNeighborScores(NCA6Metric(), samples, attributeIndices, 0, nda,
+					ndcda, DISCRETE_TYPE);
+		} else if (snpDiff == diffKM) {
+			UpdateNeighborScores(KMMetric(), samples, attributeIndices, 0, nda,
+					ndcda, DISCRETE_TYPE);
+		} else {
+			UpdateNeighborScores(PointerMetric(snpDiff), samples, attributeIndices,
+					0, nda, ndcda, DISCRETE_TYPE);
+		}
+	}
+	if (numericIndices.size()) {
+		if (numDiff == diffManhattan) {
+			UpdateNeighborScores(ManhattanMetric(), samples, numericIndices,
+					numAttributes, nda, ndcda, NUMERIC_TYPE);
+		} else if (numDiff == diffEuclidean) {
+			UpdateNeighborScores(EuclideanMetric(), samples, numericIndices,
+					numAttributes, nda, ndcda, NUMERIC_TYPE);
+		} else {
+			UpdateNeighborScores(PointerMetric(numDiff), samples, numericIndices,
+					numAttributes, nda, ndcda, NUMERIC_TYPE);
 		}
 	}
 	cout << Timestamp() << m << "/" << m << " done" << endl;
@@ -174,3 +192,60 @@ bool RReliefF::ComputeAttributeScores() {
 
 	return true;
 }
+
+template<class Metric>
+void RReliefF::UpdateNeighborScores(Metric diff,
+		const vector<InfluencedNeighbors>& samples,
+		const vector<unsigned int>& indices, unsigned int firstScore,
+		vector<double>& nda, vector<double>& ndcda, AttributeType attributeType) {
+	// threads take blocks of attributes; each attribute still sums the samples
+	// and neighbors in order, so the scores do not depend on the number of
+	// threads
+	dataset->PrepareMissingBitmaps();
+	PresentValues<Metric> presentDiff(diff);
+	unsigned int numIndices = indices.size();
+	unsigned int blockSize = ScoreBlockSize(numIndices);
+	int numBlocks = (numIndices + blockSize - 1) / blockSize;
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int block = 0; block < numBlocks; ++block) {
+		unsigned int blockStart = block * blockSize;
+		unsigned int blockEnd = blockStart + blockSize;
+		if (blockEnd > numIndices) {
+			blockEnd = numIndices;
+		}
+		// attributes missing in no instance skip the missing value checks; each
+		// attribute is still added to once per neighbor, in order
+		vector<unsigned int> presentPositions;
+		vector<unsigned int> checkPositions;
+		for (unsigned int idx = blockStart; idx < blockEnd; ++idx) {
+			if (dataset->IsMissingInAnyInstance(attributeType, indices[idx])) {
+				checkPositions.push_back(idx);
+			} else {
+				presentPositions.push_back(idx);
+			}
+		}
+		for (unsigned int i = 0; i < m; i++) {
+			const InfluencedNeighbors& sample = samples[i];
+			DatasetInstance* R_i = sample.instance;
+			for (unsigned int j = 0; j < k; ++j) {
+				DatasetInstance* I_j = sample.neighbors[j];
+				double diffPredicted = sample.diffPredicted[j];
+				double d_ij = sample.influences[j];
+				for (unsigned int p = 0; p < presentPositions.size(); ++p) {
+					unsigned int idx = presentPositions[p];
+					double score = presentDiff(indices[idx], R_i, I_j) * d_ij;
+					unsigned int scoresIndex = firstScore + idx;
+					nda[scoresIndex] += score;
+					ndcda[scoresIndex] += (diffPredicted * score);
+				}
+				for (unsigned int p = 0; p < checkPositions.size(); ++p) {
+					unsigned int idx = checkPositions[p];
+					double score = diff(indices[idx], R_i, I_j) * d_ij;
+					unsigned int scoresIndex = firstScore + idx;
+					nda[scoresIndex] += score;
+					ndcda[scoresIndex] += (diffPredicted * score);
+				}
+			}
+		}
+	}
+}
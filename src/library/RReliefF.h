@@ -30,6 +30,8 @@
 
 namespace po = boost::program_options;
 
+struct InfluencedNeighbors;
+
 class RReliefF : public ReliefF
 {
 public:
@@ -52,7 +54,27 @@ public:
   RReliefF(Dataset* ds, ConfigMap& configMap);
   bool ComputeAttributeScores();
   virtual ~RReliefF();
-private:  
+private:
+  /*************************************************************************//**
+   * Add the influence weighted diffs of some attributes to the nda and ndcda
+   * sums, in blocks of attributes, in parallel. Instantiated per metric
+   * policy so the diff is inlined; see DistanceMetricPolicies.h. Attributes
+   * missing in no instance skip the missing value checks.
+   * \param [in] diff metric policy for these attributes
+   * \param [in] samples sampled instances with their nearest neighbors
+   * \param [in] indices discrete or numeric attribute indices
+   * \param [in] firstScore scores index of the first attribute
+   * \param [in,out] nda sums of attribute diffs
+   * \param [in,out] ndcda sums of attribute and predicted value diffs
+   * \param [in] attributeType DISCRETE_TYPE or NUMERIC_TYPE indices
+   ****************************************************************************/
+  template<class Metric>
+  void UpdateNeighborScores(Metric diff,
+                            const std::vector<InfluencedNeighbors>& samples,
+                            const std::vector<unsigned int>& indices,
+                            unsigned int firstScore, std::vector<double>& nda,
+                            std::vector<double>& ndcda,
+                            AttributeType attributeType);
 };
 
 #endif	/* RRELIEFF_H */
@@ -385,7 +385,7 @@ AttributeScores RandomJungle::ComputeScores() {
 		unsigned int j = 0;
 		for (unsigned int aIdx = 0; aIdx < attrIndices.size(); aIdx++) {
 			AttributeLevel A =
-					dataset->GetInstance(instanceIndex)->attributes[attrIndices[aIdx]];
+					dataset->GetInstance(instanceIndex)->GetAttribute(attrIndices[aIdx]);
 			data->set(i, j, static_cast<double>(A));
 			++j;
 		}
@@ -14,17 +14,21 @@
 #include <iterator>
 #include <cmath>
 #include <sstream>
+#include <algorithm>
+#include <climits>
 
 #include <omp.h>
 
 #include <boost/program_options.hpp>
-#include <boost/unordered_map.hpp>
 
 #include "ReliefF.h"
 #include "Dataset.h"
 #include "DatasetInstance.h"
 #include "StringUtils.h"
 #include "DistanceMetrics.h"
+#include "DistanceMetricPolicies.h"
+#include "PairwiseDistances.h"
+#include "DistanceMatrix.h"
 #include "Insilico.h"
 
 namespace po = boost::program_options;
@@ -52,6 +56,66 @@ bool attributeSort(const pair<unsigned int, double>& p1,
 	return p1.first < p2.first;
 }
 
+/// a sampled instance with its nearest neighbors, gathered before updates
+struct SampledNeighbors {
+	/// the sampled instance R_i and its data set index
+	DatasetInstance* instance;
+	unsigned int instanceIndex;
+	/// k nearest hits and their indices
+	vector<DatasetInstance*> hits;
+	vector<unsigned int> hitIndices;
+	/// P(C) / (1 - P(class(R_i))) for each miss class C
+	vector<double> missFactors;
+	/// k nearest misses of each miss class and their indices
+	vector<vector<DatasetInstance*> > misses;
+	vector<vector<unsigned int> > missIndices;
+};
+
+typedef GenotypeBitPlanes::BitPlaneWord BitPlaneWord;
+
+/// Add one to the bit-sliced counters of the attributes set in a word.
+static inline void AddToCounters(BitPlaneWord bits, BitPlaneWord* counters,
+		unsigned int numCounterPlanes) {
+	for (unsigned int plane = 0; bits && (plane < numCounterPlanes); ++plane) {
+		BitPlaneWord carry = counters[plane] & bits;
+		counters[plane] ^= bits;
+		bits = carry;
+	}
+}
+
+/// Read one attribute's count from bit-sliced counters.
+static inline unsigned int CounterValue(const BitPlaneWord* counters,
+		unsigned int numCounterPlanes, unsigned int bit) {
+	unsigned int count = 0;
+	for (unsigned int plane = 0; plane < numCounterPlanes; ++plane) {
+		count |= (unsigned int) ((counters[plane] >> bit) & 1) << plane;
+	}
+	return count;
+}
+
+/// Count the GM mismatches of an instance with its neighbors, per attribute
+/// of a bit plane word, and collect the attributes missing in any of them.
+static inline void CountMismatches(const GenotypeBitPlanes& planes,
+		unsigned int instanceIndex, const vector<unsigned int>& neighborIndices,
+		size_t word, BitPlaneWord* counters, unsigned int numCounterPlanes,
+		BitPlaneWord& anyMissing) {
+	for (unsigned int plane = 0; plane < numCounterPlanes; ++plane) {
+		counters[plane] = 0;
+	}
+	for (unsigned int j = 0; j < neighborIndices.size(); ++j) {
+		BitPlaneWord missing = 0;
+		AddToCounters(
+				planes.MismatchWord(instanceIndex, neighborIndices[j], word, missing),
+				counters, numCounterPlanes);
+		anyMissing |= missing;
+	}
+}
+
+/// most attributes per block in the parallel score updates
+static const unsigned int MAX_SCORE_BLOCK_SIZE = 64;
+/// score blocks per thread to aim for, to balance the threads
+static const unsigned int SCORE_BLOCKS_PER_THREAD = 4;
+
 /// functor for T comparison
 typedef pair<unsigned int, DatasetInstance*> T;
 
@@ -64,7 +128,8 @@ public:
 };
 
 ReliefF::ReliefF(Dataset* ds, AnalysisType anaType):
-		AttributeRanker::AttributeRanker(ds) {
+		AttributeRanker::AttributeRanker(ds), pairwiseDistances(ds),
+		approximateNeighbors(ds, &pairwiseDistances), neighborCache(ds) {
 	cout << Timestamp() << "ReliefF default initialization without "
 			<< "configuration parameters" << endl;
 	if (ds) {
@@ -83,6 +148,8 @@ ReliefF::ReliefF(Dataset* ds, AnalysisType anaType):
 	numMetric = "manhattan";
 	numDiff = diffManhattan;
 	removePerIteration = 0;
+	keepDistances = false;
+	neighborSearch = "exact";
 
 	cout << Timestamp() << "Number of samples: m = " << m << endl;
 	randomlySelect = true;
@@ -118,7 +185,8 @@ ReliefF::ReliefF(Dataset* ds, AnalysisType anaType):
 }
 
 ReliefF::ReliefF(Dataset* ds, po::variables_map& vm, AnalysisType anaType):
-				AttributeRanker::AttributeRanker(ds)  {
+				AttributeRanker::AttributeRanker(ds), pairwiseDistances(ds),
+				approximateNeighbors(ds, &pairwiseDistances), neighborCache(ds)  {
 	cout << Timestamp() << "ReliefF initialization with boost command "
 			<< "line parameters:" << endl;
 	if (ds) {
@@ -142,6 +210,26 @@ ReliefF::ReliefF(Dataset* ds, po::variables_map& vm, AnalysisType anaType):
 	} else {
 		SetK(10);
 	}
+	neighborSearch = "exact";
+	if (vm.count("neighbor-search")) {
+		double recallTarget = approximateNeighbors.GetRecallTarget();
+		if (vm.count("neighbor-recall")) {
+			recallTarget = vm["neighbor-recall"].as<double>();
+		}
+		if (!SetNeighborSearch(vm["neighbor-search"].as<string>(),
+				recallTarget)) {
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (vm.count("neighbor-cache")
+			&& !SetNeighborCache(vm["neighbor-cache"].as<string>())) {
+		exit(EXIT_FAILURE);
+	}
+	if (vm.count("input-distance-matrix")
+			&& !SetInputDistanceMatrix(
+					vm["input-distance-matrix"].as<string>())) {
+		exit(EXIT_FAILURE);
+	}
 	snpMetric = "gm";
 	if (vm.count("snp-metric")) {
 		snpMetric = vm["snp-metric"].as<string>();
@@ -156,6 +244,7 @@ ReliefF::ReliefF(Dataset* ds, po::variables_map& vm, AnalysisType anaType):
 		numMetric = "manhattan";
 	}
 	removePerIteration = 0;
+	keepDistances = false;
 	if (vm.count("iter-remove-n")) {
 		removePerIteration = vm["iter-remove-n"].as<unsigned int>();
 		if ((removePerIteration < 1)
@@ -280,7 +369,8 @@ ReliefF::ReliefF(Dataset* ds, po::variables_map& vm, AnalysisType anaType):
 }
 
 ReliefF::ReliefF(Dataset* ds, ConfigMap& configMap, AnalysisType anaType):
-				AttributeRanker::AttributeRanker(ds)  {
+				AttributeRanker::AttributeRanker(ds), pairwiseDistances(ds),
+				approximateNeighbors(ds, &pairwiseDistances), neighborCache(ds)  {
 	cout << Timestamp() << "ReliefF initialization with configuration map:"
 			<< endl;
 	if (ds) {
@@ -306,6 +396,25 @@ ReliefF::ReliefF(Dataset* ds, ConfigMap& configMap, AnalysisType anaType):
 	} else {
 		SetK(10);
 	}
+	neighborSearch = "exact";
+	if (GetConfigValue(configMap, "neighbor-search", configValue)) {
+		string newNeighborSearch = configValue;
+		double recallTarget = approximateNeighbors.GetRecallTarget();
+		if (GetConfigValue(configMap, "neighbor-recall", configValue)) {
+			recallTarget = lexical_cast<double>(configValue);
+		}
+		if (!SetNeighborSearch(newNeighborSearch, recallTarget)) {
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (GetConfigValue(configMap, "neighbor-cache", configValue)
+			&& !SetNeighborCache(configValue)) {
+		exit(EXIT_FAILURE);
+	}
+	if (GetConfigValue(configMap, "input-distance-matrix", configValue)
+			&& !SetInputDistanceMatrix(configValue)) {
+		exit(EXIT_FAILURE);
+	}
 	if (GetConfigValue(configMap, "snp-metric", configValue)) {
 		snpMetric = configValue;
 	} else {
@@ -321,6 +430,7 @@ ReliefF::ReliefF(Dataset* ds, ConfigMap& configMap, AnalysisType anaType):
 	}
 
 	removePerIteration = 0;
+	keepDistances = false;
 	if (GetConfigValue(configMap, "iter-remove-n", configValue)) {
 		removePerIteration = lexical_cast<unsigned int>(configValue);
 		if ((removePerIteration < 1)
@@ -459,33 +569,29 @@ ReliefF::~ReliefF() {
 
 bool ReliefF::ComputeAttributeScores() {
 
-	// changed from matrix to map for ID matching - November 2011
-	PreComputeDistances();
+	// draw the samples first, so only their nearest neighbors are needed
+	vector<unsigned int> sampleIndices;
+	if (!SampleInstances(sampleIndices)) {
+		return false;
+	}
+	if (!PreComputeDistances(sampleIndices)) {
+		return false;
+	}
 
 	/// algorithm line 1
 	W.resize(dataset->NumVariables(), 0.0);
 
-	// pointer to the instance being sampled
-	DatasetInstance* R_i;
-	int i = 0;
 	cout << Timestamp() << "Running Relief-F algorithm" << endl;
 	cout << Timestamp() << "Averaging factor 1/(m*k): " << setprecision(6)
 			<< one_over_m_times_k << endl;
 
-	vector<string> instanceIds = dataset->GetInstanceIds();
-	/// algorithm line 2
-	for (i = 0; i < (int) m; i++) {
+	/// algorithm lines 2 to 6
+	// gather every sample's k nearest hits and misses and the class prior
+	// adjustment factors of its miss classes before updating any weights
+	vector<SampledNeighbors> samples(m);
+	for (unsigned int i = 0; i < m; i++) {
 		// algorithm line 3
-		if (randomlySelect) {
-			// randomly sample an instance (without replacement?)
-			R_i = dataset->GetRandomInstance();
-		} else {
-			// deterministic/indexed instance sampling, ie, every instance against
-			// every other instance
-			unsigned int instanceIndex;
-			dataset->GetInstanceIndexForID(instanceIds[i], instanceIndex);
-			R_i = dataset->GetInstance(instanceIndex);
-		}
+		DatasetInstance* R_i = dataset->GetInstance(sampleIndices[i]);
 		if (!R_i) {
 			cerr
 					<< "ERROR: Random or indexed instance count not be found for index: ["
@@ -500,21 +606,6 @@ bool ReliefF::ComputeAttributeScores() {
 		map<ClassLevel, vector<unsigned int> > misses;
 		bool canGetNeighbors = false;
 		canGetNeighbors = R_i->GetNNearestInstances(k, hits, misses);
-		//    cout << "Instance class: " << R_i->GetClass() << ", hits: ";
-		//    for(unsigned int ii = 0; ii < hits.size(); ++ii) {
-		//      cout << hits[ii] << " ";
-		//    }
-		//    cout << endl << "Misses:" << endl;
-		//    map<ClassLevel, vector<unsigned int> >::const_iterator iit;
-		//    for(iit = misses.begin(); iit != misses.end(); ++iit) {
-		//      cout << "Class: " << iit->first << ", misses: ";
-		//      vector<unsigned int> ids = iit->second;
-		//      for(unsigned int jj = 0; jj < ids.size(); ++jj) {
-		//        cout << ids[jj] << " ";
-		//      }
-		//      cout << endl;
-		//    }
-
 		if (!canGetNeighbors) {
 			cerr << "ERROR: relieff cannot get " << k << " nearest neighbors"
 					<< endl;
@@ -531,9 +622,17 @@ bool ReliefF::ComputeAttributeScores() {
 					<< endl;
 			exit(1);
 		}
+		SampledNeighbors& sample = samples[i];
+		sample.instance = R_i;
+		sample.instanceIndex = sampleIndices[i];
+		for (unsigned int j = 0; j < k; j++) {
+			sample.hits.push_back(dataset->GetInstance(hits[j]));
+			sample.hitIndices.push_back(hits[j]);
+		}
+		double P_C_R = dataset->GetClassProbability(class_R_i);
 		map<ClassLevel, vector<unsigned int> >::const_iterator it;
 		for (it = misses.begin(); it != misses.end(); ++it) {
-			vector<unsigned int> missIds = it->second;
+			const vector<unsigned int>& missIds = it->second;
 			if (missIds.size() < 1) {
 				cerr << "ERROR: No nearest misses found" << endl;
 				return false;
@@ -549,88 +648,74 @@ bool ReliefF::ComputeAttributeScores() {
 						<< hits.size() << " vs. " << misses.size() << endl;
 				return false;
 			}
+			double P_C = dataset->GetClassProbability(it->first);
+			sample.missFactors.push_back(P_C / (1.0 - P_C_R));
+			sample.misses.push_back(vector<DatasetInstance*>());
+			sample.missIndices.push_back(vector<unsigned int>());
+			for (unsigned int j = 0; j < k; j++) {
+				sample.misses.back().push_back(dataset->GetInstance(missIds[j]));
+				sample.missIndices.back().push_back(missIds[j]);
+			}
 		}
+	}
 
-		// UPDATE WEIGHTS FOR ATTRIBUTE 'A' BASED ON THIS AND NEIGHBORING INSTANCES
-		// update weights/relevance scores for each attribute averaged
-		// across k nearest neighbors and m (possibly randomly) selected instances
-		unsigned int A = 0;
-		unsigned int scoresIdx = 0;
-		if (dataset->HasGenotypes()) {
-			vector<unsigned int> attributeIndicies =
-					dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
-			/// algorithm line 7
-			for (unsigned int attrIdx = 0; attrIdx < attributeIndicies.size();
-					++attrIdx) {
-				A = attributeIndicies[attrIdx];
-				double hitSum = 0.0, missSum = 0.0;
-				/// algorithm line 8
-				for (unsigned int j = 0; j < k; j++) {
-					DatasetInstance* H_j = dataset->GetInstance(hits[j]);
-					double rawDistance = snpDiff(A, R_i, H_j);
-					hitSum += (rawDistance * one_over_m_times_k);
-				}
-				/// algorithm line 9
-				map<ClassLevel, vector<unsigned int> >::const_iterator mit;
-				for (mit = misses.begin(); mit != misses.end(); ++mit) {
-					ClassLevel C = mit->first;
-					vector<unsigned int> missIds = mit->second;
-					double P_C = dataset->GetClassProbability(C);
-					double P_C_R = dataset->GetClassProbability(class_R_i);
-					double adjustmentFactor = P_C / (1.0 - P_C_R);
-					double tempSum = 0.0;
-					for (unsigned int j = 0; j < k; j++) {
-						DatasetInstance* M_j = dataset->GetInstance(missIds[j]);
-						double rawDistance = snpDiff(A, R_i, M_j);
-						tempSum += (rawDistance * one_over_m_times_k);
-					} // nearest neighbors
-					missSum += (adjustmentFactor * tempSum);
-				}
-
-				W[scoresIdx] = W[scoresIdx] - hitSum + missSum;
-				++scoresIdx;
-			} // all attributes
-		} // has genotypes
-
-		// loop here for numeric attributes if they exist - 6/19/11
-		if (dataset->HasNumerics()) {
-			vector<unsigned int> numericIndices =
-					dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
-			for (unsigned int numIdx = 0; numIdx < numericIndices.size();
-					++numIdx) {
-				A = numericIndices[numIdx];
-				double hitSum = 0.0, missSum = 0.0;
-				for (unsigned int j = 0; j < k; j++) {
-					DatasetInstance* H_j = dataset->GetInstance(hits[j]);
-					hitSum += (numDiff(A, R_i, H_j) * one_over_m_times_k);
-				}
-
-				map<ClassLevel, vector<unsigned int> >::const_iterator mit;
-				for (mit = misses.begin(); mit != misses.end(); ++mit) {
-					ClassLevel C = mit->first;
-					vector<unsigned int> missIds = mit->second;
-					double P_C = dataset->GetClassProbability(C);
-					double P_C_R = dataset->GetClassProbability(class_R_i);
-					double adjustmentFactor = P_C / (1.0 - P_C_R);
-					double tempSum = 0.0;
-					for (unsigned int j = 0; j < k; j++) {
-						DatasetInstance* M_j = dataset->GetInstance(missIds[j]);
-						tempSum += (numDiff(A, R_i, M_j) * one_over_m_times_k);
-					} // nearest neighbors
-					missSum += (adjustmentFactor * tempSum);
-				}
-				W[scoresIdx] = W[scoresIdx] - hitSum + missSum;
-				++scoresIdx;
+	// UPDATE WEIGHTS FOR ATTRIBUTE 'A' BASED ON THIS AND NEIGHBORING INSTANCES
+	// update weights/relevance scores for each attribute averaged
+	// across k nearest neighbors and m (possibly randomly) selected instances.
+	// Threads take blocks of attributes; each attribute still sums the samples
+	// in order, so the weights do not depend on the number of threads.
+	vector<unsigned int> attributeIndices;
+	if (dataset->HasGenotypes()) {
+		attributeIndices = dataset->MaskGetAttributeIndices(DISCRETE_TYPE);
+	}
+	vector<unsigned int> numericIndices;
+	if (dataset->HasNumerics()) {
+		numericIndices = dataset->MaskGetAttributeIndices(NUMERIC_TYPE);
+	}
+	unsigned int numAttributes = attributeIndices.size();
+	// one template instance per metric inlines the diff into the score loop;
+	// GM scores of discrete attributes come from mismatch counts instead
+	if (numAttributes) {
+		if (snpDiff == diffGMM) {
+			if (dataset->PrepareGenotypeBitPlanes()) {
+				UpdateMismatchScores(samples, attributeIndices);
+			} else {
+				UpdateScores(GMMetric(), samples, attributeIndices, 0,
+						DISCRETE_TYPE);
 			}
-		} // has numerics
-
-		// happy lights
-		if (i && ((i % 100) == 0)) {
-			cout << Timestamp() << i << "/" << m << endl;
+		} else if (snpDiff == diffAMM) {
+			UpdateScores(AMMetric(), samples, attributeIndices, 0,
+					DISCRETE_TYPE);
+		} else if (snpDiff == diffNCA) {
+			dataset->PrepareNucleotideCountTables();
+			UpdateScores(NCAMetric(), samples, attributeIndices, 0,
+					DISCRETE_TYPE);
+		} else if (snpDiff == diffNCA6) {
+			dataset->PrepareNucleotideCountTables();
+			UpdateScores(NCA6Metric(), samples, attributeIndices, 0,
+					DISCRETE_TYPE);
+		} else if (snpDiff == diffKM) {
+			UpdateScores(KMMetric(), samples, attributeIndices, 0,
+					DISCRETE_TYPE);
+		} else {
+			UpdateScores(PointerMetric(snpDiff), samples, attributeIndices, 0,
+					DISCRETE_TYPE);
 		}
-
-	} // number to randomly select
-	cout << Timestamp() << i << "/" << m << " done" << endl;
+	}
+	/// numeric attributes are scored after the discrete ones
+	if (numericIndices.size()) {
+		if (numDiff == diffManhattan) {
+			UpdateScores(ManhattanMetric(), samples, numericIndices, numAttributes,
+					NUMERIC_TYPE);
+		} else if (numDiff == diffEuclidean) {
+			UpdateScores(EuclideanMetric(), samples, numericIndices, numAttributes,
+					NUMERIC_TYPE);
+		} else {
+			UpdateScores(PointerMetric(numDiff), samples, numericIndices,
+					numAttributes, NUMERIC_TYPE);
+		}
+	}
+	cout << Timestamp() << m << "/" << m << " done" << endl;
 
 	return true;
 }
@@ -640,6 +725,10 @@ bool ReliefF::ComputeAttributeScoresIteratively() {
 	// save the current dataset mask
 	dataset->MaskPushAll();
 
+	// keep the pair distances and subtract the removed attributes each time
+	bool savedKeepDistances = keepDistances;
+	keepDistances = true;
+
 	// IterativeReliefF or TuRF (Tuned Relief-F)
 	unsigned int iterations = 1;
 	while (dataset->NumVariables() > 0) {
@@ -675,6 +764,10 @@ bool ReliefF::ComputeAttributeScoresIteratively() {
 				cerr << "ERROR: ReliefF::ComputeAttributeScoresIteratively: "
 						<< "could not find attribute name in data set: "
 						<< attributeToDelete << endl;
+				keepDistances = savedKeepDistances;
+				if (!keepDistances) {
+					pairwiseDistances.ClearDistances();
+				}
 				return false;
 			}
 			finalScores[attributeToDelete] = attributeScores[i].first;
@@ -682,8 +775,13 @@ bool ReliefF::ComputeAttributeScoresIteratively() {
 
 		++iterations;
 
-		ResetForNextIteration();
+		// no ResetForNextIteration: ComputeAttributeScores updates the kept
+		// distances for the removed attributes and finds the neighbors again
 	} // iterate
+	keepDistances = savedKeepDistances;
+	if (!keepDistances) {
+		pairwiseDistances.ClearDistances();
+	}
 
 	// populate finalScores with remaining scores
 	vector<double>::const_iterator scoresIt;
@@ -751,140 +849,126 @@ void ReliefF::WriteAttributeScores(string baseFilename) {
 
 bool ReliefF::PreComputeDistances() {
 	cout << Timestamp() << "Precomputing instance distances" << endl;
-	map<string, unsigned int> instanceMask = dataset->MaskGetInstanceMask();
-	vector<string> instanceIds = dataset->MaskGetInstanceIds();
-	int numInstances = instanceIds.size();
-
-	// create a distance matrix
-	cout << Timestamp() << "Allocating distance matrix";
-	double** distanceMatrix;
-	distanceMatrix = new double*[numInstances];
-	for (int i = 0; i < numInstances; ++i) {
-		distanceMatrix[i] = new double[numInstances];
-		for (int j = 0; j < numInstances; ++j) {
-			distanceMatrix[i][j] = 0.0;
-		}
-	}
-	cout << " done" << endl;
-
-	// populate the matrix - upper triangular
-	// NOTE: make complete symmetric matrix for neighbor-to-neighbor sums
-	cout << Timestamp() << "1) Computing instance-to-instance distances... "
-			<< endl;
-	//  omp_set_nested(1);
-#pragma omp parallel for schedule(dynamic, 1)
-	for (int i = 0; i < numInstances; ++i) {
-		// cout << "Computing instance to instance distances. Row: " << i << endl;
-		// #pragma omp parallel for
-		for (int j = i + 1; j < numInstances; ++j) {
-			unsigned int dsi1Index;
-			dataset->GetInstanceIndexForID(instanceIds[i], dsi1Index);
-			unsigned int dsi2Index;
-			dataset->GetInstanceIndexForID(instanceIds[j], dsi2Index);
-			distanceMatrix[i][j] = distanceMatrix[j][i] =
-					dataset->ComputeInstanceToInstanceDistance(
-							dataset->GetInstance(dsi1Index),
-							dataset->GetInstance(dsi2Index));
-			// cout << i << ", " << j << " => " << distanceMatrix[i][j] << endl;
-		}
-		if (i && (i % 100 == 0)) {
-			cout << Timestamp() << i << "/" << numInstances << endl;
-		}
-	}
-	cout << Timestamp() << numInstances << "/" << numInstances << " done"
-			<< endl;
+	vector<unsigned int> instanceIndices = dataset->MaskGetInstanceIndices();
 
-	//  DEBUG
-	//  ofstream outFile;
-	//  outFile.open("distanceMatrix.csv");
-	//  for(unsigned int i=0; i < dataset->NumInstances(); ++i) {
-	//    for(unsigned int j=0; j < dataset->NumInstances(); ++j) {
-	//      if(j)
-	//        outFile << "," << distanceMatrix[i][j];
-	//      else
-	//        outFile << distanceMatrix[i][j];
-	//    }
-	//    outFile << endl;
-	//  }
-	//  outFile.close();
-	//  DEBUG
-
-	// for each instance: if discrete class, store the distance sums for same
-	// and different classes, else store distances to all other instances
-	// (regression ReliefF)
+	// distances go straight into bounded nearest neighbor selections for each
+	// instance; the n x n distance matrix is never stored
 	if (dataset->HasContinuousPhenotypes()) {
 		cout << Timestamp()
-				<< "2) Calculating continuous phenotype nearest neighbors... ";
+				<< "1) Computing distances and continuous phenotype nearest neighbors... ";
 	} else {
 		// multiclass - 12/1/11
 		if (dataset->NumClasses() > 2) {
 			cout << Timestamp()
-					<< "2) Calculating same and different classes nearest neighbors... ";
+					<< "1) Computing distances and same and different classes nearest neighbors... ";
 		} else {
 			cout << Timestamp()
-					<< "2) Calculating same and different class nearest neighbors... ";
+					<< "1) Computing distances and same and different class nearest neighbors... ";
 		}
 	}
 	cout << endl;
-
-	DistancePair nnInfo;
-	for (int i = 0; i < numInstances; ++i) {
-		unsigned int thisInstanceIndex = instanceMask[instanceIds[i]];
-		DatasetInstance* thisInstance = dataset->GetInstance(thisInstanceIndex);
-
-		if (dataset->HasContinuousPhenotypes()) {
-			DistancePairs instanceDistances;
-			for (int j = 0; j < numInstances; ++j) {
-				if (i == j)
-					continue;
-				double instanceToInstanceDistance = distanceMatrix[i][j];
-				DistancePair nearestNeighborInfo;
-				nearestNeighborInfo = make_pair(instanceToInstanceDistance,
-						instanceIds[j]);
-				instanceDistances.push_back(nearestNeighborInfo);
+	bool neighborsFound = false;
+	if (inputDistances.Size()) {
+		// given distances replace all distance computations
+		neighborsFound = pairwiseDistances.SelectNearestNeighbors(inputDistances,
+				inputDistanceRows, instanceIndices, instanceIndices, k);
+	} else {
+		string searchName = NeighborSearchName();
+		neighborsFound = neighborCache.Load(instanceIndices, instanceIndices, k,
+				searchName);
+		if (!neighborsFound) {
+			if (neighborSearch == "lsh") {
+				neighborsFound = approximateNeighbors.ComputeNearestNeighbors(
+						instanceIndices, instanceIndices, k);
+			} else if (keepDistances) {
+				neighborsFound = pairwiseDistances.UpdateNearestNeighbors(
+						instanceIndices, k);
+			} else {
+				neighborsFound = pairwiseDistances.ComputeNearestNeighbors(
+						instanceIndices, k);
 			}
-			thisInstance->SetDistanceSums(k, instanceDistances);
-		} else {
-			ClassLevel thisClass = thisInstance->GetClass();
-			DistancePairs sameSums;
-			// changed to an array for multiclass - 12/1/11
-			map<ClassLevel, DistancePairs> diffSums;
-			for (int j = 0; j < numInstances; ++j) {
-				if (i == j)
-					continue;
-				double instanceToInstanceDistance = distanceMatrix[i][j];
-				unsigned int otherInstanceIndex = instanceMask[instanceIds[j]];
-				DatasetInstance* otherInstance = dataset->GetInstance(
-						otherInstanceIndex);
-				nnInfo = make_pair(instanceToInstanceDistance, instanceIds[j]);
-				if (otherInstance->GetClass() == thisClass) {
-					sameSums.push_back(nnInfo);
-				} else {
-					ClassLevel otherClass = otherInstance->GetClass();
-					diffSums[otherClass].push_back(nnInfo);
-				}
+			if (neighborsFound && neighborCache.IsEnabled()) {
+				neighborCache.Save(instanceIndices, instanceIndices, k, searchName);
 			}
-			thisInstance->SetDistanceSums(k, sameSums, diffSums);
-		}
-
-		if (i && (i % 100 == 0)) {
-			cout << Timestamp() << i << "/" << numInstances << endl;
 		}
 	}
-	cout << Timestamp() << numInstances << "/" << numInstances << " done"
-			<< endl;
+	if (!neighborsFound) {
+		cerr << "ERROR: Could not compute instance nearest neighbors" << endl;
+		return false;
+	}
+	cout << Timestamp() << instanceIndices.size() << "/"
+			<< instanceIndices.size() << " done" << endl;
 
-	cout << Timestamp() << "3) Calculating weight by distance factors for "
+	cout << Timestamp() << "2) Calculating weight by distance factors for "
 			<< "nearest neighbors... " << endl;
 	ComputeWeightByDistanceFactors();
 
-	// release the dynamically-allocated distance matrix
-	cout << Timestamp() << "Freeing distance matrix memory";
-	for (int i = 0; i < numInstances; ++i) {
-		delete[] distanceMatrix[i];
+	return true;
+}
+
+bool ReliefF::PreComputeDistances(const vector<unsigned int>& sampleIndices) {
+	vector<unsigned int> instanceIndices = dataset->MaskGetInstanceIndices();
+
+	// distinct samples among the current instances
+	vector<unsigned int> sortedInstances(instanceIndices);
+	sort(sortedInstances.begin(), sortedInstances.end());
+	vector<unsigned int> sortedSamples(sampleIndices);
+	sort(sortedSamples.begin(), sortedSamples.end());
+	sortedSamples.erase(unique(sortedSamples.begin(), sortedSamples.end()),
+			sortedSamples.end());
+	vector<unsigned int> queryIndices;
+	set_intersection(sortedSamples.begin(), sortedSamples.end(),
+			sortedInstances.begin(), sortedInstances.end(),
+			back_inserter(queryIndices));
+
+	// m x n distances only pay off against the n x n / 2 of the full search,
+	// and not against kept distances that only need updating; approximate
+	// searches always hash all instances and look up only the samples, and
+	// given distances are only looked up for the samples
+	if ((neighborSearch != "lsh") && !inputDistances.Size()
+			&& ((keepDistances
+					&& pairwiseDistances.CanKeepDistances(instanceIndices.size()))
+					|| ((queryIndices.size() * 2) >= instanceIndices.size()))) {
+		return PreComputeDistances();
 	}
-	delete[] distanceMatrix;
-	cout << " done" << endl;
+
+	cout << Timestamp() << "Precomputing distances of " << queryIndices.size()
+			<< " sampled instances" << endl;
+	cout << Timestamp()
+			<< "1) Computing distances and sampled instance nearest neighbors... "
+			<< endl;
+	bool neighborsFound = false;
+	if (inputDistances.Size()) {
+		neighborsFound = pairwiseDistances.SelectNearestNeighbors(inputDistances,
+				inputDistanceRows, instanceIndices, queryIndices, k);
+	} else {
+		string searchName = NeighborSearchName();
+		neighborsFound = neighborCache.Load(instanceIndices, queryIndices, k,
+				searchName);
+		if (!neighborsFound) {
+			if (neighborSearch == "lsh") {
+				neighborsFound = approximateNeighbors.ComputeNearestNeighbors(
+						instanceIndices, queryIndices, k);
+			} else {
+				neighborsFound = pairwiseDistances.ComputeNearestNeighbors(
+						instanceIndices, queryIndices, k);
+			}
+			if (neighborsFound && neighborCache.IsEnabled()) {
+				neighborCache.Save(instanceIndices, queryIndices, k, searchName);
+			}
+		}
+	}
+	if (!neighborsFound) {
+		cerr << "ERROR: Could not compute sampled instance nearest neighbors"
+				<< endl;
+		return false;
+	}
+	cout << Timestamp() << queryIndices.size() << "/" << queryIndices.size()
+			<< " done" << endl;
+
+	cout << Timestamp() << "2) Calculating weight by distance factors for "
+			<< "nearest neighbors... " << endl;
+	ComputeWeightByDistanceFactors();
 
 	return true;
 }
@@ -892,41 +976,18 @@ bool ReliefF::PreComputeDistances() {
 bool ReliefF::PreComputeDistancesByMap() {
 
 	cout << Timestamp() << "Precomputing instance distances by map" << endl;
-	map<string, unsigned int> instanceMask = dataset->MaskGetInstanceMask();
-	vector<string> instanceIds = dataset->MaskGetInstanceIds();
-	int numInstances = instanceIds.size();
+	vector<unsigned int> instanceIndices = dataset->MaskGetInstanceIndices();
+	int numInstances = instanceIndices.size();
 
 	cout << Timestamp()
 			<< "1) Computing instance-to-instance distances in parallel... ";
-	boost::unordered_map<pair<string, string>, double> distanceMatrix;
-	//        ID1     ID2     dist
-	int i = 0;
-#ifdef WITH_OPENMP
-#pragma omp parallel for schedule(dynamic, 1)
-#endif
-	for (i = 0; i < numInstances; ++i) {
-		for (int j = i + 1; j < numInstances; ++j) {
-			string instanceId1 = instanceIds[i];
-			string instanceId2 = instanceIds[j];
-			unsigned int dsi1Index = instanceMask[instanceId1];
-			unsigned int dsi2Index = instanceMask[instanceId2];
-			pair<string, string> key = make_pair(instanceId1, instanceId2);
-			pair<string, string> symkey = make_pair(instanceId2, instanceId1);
-			double distance = dataset->ComputeInstanceToInstanceDistance(
-					dataset->GetInstance(dsi1Index),
-					dataset->GetInstance(dsi2Index));
-#ifdef WITH_OPENMP
-#pragma omp critical
-#endif
-			{
-				distanceMatrix[key] = distance;
-				//        cout << i << "," << j << " -> (" << key.first << "," << key.second
-				//             << ") => " << distanceMatrix[key] << endl;
-			}
-		}
-		if (i && (i % 100 == 0)) {
-			cout << Timestamp() << i << "/" << numInstances << endl;
-		}
+	// packed upper triangle, by position among the instances
+	DistanceMatrix distanceMatrix;
+	if (!distanceMatrix.Allocate(numInstances, DISTANCE_FLOAT64, true)
+			|| !pairwiseDistances.ComputeDistanceMatrix(instanceIndices,
+					distanceMatrix)) {
+		cerr << "ERROR: Could not compute instance distances" << endl;
+		return false;
 	}
 	cout << Timestamp() << numInstances << "/" << numInstances << " done"
 			<< endl;
@@ -945,24 +1006,22 @@ bool ReliefF::PreComputeDistancesByMap() {
 		}
 	}
 
-	pair<string, string> key;
-	DistancePair nnInfo;
-	double instanceToInstanceDistance;
-	for (i = 0; i < numInstances; ++i) {
-		unsigned int thisInstanceIndex = instanceMask[instanceIds[i]];
+	// instances find their neighbors in parallel; each one still sees the
+	// other instances in order, so the neighbors do not depend on the threads
+	int numDone = 0;
+#pragma omp parallel for schedule(dynamic, 16)
+	for (int i = 0; i < numInstances; ++i) {
+		DistancePair nnInfo;
+		double instanceToInstanceDistance;
+		unsigned int thisInstanceIndex = instanceIndices[i];
 		DatasetInstance* thisInstance = dataset->GetInstance(thisInstanceIndex);
 		if (dataset->HasContinuousPhenotypes()) {
 			DistancePairs instanceDistances;
 			for (int j = 0; j < numInstances; ++j) {
 				if (i == j)
 					continue;
-				if (j < i) {
-					key = make_pair(instanceIds[j], instanceIds[i]);
-				} else {
-					key = make_pair(instanceIds[i], instanceIds[j]);
-				}
-				instanceToInstanceDistance = distanceMatrix[key];
-				nnInfo = make_pair(instanceToInstanceDistance, instanceIds[j]);
+				instanceToInstanceDistance = distanceMatrix.Get(i, j);
+				nnInfo = make_pair(instanceToInstanceDistance, instanceIndices[j]);
 				instanceDistances.push_back(nnInfo);
 			}
 			thisInstance->SetDistanceSums(k, instanceDistances);
@@ -974,16 +1033,11 @@ bool ReliefF::PreComputeDistancesByMap() {
 			for (int j = 0; j < numInstances; ++j) {
 				if (i == j)
 					continue;
-				if (j < i) {
-					key = make_pair(instanceIds[j], instanceIds[i]);
-				} else {
-					key = make_pair(instanceIds[i], instanceIds[j]);
-				}
-				instanceToInstanceDistance = distanceMatrix[key];
-				unsigned int otherInstanceIndex = instanceMask[instanceIds[j]];
+				instanceToInstanceDistance = distanceMatrix.Get(i, j);
+				unsigned int otherInstanceIndex = instanceIndices[j];
 				DatasetInstance* otherInstance = dataset->GetInstance(
 						otherInstanceIndex);
-				nnInfo = make_pair(instanceToInstanceDistance, instanceIds[j]);
+				nnInfo = make_pair(instanceToInstanceDistance, instanceIndices[j]);
 				if (otherInstance->GetClass() == thisClass) {
 					sameSums.push_back(nnInfo);
 				} else {
@@ -994,8 +1048,12 @@ bool ReliefF::PreComputeDistancesByMap() {
 			thisInstance->SetDistanceSums(k, sameSums, diffSums);
 		}
 
-		if (i % 100 == 0) {
-			cout << Timestamp() << i << "/" << numInstances << endl;
+#pragma omp critical(PreComputeDistancesByMapProgress)
+		{
+			if (numDone % 100 == 0) {
+				cout << Timestamp() << numDone << "/" << numInstances << endl;
+			}
+			++numDone;
 		}
 	}
 	cout << Timestamp() << numInstances << "/" << numInstances << " done"
@@ -1026,6 +1084,13 @@ AttributeScores ReliefF::ComputeScores() {
 	return GetScores();
 }
 
+void ReliefF::SetKeepDistances(bool newKeepDistances) {
+	keepDistances = newKeepDistances;
+	if (!keepDistances) {
+		pairwiseDistances.ClearDistances();
+	}
+}
+
 bool ReliefF::SetK(unsigned int newK) {
 	map<ClassLevel, vector<unsigned int> > classLevels =
 			dataset->GetClassIndexes();
@@ -1051,6 +1116,273 @@ bool ReliefF::SetK(unsigned int newK) {
 	return true;
 }
 
+bool ReliefF::SetNeighborSearch(string newNeighborSearch,
+		double recallTarget) {
+	if ((newNeighborSearch != "exact") && (newNeighborSearch != "lsh")) {
+		cerr << "ERROR: Invalid --neighbor-search: " << newNeighborSearch
+				<< endl;
+		return false;
+	}
+	if ((newNeighborSearch == "lsh")
+			&& !approximateNeighbors.SetRecallTarget(recallTarget)) {
+		return false;
+	}
+	neighborSearch = newNeighborSearch;
+	cout << Timestamp() << "Nearest neighbor search: " << neighborSearch;
+	if (neighborSearch == "lsh") {
+		cout << ", recall target " << recallTarget;
+	}
+	cout << endl;
+
+	return true;
+}
+
+bool ReliefF::SetNeighborCache(string cacheDirectory) {
+	return neighborCache.SetDirectory(cacheDirectory);
+}
+
+bool ReliefF::SetInputDistanceMatrix(string matrixFilename) {
+	cout << Timestamp() << "Loading instance distances from ["
+			<< matrixFilename << "]" << endl;
+	vector<string> matrixIds;
+	if (!inputDistances.Load(matrixFilename, matrixIds)) {
+		return false;
+	}
+	map<string, unsigned int> matrixRowsById;
+	for (unsigned int i = 0; i < matrixIds.size(); ++i) {
+		if (!matrixRowsById.insert(make_pair(matrixIds[i], i)).second) {
+			cerr << "ERROR: Instance ID " << matrixIds[i]
+					<< " is in the distance matrix more than once" << endl;
+			inputDistances.Clear();
+			return false;
+		}
+	}
+
+	// every instance of the data set must have a row; others are ignored
+	const vector<string>& instanceIds = dataset->MaskGetInstanceIds();
+	const vector<unsigned int>& instanceIndices =
+			dataset->MaskGetInstanceIndices();
+	unsigned int numIndices = 0;
+	for (unsigned int i = 0; i < instanceIndices.size(); ++i) {
+		if (instanceIndices[i] >= numIndices) {
+			numIndices = instanceIndices[i] + 1;
+		}
+	}
+	inputDistanceRows.assign(numIndices, UINT_MAX);
+	for (unsigned int i = 0; i < instanceIds.size(); ++i) {
+		map<string, unsigned int>::const_iterator rowIt = matrixRowsById.find(
+				instanceIds[i]);
+		if (rowIt == matrixRowsById.end()) {
+			cerr << "ERROR: Instance ID " << instanceIds[i]
+					<< " is not in the distance matrix " << matrixFilename << endl;
+			inputDistances.Clear();
+			inputDistanceRows.clear();
+			return false;
+		}
+		inputDistanceRows[instanceIndices[i]] = rowIt->second;
+	}
+	cout << Timestamp() << "Matched " << instanceIds.size()
+			<< " instances to the " << matrixIds.size()
+			<< " distance matrix instances by ID" << endl;
+
+	return true;
+}
+
+string ReliefF::NeighborSearchName() {
+	ostringstream searchName;
+	searchName << neighborSearch;
+	if (neighborSearch == "lsh") {
+		searchName << " recall " << approximateNeighbors.GetRecallTarget();
+	}
+	return searchName.str();
+}
+
+bool ReliefF::SampleInstances(vector<unsigned int>& sampleIndices) {
+	sampleIndices.clear();
+	sampleIndices.reserve(m);
+	vector<string> instanceIds = dataset->GetInstanceIds();
+	for (unsigned int i = 0; i < m; ++i) {
+		if (randomlySelect) {
+			// randomly sample an instance (without replacement?)
+			sampleIndices.push_back(dataset->GetRandomInstanceIndex());
+		} else {
+			// deterministic/indexed instance sampling, ie, every instance against
+			// every other instance
+			unsigned int instanceIndex;
+			if (!dataset->GetInstanceIndexForID(instanceIds[i], instanceIndex)) {
+				cerr << "ERROR: Indexed instance could not be found for index: ["
+						<< i << "]" << endl;
+				return false;
+			}
+			sampleIndices.push_back(instanceIndex);
+		}
+	}
+
+	return true;
+}
+
+/// Sum an attribute's diffs between a sampled instance and its hits, and its
+/// misses weighted by class: algorithm lines 8 and 9.
+template<class Metric>
+static inline void SumNeighborDiffs(Metric diff, unsigned int A,
+		const SampledNeighbors& sample, unsigned int k,
+		double one_over_m_times_k, double& hitSum, double& missSum) {
+	DatasetInstance* R_i = sample.instance;
+	hitSum = 0.0;
+	missSum = 0.0;
+	/// algorithm line 8
+	for (unsigned int j = 0; j < k; j++) {
+		double rawDistance = diff(A, R_i, sample.hits[j]);
+		hitSum += (rawDistance * one_over_m_times_k);
+	}
+	/// algorithm line 9
+	for (unsigned int c = 0; c < sample.misses.size(); ++c) {
+		const vector<DatasetInstance*>& missInstances = sample.misses[c];
+		double tempSum = 0.0;
+		for (unsigned int j = 0; j < k; j++) {
+			double rawDistance = diff(A, R_i, missInstances[j]);
+			tempSum += (rawDistance * one_over_m_times_k);
+		} // nearest neighbors
+		missSum += (sample.missFactors[c] * tempSum);
+	}
+}
+
+template<class Metric>
+void ReliefF::UpdateScores(Metric diff, const vector<SampledNeighbors>& samples,
+		const vector<unsigned int>& indices, unsigned int firstScore,
+		AttributeType attributeType) {
+	// attributes missing in no instance skip the missing value checks
+	dataset->PrepareMissingBitmaps();
+	vector<char> checkMissing(indices.size());
+	for (unsigned int idx = 0; idx < indices.size(); ++idx) {
+		checkMissing[idx] = dataset->IsMissingInAnyInstance(attributeType,
+				indices[idx]);
+	}
+	PresentValues<Metric> presentDiff(diff);
+	unsigned int numIndices = indices.size();
+	unsigned int blockSize = ScoreBlockSize(numIndices);
+	int numBlocks = (numIndices + blockSize - 1) / blockSize;
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int block = 0; block < numBlocks; ++block) {
+		unsigned int blockStart = block * blockSize;
+		unsigned int blockEnd = blockStart + blockSize;
+		if (blockEnd > numIndices) {
+			blockEnd = numIndices;
+		}
+		/// algorithm line 2
+		for (unsigned int i = 0; i < m; i++) {
+			const SampledNeighbors& sample = samples[i];
+			/// algorithm line 7
+			for (unsigned int idx = blockStart; idx < blockEnd; ++idx) {
+				unsigned int A = indices[idx];
+				double hitSum, missSum;
+				if (checkMissing[idx]) {
+					SumNeighborDiffs(diff, A, sample, k, one_over_m_times_k, hitSum,
+							missSum);
+				} else {
+					SumNeighborDiffs(presentDiff, A, sample, k, one_over_m_times_k,
+							hitSum, missSum);
+				}
+
+				unsigned int scoresIdx = firstScore + idx;
+				W[scoresIdx] = W[scoresIdx] - hitSum + missSum;
+			} // block of attributes
+		} // number to randomly select
+	} // all attribute blocks
+}
+
+void ReliefF::UpdateMismatchScores(const vector<SampledNeighbors>& samples,
+		const vector<unsigned int>& attributeIndices) {
+	const GenotypeBitPlanes* planes = dataset->GetGenotypeBitPlanes();
+	GMMetric diff;
+	unsigned int numAttributes = attributeIndices.size();
+	// n mismatches add 1.0 * 1/(m*k) n times in sequence: the same sums the
+	// per attribute loop makes, whatever the order of the mismatches
+	vector<double> mismatchSums(k + 1, 0.0);
+	for (unsigned int n = 1; n <= k; ++n) {
+		mismatchSums[n] = mismatchSums[n - 1] + (1.0 * one_over_m_times_k);
+	}
+	unsigned int numCounterPlanes = 1;
+	while ((1u << numCounterPlanes) <= k) {
+		++numCounterPlanes;
+	}
+	unsigned int maxMissClasses = 0;
+	for (unsigned int i = 0; i < samples.size(); ++i) {
+		if (samples[i].misses.size() > maxMissClasses) {
+			maxMissClasses = samples[i].misses.size();
+		}
+	}
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int word = 0; word < (int) planes->NumWords(); ++word) {
+		unsigned int scoresStart = word * GenotypeBitPlanes::BITS_PER_PLANE_WORD;
+		unsigned int scoresEnd = scoresStart
+				+ GenotypeBitPlanes::BITS_PER_PLANE_WORD;
+		if (scoresEnd > numAttributes) {
+			scoresEnd = numAttributes;
+		}
+		vector<BitPlaneWord> hitCounters(numCounterPlanes);
+		vector<BitPlaneWord> missCounters(maxMissClasses * numCounterPlanes);
+		for (unsigned int i = 0; i < samples.size(); i++) {
+			const SampledNeighbors& sample = samples[i];
+			unsigned int numMissClasses = sample.misses.size();
+			// mismatches of each attribute with the hits and each miss class
+			BitPlaneWord anyMissing = 0;
+			CountMismatches(*planes, sample.instanceIndex, sample.hitIndices, word,
+					&hitCounters[0], numCounterPlanes, anyMissing);
+			for (unsigned int c = 0; c < numMissClasses; ++c) {
+				CountMismatches(*planes, sample.instanceIndex, sample.missIndices[c],
+						word, &missCounters[c * numCounterPlanes], numCounterPlanes,
+						anyMissing);
+			}
+			for (unsigned int scoresIdx = scoresStart; scoresIdx < scoresEnd;
+					++scoresIdx) {
+				unsigned int bit = scoresIdx - scoresStart;
+				double hitSum = 0.0, missSum = 0.0;
+				if ((anyMissing >> bit) & 1) {
+					// missing values add 2/3, which the counts do not reproduce
+					unsigned int A = attributeIndices[scoresIdx];
+					for (unsigned int j = 0; j < k; j++) {
+						double rawDistance = diff(A, sample.instance, sample.hits[j]);
+						hitSum += (rawDistance * one_over_m_times_k);
+					}
+					for (unsigned int c = 0; c < numMissClasses; ++c) {
+						double tempSum = 0.0;
+						for (unsigned int j = 0; j < k; j++) {
+							double rawDistance = diff(A, sample.instance,
+									sample.misses[c][j]);
+							tempSum += (rawDistance * one_over_m_times_k);
+						}
+						missSum += (sample.missFactors[c] * tempSum);
+					}
+				} else {
+					hitSum = mismatchSums[CounterValue(&hitCounters[0],
+							numCounterPlanes, bit)];
+					for (unsigned int c = 0; c < numMissClasses; ++c) {
+						missSum += (sample.missFactors[c]
+								* mismatchSums[CounterValue(&missCounters[c * numCounterPlanes],
+										numCounterPlanes, bit)]);
+					}
+				}
+
+				W[scoresIdx] = W[scoresIdx] - hitSum + missSum;
+			} // attributes of the word
+		} // samples
+	} // all words
+}
+
+unsigned int ReliefF::ScoreBlockSize(unsigned int numScores) {
+	unsigned int minBlocks = SCORE_BLOCKS_PER_THREAD * omp_get_max_threads();
+	unsigned int blockSize = (numScores + minBlocks - 1) / minBlocks;
+	if (blockSize > MAX_SCORE_BLOCK_SIZE) {
+		blockSize = MAX_SCORE_BLOCK_SIZE;
+	}
+	if (blockSize < 1) {
+		blockSize = 1;
+	}
+	return blockSize;
+}
+
 bool ReliefF::ComputeWeightByDistanceFactors() {
 
 	vector<string> instanceIds = dataset->GetInstanceIds();
@@ -26,10 +26,16 @@
 
 #include "AttributeRanker.h"
 #include "Dataset.h"
+#include "PairwiseDistances.h"
+#include "ApproximateNeighbors.h"
+#include "NeighborCache.h"
+#include "DistanceMatrix.h"
 #include "Insilico.h"
 
 namespace po = boost::program_options;
 
+struct SampledNeighbors;
+
 class ReliefF : public AttributeRanker
 {
 public:
@@ -76,22 +82,108 @@ public:
    * \param [in] baseFIlename filename to write score-attribute name pairs
    ****************************************************************************/
   void WriteAttributeScores(std::string baseFilename);
-  /// Precompute all pairwise instance-to-instance distances.
+  /// Find the nearest neighbors of every instance from pairwise distances.
   bool PreComputeDistances();
+  /*************************************************************************//**
+   * Find the nearest neighbors of only the sampled instances. When fewer
+   * than half the instances are sampled, only their rows of distances are
+   * computed: m x n distances instead of n x n.
+   * \param [in] sampleIndices data set indices of the sampled instances
+   * \return success
+   ****************************************************************************/
+  bool PreComputeDistances(const std::vector<unsigned int>& sampleIndices);
   /// Precompute all pairwise distances honoring excluded instances.
   bool PreComputeDistancesByMap();
   /// Overrides base class method.
   AttributeScores GetScores();
   /// Implements AttributeRanker interface.
   AttributeScores ComputeScores();
+  /*************************************************************************//**
+   * Keep the instance pair distances between calls to ComputeAttributeScores,
+   * for callers that remove attributes and score again, like EC. Removed
+   * attributes are then subtracted from the kept distances instead of
+   * computing all distances again. Off by default; on during
+   * ComputeAttributeScoresIteratively.
+   * \param [in] newKeepDistances keep the distances?
+   ****************************************************************************/
+  void SetKeepDistances(bool newKeepDistances);
   /// Set k nearest neighbors, with bounds checking
   bool SetK(unsigned int newK);
+  /*************************************************************************//**
+   * Choose the nearest neighbor search: "exact", the default, or "lsh" for
+   * ApproximateNeighbors' random projection hashing.
+   * \param [in] newNeighborSearch exact|lsh
+   * \param [in] recallTarget fraction of the exact neighbors lsh must find
+   * \return success
+   ****************************************************************************/
+  bool SetNeighborSearch(std::string newNeighborSearch, double recallTarget);
+  /*************************************************************************//**
+   * Cache the nearest neighbors of each search in a directory, and reuse
+   * them in later runs on the same data, see NeighborCache.
+   * \param [in] cacheDirectory existing directory; "" for no cache
+   * \return success
+   ****************************************************************************/
+  bool SetNeighborCache(std::string cacheDirectory);
+  /*************************************************************************//**
+   * Find nearest neighbors from a precomputed distance matrix instead of
+   * computing instance distances: a binary or text matrix from
+   * Dataset::CalculateDistanceMatrix or another tool, matched to the
+   * instances by ID. Its distances do not change as attributes are removed.
+   * \param [in] matrixFilename binary or text distance matrix file
+   * \return success
+   ****************************************************************************/
+  bool SetInputDistanceMatrix(std::string matrixFilename);
 private:
   /// no default constructor
   ReliefF();
 protected:
   /// Compute theconst AttributeScores& ComputeScores(); weight by distance factors for nearest neighbors.
   bool ComputeWeightByDistanceFactors();
+  /*************************************************************************//**
+   * Choose the m instances to score from, in the order they are used:
+   * random draws, or every instance in turn.
+   * \param [out] sampleIndices data set indices of the sampled instances
+   * \return success
+   ****************************************************************************/
+  bool SampleInstances(std::vector<unsigned int>& sampleIndices);
+  /// Nearest neighbor search and its settings, for the neighbor cache key.
+  std::string NeighborSearchName();
+  /*************************************************************************//**
+   * Number of scores per block when threads update blocks of scores. Each
+   * score is only updated by one thread, in sample order, so the scores do
+   * not depend on the block size or the number of threads.
+   * \param [in] numScores number of attribute scores
+   * \return scores per block
+   ****************************************************************************/
+  static unsigned int ScoreBlockSize(unsigned int numScores);
+  /*************************************************************************//**
+   * Update the scores of some attributes from the sampled instances and their
+   * neighbors: algorithm lines 7 to 9 in blocks of attributes, in parallel.
+   * Instantiated per metric policy so the diff is inlined; see
+   * DistanceMetricPolicies.h. Attributes missing in no instance skip the
+   * missing value checks.
+   * \param [in] diff metric policy for these attributes
+   * \param [in] samples sampled instances with their nearest neighbors
+   * \param [in] indices discrete or numeric attribute indices
+   * \param [in] firstScore scores index of the first attribute
+   * \param [in] attributeType DISCRETE_TYPE or NUMERIC_TYPE indices
+   ****************************************************************************/
+  template<class Metric>
+  void UpdateScores(Metric diff, const std::vector<SampledNeighbors>& samples,
+                    const std::vector<unsigned int>& indices,
+                    unsigned int firstScore, AttributeType attributeType);
+  /*************************************************************************//**
+   * Update the GM scores of the discrete attributes from the genotype bit
+   * planes, a word of attributes at a time. Each attribute's mismatches with
+   * the hits and with each miss class are counted with bit-sliced counters
+   * instead of computing the diff for every neighbor. Attributes with a
+   * missing value among the instances fall back to the diff. Requires
+   * current bit planes; scores are the same as the per attribute loop.
+   * \param [in] samples sampled instances with their nearest neighbors
+   * \param [in] attributeIndices discrete attributes in bit plane order
+   ****************************************************************************/
+  void UpdateMismatchScores(const std::vector<SampledNeighbors>& samples,
+                            const std::vector<unsigned int>& attributeIndices);
   /// type of analysis to perform
   AnalysisType analysisType;
   /*************************************************************************//**
@@ -126,6 +218,20 @@ protected:
   bool randomlySelect;
   /// k nearest neighbors
   unsigned int k;
+  /// pair distances and nearest neighbor searches
+  PairwiseDistances pairwiseDistances;
+  /// nearest neighbor search: exact or lsh
+  std::string neighborSearch;
+  /// approximate nearest neighbor searches
+  ApproximateNeighbors approximateNeighbors;
+  /// nearest neighbors saved by earlier runs
+  NeighborCache neighborCache;
+  /// precomputed distances replacing the distance computations, if any
+  DistanceMatrix inputDistances;
+  /// row of inputDistances of each data set instance index
+  std::vector<unsigned int> inputDistanceRows;
+  /// keep the pair distances between score computations?
+  bool keepDistances;
   /// number of attributes to remove each iteration if running iteratively
   unsigned int removePerIteration;
   /// are we removing a percentage per iteration?
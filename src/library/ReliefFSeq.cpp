@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <map>
 #include <vector>
 
 #include <boost/lexical_cast.hpp>
@@ -147,6 +148,22 @@ bool ReliefFSeq::ComputeAttributeScores() {
 	// pre-compute all instance-to-instance distances and get nearest neighbors
 	PreComputeDistances();
 
+	// MuDeltaAlphas and SigmaDeltaAlphas read k hits and k misses of the
+	// first miss class from every instance
+	for(unsigned int i = 0; i < m; ++i) {
+		DatasetInstance* S_i = dataset->GetInstance(i);
+		const map<ClassLevel, vector<unsigned int> >& allMisses =
+				S_i->GetNearestMisses();
+		if((S_i->GetNearestHits().size() < k) || !allMisses.size()
+				|| (allMisses.begin()->second.size() < k)) {
+			cerr << endl << "ERROR: ReliefFSeq::ComputeAttributeScores: k: [" << k
+					<< "] is larger than the number of neighbors of instance " << i
+					<< ": Same: " << S_i->GetNearestHits().size()
+					<< ", Different classes: " << allMisses.size() << endl;
+			return false;
+		}
+	}
+
 	// using pseudo-code notation from white board discussion - 7/21/12
 	// changed to use Brett's email (7/21/12) equations - 7/23/12
 	cout << Timestamp() << "Running ReliefFSeq algorithm" << endl;
@@ -257,11 +274,10 @@ pair<double, double> ReliefFSeq::MuDeltaAlphas(unsigned int alpha) {
 		DatasetInstance* S_i = dataset->GetInstance(i);
 
 		// get hits and misses for this instance
-		vector<unsigned int> hits(k);
-		vector<unsigned int> misses(k);
-		map<ClassLevel, vector<unsigned int> > allMisses;
-		S_i->GetNNearestInstances(k, hits, allMisses);
-		misses = allMisses.begin()->second;
+		// assume only one other miss class
+		const vector<unsigned int>& hits = S_i->GetNearestHits();
+		const vector<unsigned int>& misses =
+				S_i->GetNearestMisses().begin()->second;
 
 		// sum over all nearest hits and misses neighbors
 		for(unsigned int j = 0; j < k; ++j) {
@@ -289,9 +305,7 @@ pair<double, double> ReliefFSeq::SigmaDeltaAlphas(unsigned int alpha,
 	for(unsigned int i = 0; i < m; ++i) {
 		DatasetInstance* S_i = dataset->GetInstance(i);
 		/// get hits and misses for this instance
-		vector<unsigned int> hits(k);
-		map<ClassLevel, vector<unsigned int> > allMisses;
-		S_i->GetNNearestInstances(k, hits, allMisses);
+		const vector<unsigned int>& hits = S_i->GetNearestHits();
 		// for all nearest neighbor hits
 		for(unsigned int j = 0; j < k; ++j) {
 			hitSum +=
@@ -301,8 +315,8 @@ pair<double, double> ReliefFSeq::SigmaDeltaAlphas(unsigned int alpha,
 		}
 		// for all nearest neighbor misses
 		// assume only one other miss class
-		vector<unsigned int> misses(k);
-		misses = allMisses.begin()->second;
+		const vector<unsigned int>& misses =
+				S_i->GetNearestMisses().begin()->second;
 		for(unsigned int j = 0; j < k; ++j) {
 			missSum += pow(
 					(diffManhattan(alpha, S_i, dataset->GetInstance(misses[j]))